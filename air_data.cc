@@ -0,0 +1,120 @@
+//======================================================================================
+/** \file  air_data.cc
+ *  This file contains the air data computer, which works out airspeed, pressure
+ *  altitude and rate of climb. See air_data.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "cal_channel.h"
+#include "air_data.h"
+
+/** The pressure of the first point of the altitude table, in 10 Pa */
+#define AIR_TABLE_START     6800
+
+/** Log base 2 of the spacing of the altitude table's points, in 10 Pa */
+#define AIR_TABLE_BITS      6
+
+
+//-------------------------------------------------------------------------------------
+/** Pressure altitude in 0.1 m for every 640 Pa of static pressure from 68.0 kPa,
+ *  3239 m, to 108.3 kPa, -567 m. Straight lines between the points are within 4 cm
+ *  of the curve.
+ */
+
+static const int16_t altitude_table[] PROGMEM =
+{
+    32394, 31661, 30934, 30212, 29495, 28783, 28077, 27376, 26679, 25988,
+    25302, 24620, 23943, 23270, 22602, 21939, 21280, 20625, 19975, 19329,
+    18687, 18049, 17415, 16785, 16159, 15537, 14919, 14305, 13694, 13087,
+    12483, 11884, 11287, 10695, 10105,  9519,  8937,  8357,  7781,  7208,
+     6639,  6072,  5509,  4948,  4391,  3837,  3285,  2737,  2191,  1649,
+     1109,   572,    37,  -494, -1023, -1549, -2073, -2594, -3112, -3628,
+    -4141, -4652, -5161, -5667
+};
+
+/** The number of points in the altitude table */
+#define AIR_TABLE_POINTS    (sizeof (altitude_table) / sizeof (altitude_table[0]))
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an air data computer which hasn't had any readings yet.
+ *  @param per_second The number of static readings each second, which the climb
+ *      rate is worked out from
+ */
+
+air_data::air_data (uint8_t per_second)
+{
+    altitude_cal.set_linear (AIR_TABLE_START, 1, 0);
+    altitude_cal.set_table (altitude_table, AIR_TABLE_POINTS, AIR_TABLE_BITS);
+    rate = per_second;
+    airspeed = 0;
+    altitude = 0;
+    climb = 0;
+    started = false;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes a new airspeed from the pitot tube. Readings below the pitot's
+ *  zero, which come from noise when the air is still, are taken as no airspeed.
+ *  @param speed The indicated airspeed in cm/s
+ */
+
+void air_data::put_pitot (int16_t speed)
+{
+    airspeed = speed > 0 ? speed : 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method brings the altitude and climb rate up to date with a new static
+ *  reading. The tracker predicts the altitude from the last one and the climb rate,
+ *  then moves the altitude a fraction alpha and the climb rate a fraction beta of
+ *  the way by which the new reading misses the prediction.
+ *  @param pressure The static pressure in 10 Pa
+ */
+
+void air_data::put_static (int16_t pressure)
+{
+    int32_t measured = (int32_t)altitude_cal.convert ((uint16_t)pressure)
+                       * (1L << AIR_FRACTION_BITS);
+
+    if (!started)
+    {
+        altitude = measured;
+        climb = 0;
+        started = true;
+        return;
+    }
+
+    altitude += climb;
+    int32_t miss = measured - altitude;
+    altitude += miss >> AIR_ALPHA_SHIFT;
+    climb += miss >> AIR_BETA_SHIFT;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the rate of climb, negative when descending.
+ *  @return The rate of climb in cm/s
+ */
+
+int16_t air_data::get_climb (void) const
+{
+    int32_t speed = (climb * 10 * rate) >> AIR_FRACTION_BITS;
+
+    if (speed > 32767)
+        return (32767);
+    if (speed < -32768)
+        return (-32768);
+    return ((int16_t)speed);
+}
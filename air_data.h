@@ -0,0 +1,80 @@
+//======================================================================================
+/** \file  air_data.h
+ *  This file contains the air data computer, which works out the indicated airspeed,
+ *  the pressure altitude and the rate of climb from the pitot tube and static port.
+ *  The pitot channel's calibration table already turns dynamic pressure into
+ *  indicated airspeed, the square root of 2 q / rho at sea level density, so the
+ *  airspeed is taken as it comes. The static pressure is turned into pressure
+ *  altitude in the standard atmosphere, h = 44331 m (1 - (p / 101325 Pa)^0.1903),
+ *  by another table in program memory through a cal_channel, so there's no power
+ *  function to work out onboard.
+ *
+ *  Each static reading brings an alpha-beta tracker up to date, which smooths the
+ *  altitude and estimates the rate of climb at the same time with two shifts and a
+ *  few adds; the gains are powers of two chosen so the tracker is close to critically
+ *  damped. A 12-bit static reading is about 2 m of altitude, so the climb rate needs
+ *  the smoothing; it follows a change in about a second.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _AIR_DATA_H_                        // To prevent *.h file from being included
+#define _AIR_DATA_H_                        // in a source file more than once
+
+#include <stdint.h>
+#include "cal_channel.h"
+
+/** The altitude tracker's gains as shifts: alpha is 1/16 and beta 1/512 */
+#define AIR_ALPHA_SHIFT     4
+#define AIR_BETA_SHIFT      9
+
+/** The number of fraction bits kept in the tracker's altitude and climb */
+#define AIR_FRACTION_BITS   8
+
+
+//-------------------------------------------------------------------------------------
+/** This class works out the air data from pitot and static readings in engineering
+ *  units, as the sensor task's calibrations give them.
+ */
+
+class air_data
+{
+    protected:
+        cal_channel altitude_cal;           // Turns pressure into altitude
+        int16_t airspeed;                   // Indicated airspeed in cm/s
+        int32_t altitude;                   // Altitude in 0.1 m, with fraction bits
+        int32_t climb;                      // Climb in 0.1 m per reading, likewise
+        uint8_t rate;                       // Static readings per second
+        bool started;                       // The tracker has had a reading
+
+    public:
+        // The constructor sets up the altitude table for a given static sample rate
+        air_data (uint8_t);
+
+        // This method takes a new airspeed from the pitot tube
+        void put_pitot (int16_t);
+
+        // This method brings the altitude and climb up to date with a static reading
+        void put_static (int16_t);
+
+        /** This method starts the altitude tracker afresh at the next reading. */
+        void restart (void) { started = false; }
+
+        /** This method returns the indicated airspeed in cm/s. */
+        int16_t get_airspeed (void) const { return (airspeed); }
+
+        /** This method returns the pressure altitude in 0.1 m. */
+        int16_t get_altitude (void) const
+            { return ((int16_t)(altitude >> AIR_FRACTION_BITS)); }
+
+        // This method returns the rate of climb in cm/s
+        int16_t get_climb (void) const;
+};
+
+#endif // _AIR_DATA_H_
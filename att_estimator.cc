@@ -0,0 +1,361 @@
+//======================================================================================
+/** \file  att_estimator.cc
+ *  This file contains a fixed point attitude estimator for a 6 DOF unit. See
+ *  att_estimator.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdint.h>
+#include "att_estimator.h"
+
+/** CORDIC lengthens the vector it turns by 1.6468 times; this undoes that, with 15
+ *  fraction bits */
+#define ATT_CORDIC_SCALE    19898L
+
+/** The rate to quaternion step gain for a 1 microsecond period, in 1/1000 of the
+ *  gain's units: half of 0.1 degree in radians, times 2 ^ (16 + ATT_STEP_SHIFT) for
+ *  the fraction bits of the quaternion and the step shift, times 2 ^ 14 */
+#define ATT_GAIN_PER_US     3748L
+
+
+//-------------------------------------------------------------------------------------
+/** This table holds the angles CORDIC turns through at each step, atan (2 ^ -step),
+ *  in binary angle units of 1/65536 turn. It's small enough to stay in SRAM, which
+ *  is quicker to read in the loop than flash.
+ */
+
+static const int16_t atan_table[ATT_CORDIC_STEPS] =
+    {
+    8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3
+    };
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the angle and length of a vector with CORDIC. The vector is
+ *  turned towards the x axis, a step at a time through angles whose tangents are
+ *  powers of two, so each step takes only shifts and adds, and the turns are added up.
+ *  @param x The x component of the vector, no bigger than ATT_CORDIC_MAX
+ *  @param y The y component of the vector, no bigger than ATT_CORDIC_MAX
+ *  @param p_length A variable into which the length of the vector is put, or NULL
+ *  @return The angle of the vector from the x axis, in 1/65536 turn, so that 16384
+ *      is 90 degrees and -32768 is 180
+ */
+
+int16_t att_vector (int16_t x, int16_t y, int16_t* p_length)
+{
+    uint16_t angle = 0;
+
+    // CORDIC only turns through 100 degrees or so, so the left half is flipped over
+    if (x < 0)
+    {
+        x = -x;
+        y = -y;
+        angle = 0x8000;
+    }
+
+    for (uint8_t step = 0; step < ATT_CORDIC_STEPS; step++)
+    {
+        int16_t dx = y >> step;
+        int16_t dy = x >> step;
+
+        if (y > 0)
+        {
+            x += dx;
+            y -= dy;
+            angle += atan_table[step];
+        }
+        else
+        {
+            x -= dx;
+            y += dy;
+            angle -= atan_table[step];
+        }
+    }
+
+    if (p_length != 0)
+        *p_length = (int16_t)(((int32_t)x * ATT_CORDIC_SCALE) >> 15);
+
+    return ((int16_t)angle);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function changes an angle in 1/65536 turn into 0.1 degree.
+ *  @param angle The angle in 1/65536 turn
+ *  @return The angle in 0.1 degree
+ */
+
+static inline int16_t tenths (int16_t angle)
+{
+    return ((int16_t)(((int32_t)angle * 225) >> 12));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the Euler angles of a quaternion, from those terms of its
+ *  rotation matrix which are needed. The terms are worked out with 13 fraction bits,
+ *  so they can go straight into att_vector().
+ *  @param q The quaternion, of unit length, with 14 fraction bits
+ *  @param angles A structure into which the angles are put
+ */
+
+static void euler (const int16_t* q, att_angles& angles)
+{
+    int16_t across, down, length;
+
+    // Roll from the row of the matrix which gives the y and z components of gravity
+    across = (int16_t)(((int32_t)q[0] * q[1] + (int32_t)q[2] * q[3]) >> 14);
+    down = 8192 - (int16_t)(((int32_t)q[1] * q[1] + (int32_t)q[2] * q[2]) >> 14);
+    angles.roll = tenths (att_vector (down, across, &length));
+
+    // The length of that row's y and z terms is the cosine of the pitch
+    across = (int16_t)(((int32_t)q[0] * q[2] - (int32_t)q[3] * q[1]) >> 14);
+    angles.pitch = tenths (att_vector (length, across));
+
+    across = (int16_t)(((int32_t)q[0] * q[3] + (int32_t)q[1] * q[2]) >> 14);
+    down = 8192 - (int16_t)(((int32_t)q[2] * q[2] + (int32_t)q[3] * q[3]) >> 14);
+    angles.yaw = tenths (att_vector (down, across));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an estimator which waits for a sample at 1 g to set its
+ *  attitude.
+ *  @param period_us The time between samples in microseconds, no more than
+ *      ATT_PERIOD_MAX
+ */
+
+att_estimator::att_estimator (uint16_t period_us)
+{
+    if (period_us > ATT_PERIOD_MAX)
+        period_us = ATT_PERIOD_MAX;
+
+    rate_gain = (int16_t)(((int32_t)period_us * ATT_GAIN_PER_US + 500) / 1000);
+
+    // The integral has 22 fraction bits and the error 14, so 2 ^ 8 * period / 10 ^ 6
+    ki_step = (int16_t)(((int32_t)ATT_KI * period_us * 16 + 31250) / 62500);
+
+    quat[0] = 1L << 30;
+    quat[1] = quat[2] = quat[3] = 0;
+    integral[0] = integral[1] = integral[2] = 0;
+    started = false;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the attitude from the direction of gravity alone, as the shortest
+ *  turn, about a level axis, which takes the z axis up onto it, and forgets the 
+ *  learned gyro biases. Gravity says nothing about heading, so the yaw this gives is
+ *  only a starting point; it isn't zero when the unit is tilted in both roll and 
+ *  pitch.
+ *  @param accel The acceleration, of unit length, with 14 fraction bits
+ */
+
+void att_estimator::start (const int16_t* accel)
+{
+    int16_t q[4], length, part;
+
+    // The quaternion (1 + z, y, -x, 0) turns z up onto the acceleration; it's worked
+    // on with 12 fraction bits so its length fits in att_vector()
+    q[0] = (16384 + accel[2]) >> 2;
+    q[1] = accel[1] >> 2;
+    q[2] = -accel[0] >> 2;
+    q[3] = 0;
+    att_vector (q[0], q[1], &part);
+    att_vector (part, q[2], &length);
+
+    // Upside down, that quaternion vanishes; a half turn about x does the job
+    if (length < 64)
+    {
+        quat[0] = quat[2] = quat[3] = 0;
+        quat[1] = 1L << 30;
+    }
+    else
+    {
+        for (uint8_t index = 0; index < 4; index++)
+            quat[index] = ((int32_t)q[index] * (1L << 17) / length) * (1L << 13);
+    }
+
+    integral[0] = integral[1] = integral[2] = 0;
+    started = true;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method brings the attitude up to date with a new sample. The rates, corrected
+ *  by the feedback from the accelerometers if they read about 1 g, turn the quaternion
+ *  through one sample period, and the quaternion is then pulled back to unit length.
+ *  @param accel An array of the three accelerations in mg
+ *  @param gyro An array of the three rates in 0.1 degree/s
+ */
+
+void att_estimator::update (const int16_t* accel, const int16_t* gyro)
+{
+    int16_t unit[3];                        // Acceleration of unit length, Q14
+    int16_t error[3];                       // Error between gravity and unit, Q14
+    int16_t rate[3];                        // Corrected rates, scaled to a step
+    int16_t q[4];                           // Top of the quaternion, Q14
+    int16_t length, part;
+    uint8_t index;
+
+    // Accelerations of over 4 g are clipped so CORDIC can't overflow; they're far too
+    // big to be taken for gravity anyway
+    for (index = 0; index < 3; index++)
+    {
+        unit[index] = accel[index];
+        if (unit[index] > 4000)
+            unit[index] = 4000;
+        else if (unit[index] < -4000)
+            unit[index] = -4000;
+    }
+    att_vector (unit[0], unit[1], &part);
+    att_vector (part, unit[2], &length);
+
+    bool gravity = (length >= ATT_ACCEL_MIN && length <= ATT_ACCEL_MAX);
+    if (gravity)
+    {
+        int16_t inverse = (int16_t)((1L << 24) / length);
+        for (index = 0; index < 3; index++)
+            unit[index] = (int16_t)(((int32_t)unit[index] * inverse) >> 10);
+    }
+
+    if (!started)
+    {
+        if (gravity)
+            start (unit);
+        return;
+    }
+
+    for (index = 0; index < 4; index++)
+        q[index] = (int16_t)(quat[index] >> 16);
+
+    // The error is the cross product of the measured gravity with the predicted one
+    if (gravity)
+    {
+        int16_t half_x, half_y, half_z;     // Half the predicted gravity, Q14
+
+        half_x = (int16_t)(((int32_t)q[1] * q[3] - (int32_t)q[0] * q[2]) >> 14);
+        half_y = (int16_t)(((int32_t)q[0] * q[1] + (int32_t)q[2] * q[3]) >> 14);
+        half_z = (int16_t)(((int32_t)q[0] * q[0] + (int32_t)q[3] * q[3]) >> 14) - 8192;
+
+        error[0] = (int16_t)(((int32_t)unit[1] * half_z
+                              - (int32_t)unit[2] * half_y) >> 13);
+        error[1] = (int16_t)(((int32_t)unit[2] * half_x
+                              - (int32_t)unit[0] * half_z) >> 13);
+        error[2] = (int16_t)(((int32_t)unit[0] * half_y
+                              - (int32_t)unit[1] * half_x) >> 13);
+    }
+
+    for (index = 0; index < 3; index++)
+    {
+        int32_t omega = gyro[index];
+
+        if (gravity)
+        {
+            // The integral is limited before it's added to, so it can't overflow
+            integral[index] += (int32_t)error[index] * ki_step;
+            if (integral[index] > ((int32_t)ATT_BIAS_MAX << 22))
+                integral[index] = (int32_t)ATT_BIAS_MAX << 22;
+            else if (integral[index] < -((int32_t)ATT_BIAS_MAX << 22))
+                integral[index] = -((int32_t)ATT_BIAS_MAX << 22);
+
+            omega += ((int32_t)error[index] * ATT_KP) >> 14;
+        }
+        omega += integral[index] >> 22;
+
+        if (omega > ATT_RATE_MAX)
+            omega = ATT_RATE_MAX;
+        else if (omega < -ATT_RATE_MAX)
+            omega = -ATT_RATE_MAX;
+        rate[index] = (int16_t)((omega * rate_gain) >> 14);
+    }
+
+    // The quaternion is turned by half its product with the rates
+    quat[0] += (-(int32_t)q[1] * rate[0] - (int32_t)q[2] * rate[1]
+                - (int32_t)q[3] * rate[2]) >> ATT_STEP_SHIFT;
+    quat[1] += ((int32_t)q[0] * rate[0] + (int32_t)q[2] * rate[2]
+                - (int32_t)q[3] * rate[1]) >> ATT_STEP_SHIFT;
+    quat[2] += ((int32_t)q[0] * rate[1] - (int32_t)q[1] * rate[2]
+                + (int32_t)q[3] * rate[0]) >> ATT_STEP_SHIFT;
+    quat[3] += ((int32_t)q[0] * rate[2] + (int32_t)q[1] * rate[1]
+                - (int32_t)q[2] * rate[0]) >> ATT_STEP_SHIFT;
+
+    // A quaternion of length 1 + e is brought back to 1 by taking off e times itself,
+    // which is close enough as the length only strays a little each step
+    int32_t square = 0;
+    for (index = 0; index < 4; index++)
+    {
+        q[index] = (int16_t)(quat[index] >> 16);
+        square += (int32_t)q[index] * q[index];
+    }
+    int32_t shortfall = (1L << 28) - square;
+    if (shortfall > (1L << 22))
+        shortfall = 1L << 22;
+    else if (shortfall < -(1L << 22))
+        shortfall = -(1L << 22);
+    int16_t shrink = (int16_t)(shortfall >> 8);
+    for (index = 0; index < 4; index++)
+        quat[index] += ((int32_t)q[index] * shrink) >> 5;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the Euler angles of the attitude.
+ *  @param angles A structure into which the roll, pitch and yaw are put
+ */
+
+void att_estimator::get_angles (att_angles& angles) const
+{
+    int16_t q[4];
+
+    for (uint8_t index = 0; index < 4; index++)
+        q[index] = (int16_t)(quat[index] >> 16);
+    euler (q, angles);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the attitude of this unit relative to another one, such as that
+ *  of the canopy relative to the chassis, as the Euler angles which turn the other
+ *  unit's axes onto this one's and as the single angle through which they're turned.
+ *  @param other The estimator of the unit this one's attitude is measured from
+ *  @param angles A structure into which the relative roll, pitch and yaw are put
+ *  @return The total angle between the two units in 0.1 degree, 0 to 1800
+ */
+
+uint16_t att_estimator::relative_to (const att_estimator& other,
+                                     att_angles& angles) const
+{
+    int16_t a[4], b[4], r[4];
+    uint8_t index;
+
+    for (index = 0; index < 4; index++)
+    {
+        a[index] = (int16_t)(other.quat[index] >> 16);
+        b[index] = (int16_t)(quat[index] >> 16);
+    }
+
+    // The conjugate of the other attitude times this one
+    r[0] = (int16_t)(((int32_t)a[0] * b[0] + (int32_t)a[1] * b[1]
+                      + (int32_t)a[2] * b[2] + (int32_t)a[3] * b[3]) >> 14);
+    r[1] = (int16_t)(((int32_t)a[0] * b[1] - (int32_t)a[1] * b[0]
+                      - (int32_t)a[2] * b[3] + (int32_t)a[3] * b[2]) >> 14);
+    r[2] = (int16_t)(((int32_t)a[0] * b[2] + (int32_t)a[1] * b[3]
+                      - (int32_t)a[2] * b[0] - (int32_t)a[3] * b[1]) >> 14);
+    r[3] = (int16_t)(((int32_t)a[0] * b[3] - (int32_t)a[1] * b[2]
+                      + (int32_t)a[2] * b[1] - (int32_t)a[3] * b[0]) >> 14);
+    euler (r, angles);
+
+    // A quaternion holds the cosine and sine of half the angle it turns through
+    int16_t part, sine, cosine = r[0] < 0 ? -r[0] : r[0];
+    att_vector (r[1] >> 2, r[2] >> 2, &part);
+    att_vector (part, r[3] >> 2, &sine);
+    return ((uint16_t)tenths (att_vector (cosine >> 2, sine)) * 2);
+}
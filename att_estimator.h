@@ -0,0 +1,134 @@
+//======================================================================================
+/** \file  att_estimator.h
+ *  This file contains a fixed point attitude estimator for a 6 DOF unit, a Mahony
+ *  complementary filter. The attitude is kept as a quaternion which is turned by the
+ *  rate gyros at each sample. Gyros drift, so the direction of gravity the quaternion
+ *  predicts is compared with the one the accelerometers measure; the cross product of
+ *  the two is an angle error which is fed back into the rates, proportionally to pull
+ *  the attitude in and through an integral to learn the gyro biases. The feedback is
+ *  only used while the accelerometers read close to 1 g, so that turns and the jolt
+ *  of the parachute opening don't pull the attitude off. Roll and pitch are held to
+ *  gravity; there's no magnetometer, so yaw is the integral of the rates and drifts.
+ *
+ *  Everything is done in integers with 16 x 16 -> 32 bit multiplies, which the AVR's
+ *  hardware multiplier does quickly; there's no floating point and no libm. The
+ *  quaternion is kept with 30 fraction bits so slow rates aren't lost, but only its
+ *  top 16 bits are used in the products. It's kept at unit length by a first order
+ *  correction each step, which needs no square root or division. Angles come out of
+ *  the quaternion through CORDIC, which finds the angle and length of a vector with
+ *  shifts and adds: att_vector().
+ *
+ *  The 6 DOF units are taken to be mounted with x forward and z up, so that the
+ *  accelerometers read +1 g on z when level, and with rates positive by the right
+ *  hand rule about the same axes. Angles are in 0.1 degree, rates in 0.1 degree/s
+ *  and accelerations in mg, as the sensor task's calibrations give them.
+ *
+ *  This file and att_estimator.cc build both for the AVR and for the ground station
+ *  PC, where the estimator can be checked against logged scans.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _ATT_ESTIMATOR_H_                   // To prevent *.h file from being included
+#define _ATT_ESTIMATOR_H_                   // in a source file more than once
+
+#include <stdint.h>
+
+/** The number of CORDIC steps; each one gives about one more bit of angle */
+#define ATT_CORDIC_STEPS    13
+
+/** The largest size of the numbers given to att_vector(), so that they don't overflow
+ *  as CORDIC lengthens the vector by up to 1.65 times */
+#define ATT_CORDIC_MAX      8192
+
+/** The proportional feedback gain, in 0.1 degree/s of rate per radian of angle error;
+ *  573 is 1 rad/s per radian, which pulls the attitude in with a 1 s time constant */
+#define ATT_KP              573
+
+/** The integral feedback gain, in 0.1 degree/s per second per radian of error */
+#define ATT_KI              11
+
+/** The largest gyro bias the integral may learn, in 0.1 degree/s */
+#define ATT_BIAS_MAX        500
+
+/** The fastest rate which is used, in 0.1 degree/s; rates are limited to this so
+ *  the quaternion arithmetic can't overflow */
+#define ATT_RATE_MAX        9000
+
+/** Accelerations whose size is between these, in mg, are taken to be gravity alone */
+#define ATT_ACCEL_MIN       800
+#define ATT_ACCEL_MAX       1200
+
+/** The longest sample period the estimator can be run with, in microseconds */
+#define ATT_PERIOD_MAX      8000
+
+/** The shift which takes the quaternion products down to the size of one step */
+#define ATT_STEP_SHIFT      2
+
+
+// This function finds the angle and length of a vector with CORDIC
+int16_t att_vector (int16_t, int16_t, int16_t* = 0);
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds an attitude as Euler angles in 0.1 degree: roll about x,
+ *  then pitch about y, then yaw about z. */
+
+typedef struct
+{
+    int16_t roll;                           // Roll angle, -1800 to 1800
+    int16_t pitch;                          // Pitch angle, -900 to 900
+    int16_t yaw;                            // Yaw angle, -1800 to 1800
+} att_angles;
+
+
+//-------------------------------------------------------------------------------------
+/** This class estimates the attitude of one 6 DOF unit. Call update() with each new
+ *  sample; the first sample in which the accelerometers read about 1 g sets the roll
+ *  and pitch, and updates before then do nothing.
+ */
+
+class att_estimator
+{
+    protected:
+        int32_t quat[4];                    // Attitude quaternion, 30 fraction bits
+        int32_t integral[3];                // Integral feedback, 0.1 deg/s << 22
+        int16_t rate_gain;                  // Rate to quaternion step, 14 fraction bits
+        int16_t ki_step;                    // Integral gain for one sample
+        bool started;                       // The attitude has been set from gravity
+
+        // This method sets the attitude from the direction of gravity
+        void start (const int16_t*);
+
+    public:
+        // The constructor creates an estimator for a given sample period
+        att_estimator (uint16_t);
+
+        // This method brings the attitude up to date with a new sample
+        void update (const int16_t*, const int16_t*);
+
+        // This method finds the Euler angles of the attitude
+        void get_angles (att_angles&) const;
+
+        // This method finds the angles of one attitude relative to another
+        uint16_t relative_to (const att_estimator&, att_angles&) const;
+
+        /** This method makes the next update set the attitude from gravity afresh. */
+        void restart (void) { started = false; }
+
+        /** This method returns true once the attitude has been set from gravity. */
+        bool is_started (void) const { return (started); }
+
+        /** This method returns the gyro bias which has been learned on one axis, in
+         *  0.1 degree/s. */
+        int16_t get_bias (uint8_t axis) const 
+            { return ((int16_t)-(integral[axis] >> 22)); }
+};
+
+#endif // _ATT_ESTIMATOR_H_
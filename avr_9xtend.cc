@@ -16,6 +16,8 @@
  *      \li 12-16-07  JRR  Changed puts() to (char const*) to shut up a GCC warning
  *      \li 12-18-07  JRR  Merged lots of stuff with avr_serial for efficiency
  *	\li 05-05-08  DSC  Modifying radio modem class to operate XTend module
+ *	\li 10-18-26  DSC  Blocking setup code replaced by task_radio_setup
+ *	\li 10-18-26  DSC  Pin sleep put back in service
  */
 //**************************************************************************************
 
@@ -27,46 +29,31 @@
 
 //--------------------------------------------------------------------------------------
 /** This constructor creates a radio modem object by calling the serial port 
- *  constructor setting up the input and output pins for CTS and sleep mode, and
- *  sending the correct setup codes to the radio modem. Due to the need for dumb delay
- *  loops to satisfy the radio's timing requirements, this constructor takes several
- *  seconds to execute. 
- *  @param a_divisor A baud rate divisor to give to the UART constructor
+ *  constructor and setting up the input and output pins for CTS and sleep mode. It
+ *  doesn't send any setup codes to the radio modem, because the radio's guard times
+ *  would hold up the processor for several seconds; a task_radio_setup task does 
+ *  that in the background instead. Until that task has finished, ready_for_data()
+ *  returns false so that nothing else is sent to the radio. 
+ *  @param a_setting A baud rate setting to give to the UART constructor
  *  @param cts_bitmask Bitmask for the Clear To Send flow control bit
  *  @param sleep_bitmask Bitmask for the sleep control line (default 0, sleep unused)
  */
 
-avr_9xtend::avr_9xtend (unsigned char a_divisor, unsigned char cts_bitmask,
+avr_9xtend::avr_9xtend (unsigned int a_setting, unsigned char cts_bitmask,
     unsigned char sleep_bitmask = 0) 
-    : avr_uart (a_divisor, cts_bitmask)
+    : avr_uart (a_setting, cts_bitmask)
 {
     sleep_mask = sleep_bitmask;             // Save the bitmask for the sleep bit
 
     setup_error = false;
+    timeout = 0;
 
-// Set bitmask for Clear To Send flow control bit
-
+    // Hold off other senders until the setup task has configured the radio
+    command_mode = true;
 
     // If sleep line is used, set up the sleep pin as an output and awaken radio
-//     A9XS_SLEEP_DDR |= sleep_mask;
-//     A9XS_SLEEP_PRT &= ~sleep_mask;
-
-    // Put the radio modem into command mode and tell it to use sleep mode 1, the mode
-    // in which pin 2 controls whether it's asleep or awake. Dumb delay loops are used
-    // to ensure that the "guard times" for the radio are satisfied
-//     for (volatile long dumbdelay = 0L; dumbdelay < 100000L; dumbdelay++);
-//     puts ("+++");
-//     if (getchar () != 'O')  setup_error = true;
-//     if (getchar () != 'K')  setup_error = true;
-//     if (getchar () != '\r') setup_error = true;
-//     puts ("ATSM1,WR,CN\r\n");
-//     if (getchar () != 'O')  setup_error = true;
-//     if (getchar () != 'K')  setup_error = true;
-//     if (getchar () != '\r') setup_error = true;
-
-    // Even though nobody's likely to see this, we can at least try to complain
-    if (setup_error) puts ("Error setting up radio modem\r\n");
-//  else             puts ("Radio modem setup OK\r\n");
+    A9XS_SLEEP_DDR |= sleep_mask;
+    A9XS_SLEEP_PRT &= ~sleep_mask;
 }
 
 
@@ -77,10 +64,10 @@ avr_9xtend::avr_9xtend (unsigned char a_divisor, unsigned char cts_bitmask,
  *  does nothing. 
  */
 
-// void avr_9xtend::sleep (void)
-// {
-//     A9XS_SLEEP_PRT |= sleep_mask;
-// }
+void avr_9xtend::sleep (void)
+{
+    A9XS_SLEEP_PRT |= sleep_mask;
+}
 
 
 //--------------------------------------------------------------------------------------
@@ -88,7 +75,7 @@ avr_9xtend::avr_9xtend (unsigned char a_divisor, unsigned char cts_bitmask,
  *  the sleep pin isn't being used, this method does nothing. 
  */
 
-// void avr_9xtend::wake_up (void)
-// {
-//     A9XS_SLEEP_PRT &= ~sleep_mask;
-// }
+void avr_9xtend::wake_up (void)
+{
+    A9XS_SLEEP_PRT &= ~sleep_mask;
+}
@@ -15,12 +15,26 @@
  *      \li 04-16-07  JO   Added write (unsigned long)
  *      \li 12-16-07  JRR  Changed puts() to (char const*) to shut up a GCC warning
  *      \li 12-18-07  JRR  Merged lots of stufADCf with avr_serial for efficiency
+ *      \li 10-18-26  DSC  Setup moved to the non-blocking task_radio_setup
+ *      \li 10-18-26  DSC  Pin sleep put back in service
+ *      \li 10-18-26  DSC  Added asleep() so quiet A/D conversions can be scheduled
  */
 //*************************************************************************************
 
 #ifndef _AVR_9XTEND_H_                    // To prevent *.h file from being included
 #define _AVR_9XTEND_H_                    // in a source file more than once
 
+/** The output port (PORTA, PORTB, etc.) used for the radio's sleep pin. This must match
+ *  the data direction register in A9XS_SLEEP_DDR */
+#define A9XS_SLEEP_PRT      PORTD
+
+/** The data direction register (DDRA, DDRB, etc.) for the sleep pin */
+#define A9XS_SLEEP_DDR      DDRD
+
+/** The time the radio takes to wake up from pin sleep before it can take data, in 
+ *  microseconds. The XTend data sheet gives a worst case wake time well under this */
+#define A9XS_WAKE_TIME      50000L
+
 /** This class communicates with the 9XTend radio. It is a descendent of the uart
  *  class from avr_serial.*. It operates the serial port with a baud rate which is 
  *  set in avr_9xtend.h.
@@ -32,16 +46,38 @@ class avr_9xtend : public avr_uart
         unsigned char sleep_mask;           // Bitmask for the sleep bit
         volatile unsigned int timeout;      // Counter for software timeouts
         bool setup_error;                   // Flag for problems setting up radio
+        bool command_mode;                  // True while AT commands are being sent
 
     public:
         // The constructor creates the radio modem object and assigns port pins
-        avr_9xtend (unsigned char, unsigned char, unsigned char);
+        avr_9xtend (unsigned int, unsigned char, unsigned char);
+
+        void sleep (void);                  // Put the radio into sleep mode
+        void wake_up (void);                // Awaken the radio modem
 
-//         void sleep (void);                  // Put the radio into sleep mode
-//         void wake_up (void);                // Awaken the radio modem
+        /** This method returns true if a sleep pin is connected, so the radio can 
+         *  be put to sleep to save power. */
+        bool can_sleep (void) { return (sleep_mask != 0); }
+
+        /** This method returns true if the radio has been put to sleep, in which 
+         *  case it won't send anything to the serial port until it's woken up. */
+        bool asleep (void) 
+            { return (sleep_mask != 0 && (A9XS_SLEEP_PRT & sleep_mask) != 0); }
 
         /** This method returns the number of timeout errors which have occurred. */
         unsigned char timeouts (void) { return timeout; }
+
+        /** This method tells whether the radio can take data to be sent. Data must 
+         *  not be sent while the radio is being configured, because the radio would
+         *  try to interpret it as commands, and any byte sent during the guard times
+         *  around the "+++" escape sequence keeps command mode from being entered. */
+        bool ready_for_data (void) { return (!command_mode); }
+
+        /** This method returns true if the radio could not be configured. */
+        bool setup_failed (void) { return (setup_error); }
+
+    // The setup task runs the radio's command mode and sets the flags above
+    friend class task_radio_setup;
 };
 
 #endif  // _AVR_9XTEND_H_
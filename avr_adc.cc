@@ -5,6 +5,10 @@
  *  Revisions:
  *    \li  01-15-08 JRR Original (somewhat useful) file
  *    \li  02-20-08 CBG Added functionality to make it not hog the processor
+ *    \li  10-18-26 DSC Results read with one ADCW read; fixed the scaling of results
+ *                      and the inverted test in convertDone(); timeout measured in 
+ *                      microseconds; ADMUX only written when the channel changes
+ *    \li  10-18-26 DSC read_once() waits for a running conversion before starting
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -14,87 +18,73 @@
 
 #include <stdlib.h>                         // Include standard library header files
 #include <avr/io.h>
+#include "stl_us_timer.h"                   // Timer measures the conversion timeout
 #include "avr_adc.h"                        // Include header for the A/D class
 
 #define ADC_PRESCALE     0x04               // Default prescaler setting
-#define ADC_RETRIES      10000              // Retries before giving up on conversion
 
 
 //-------------------------------------------------------------------------------------
-/** This constructor sets up an A/D converter. How does it do so?
- *  @param p_serial_port A pointer to the serial port which writes debugging info. 
+/** This constructor sets up an A/D converter, with its clock prescaler set to 
+ *  ADC_PRESCALE and channel 0 selected, and turns it on. 
+ *  @param a_timer A pointer to the task timer which measures conversion timeouts
+ *  @param timeout_us The longest time to wait for a conversion, in microseconds
  */
 	
-avr_adc::avr_adc (void)
+avr_adc::avr_adc (task_timer* a_timer, long timeout_us)
 {
-	ADMUX = 0;                    		// Set reference to AVCC pin voltage
-	ADCSRA = (1 << ADEN) | ADC_PRESCALE;    // Set clock prescaler and turn A/D on
+    p_timer = a_timer;
+    timeout.set_time (0, timeout_us);
+
+    ADMUX = 0;                              // Set reference to AREF pin voltage
+    channel_now = 0;
+    ADCSRA = (1 << ADEN) | ADC_PRESCALE;    // Set clock prescaler and turn A/D on
 }
-// end constructor
+
 
 //-------------------------------------------------------------------------------------
-/** This method takes one A/D reading from the given channel, and returns the value
+/** This method takes one A/D reading from the given channel, and returns the value. 
+ *  If an earlier conversion is still running, as one which timed out may be, it is 
+ *  waited for first, so that its result isn't given back as this channel's. 
  *  \param  channel The A/D channel which is being read must be from 0 to 7
  *  \return The result of the A/D conversion, or 0xFFFF if there was a timeout
  */
 
 unsigned int avr_adc::read_once (unsigned char channel)
 {
-    unsigned int counter;                   // Counter waits for timeouts
+    time_stamp give_up = p_timer->get_time_now ();
+    give_up += timeout;
 
-    // Set the channel
-    ADMUX &= 0b11111000;                    // Clear the channel bits
-    ADMUX |= (channel & 0x07);              // Put channel bits in the register
-
-    // Start a conversion
-    ADCSRA |= (1 << ADSC);
-
-    // Wait until a timeout, or the conversion is finished
-    for (counter = 0; ADCSRA & (1 << ADSC); counter++)
+    // Start once any running conversion is done, then wait for this one to finish;
+    // both waits share the one timeout
+    while (!startConversion (channel))
     {
-        if (counter > ADC_RETRIES)
+        if (p_timer->get_time_now () >= give_up)
             return (0xFFFF);
     }
-	unsigned int tempL = ADCL;		//grabs low byte first
-	unsigned int tempH = ADCH;
-	
-	return (tempH*0xFF+tempL);
-}
-    //read_once end
-    
-//starts the conversion but does not wait
-bool avr_adc::startConversion(unsigned char channel)
-{
-	 // Set the channel
-	ADMUX &= 0b11111000;                    // Clear the channel bits
-	ADMUX |= (channel & 0x07);              // Put channel bits in the register
-	
-	 // Start a conversion
-	ADCSRA |= (1 << ADSC);
-	
-	return true;
-}
-    //end startConversion
-    
-//simply polls to see if the conversion is done
-bool avr_adc::convertDone(void)
-{
-	bool status = false;			//assume it isnt ready
-	
-	if(ADCSRA & (1 << ADSC))
-	{
-	    status = true;			//changes it to true since it was ready
-	}
-	return status;
+    while (!convertDone ())
+    {
+        if (p_timer->get_time_now () >= give_up)
+            return (0xFFFF);
+    }
+
+    return (getValue ());
 }
-    //end convert done
-    
-    //gets the value from the registers
-unsigned int avr_adc::getValue(void)
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts a conversion on the given channel but doesn't wait for it. 
+ *  \param  channel The A/D channel which is to be read, from 0 to 7
+ *  \return True if the conversion was started, false if one was already running
+ */
+
+bool avr_adc::startConversion (unsigned char channel)
 {
-	unsigned int tempL = ADCL;		//grabs low byte first
-	unsigned int tempH = ADCH;
-	
-	return (tempH*0xFF+tempL);		//turns the two registers into 1
+    if (!convertDone ())
+        return (false);
+
+    select (channel);
+    ADCSRA |= (1 << ADSC);
+
+    return (true);
 }
-    //gets the value from the registers
@@ -5,6 +5,9 @@
  *  Revisions:
  *    \li  01-15-08 JRR Original (somewhat useful) file
  *    \li  02-20-08 CBG Added functionality to make it not hog the processor
+ *    \li  10-18-26 DSC Results read with one ADCW read; fixed the scaling of results
+ *                      and the inverted test in convertDone(); timeout measured in 
+ *                      microseconds; ADMUX only written when the channel changes
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -15,34 +18,58 @@
 #ifndef _AVR_ADC_H_                         // To prevent *.h file from being included
 #define _AVR_ADC_H_                         // in a source file more than once
 
+/** The longest time in microseconds which read_once() waits for a conversion. A 
+ *  conversion takes 13 A/D clocks, or 26 us with the default prescaler at 8 MHz, so 
+ *  this only runs out if the converter isn't working */
+#define ADC_TIMEOUT     200L
+
 
 //-------------------------------------------------------------------------------------
-/** This class should run the A/D converter on an AVR processor. It should have some
- *  better comments. 
+/** This class runs the A/D converter on an AVR processor, one conversion at a time. 
+ *  A conversion can be waited for with read_once(), or started with startConversion()
+ *  and picked up with getValue() once convertDone() says it's finished. For scans of
+ *  many channels in the background, see avr_adc_scan.h instead. 
  */
 
 class avr_adc
 {
     protected:
-        // The ADC class needs a pointer to the serial port used to say hello
+        task_timer* p_timer;                // Timer which measures the timeout
+        time_stamp timeout;                 // Longest wait for a conversion
+        unsigned char channel_now;          // Channel which ADMUX is set to
+
+        /** This method points the A/D converter at a channel, writing ADMUX only if
+         *  the channel has changed. */
+        void select (unsigned char channel)
+        {
+            channel &= 0x07;
+            if (channel != channel_now)
+            {
+                ADMUX = (ADMUX & 0xF8) | channel;
+                channel_now = channel;
+            }
+        }
 
     public:
-        // The constructor just says hello at the moment, using the serial port which
-        // is specified in the pointer given to it
-        avr_adc (void);
+        // The constructor turns on the A/D converter and saves the timer it uses
+        avr_adc (task_timer*, long = ADC_TIMEOUT);
 
-        // This could be a function to read one channel once, returning the result as
-        // an unsigned integer. The parameter is the channel number 
+        // This method reads one channel once, waiting for the conversion to finish
         unsigned int read_once (unsigned char);
         
-        //this will start a conversion but not wait until it is ready.
-        bool startConversion(unsigned char );
+        // This method starts a conversion but doesn't wait until it's done
+        bool startConversion (unsigned char);
          
-         //polls to see if conversion is done
-        bool convertDone(void);
+        /** This method checks whether the conversion which was started is done. 
+         *  @return True if the result is ready, false if it's still being converted
+         */
+        bool convertDone (void) { return ((ADCSRA & (1 << ADSC)) == 0); }
          
-         //grabs the values from the registers
-        unsigned int getValue(void);
+        /** This method gets the result of the last conversion. The 16-bit read of 
+         *  ADCW reads the low byte first, as the hardware requires. 
+         *  @return The result, from 0 to 1023
+         */
+        unsigned int getValue (void) { return (ADCW); }
 };
 
 #endif // _AVR_ADC_H_
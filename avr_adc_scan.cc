@@ -0,0 +1,998 @@
+//======================================================================================
+/** \file  avr_adc_scan.cc
+ *  This file contains an interrupt driven A/D converter scan sequencer. See 
+ *  avr_adc_scan.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Scans started by a hardware timer at an exact rate
+ *    \li  10-18-26 DSC Per-channel oversampling and decimation
+ *    \li  10-18-26 DSC Quiet conversions in ADC noise reduction sleep
+ *    \li  10-18-26 DSC Channels can be converted on only some of the scans
+ *    \li  10-18-26 DSC The instant of each channel's conversion is recorded
+ *    \li  10-18-26 DSC Channel report taken off the serial port; bits() and noise() 
+ *                      are sent to the ground in command replies instead
+ *    \li  10-18-26 DSC Noise comparison and scan timing worked from the ground
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "stl_us_timer.h"
+#include "avr_adc_scan.h"
+
+/** A value the A/D converter can't give, marking a channel which has no result yet */
+#define AS_NO_RESULT        0xFFFF
+
+// These registers and bits have different names on different processors. Processors
+// whose A/D converter can be started by Timer 1 compare match B get AS_AUTO_TRIGGER
+#if defined __AVR_ATmega644__ || defined __AVR_ATmega324P__
+    #define AS_TIMER_FLAGS  TIFR1
+    #define AS_AUTO_TRIGGER
+#else
+    #define AS_TIMER_FLAGS  TIFR
+#endif
+
+
+//-------------------------------------------------------------------------------------
+// These variables are shared between the methods of class avr_adc_scan and the A/D
+// complete interrupt service routine; since there's only one A/D converter, they don't
+// need to belong to an object
+
+/** The overflow count kept by the task timer in stl_us_timer.cc */
+extern unsigned int ust_overflows;
+
+/** The list of channel codes to be scanned */
+static uint8_t as_codes[AS_MAX_CHANNELS];
+
+/** The number of channels in the list */
+static volatile uint8_t as_count = 0;
+
+/** Index in the list of the channel being converted */
+static volatile uint8_t as_index = 0;
+
+/** The oversampling exponent n of each channel; 4^n samples are added for a result */
+static uint8_t as_shift[AS_MAX_CHANNELS];
+
+/** Each channel is converted on one scan out of this many */
+static uint8_t as_divider[AS_MAX_CHANNELS];
+
+/** The number of scans until each channel is next converted; 0 means this scan */
+static uint8_t as_countdown[AS_MAX_CHANNELS];
+
+/** Bitmap of the channels which were converted in the scan in each buffer half */
+static volatile uint32_t as_fresh[2];
+
+/** The bit in the bitmap for the channel being converted */
+static volatile uint32_t as_bit;
+
+/** How many samples of the current channel's oversampling group have been taken */
+static volatile uint8_t as_taken = 0;
+
+/** The first sample of the current group; the noise is measured from it */
+static volatile uint16_t as_first;
+
+/** The sum of the samples in the current group */
+static volatile uint16_t as_sum;
+
+/** When the first sample of the current group was taken, after the start of the scan */
+static volatile uint16_t as_group_start;
+
+/** The sum of the squared differences of the samples from the group's first one */
+static volatile uint32_t as_sum_sq;
+
+/** The noise variance of each channel in LSB^2 times 16, averaged over about eight 
+ *  results; [0] holds it for conversions made awake and [1] for those made asleep */
+static volatile uint32_t as_variance[2][AS_MAX_CHANNELS];
+
+/** Each channel's previous result, used to find the noise of channels which aren't 
+ *  oversampled, or AS_NO_RESULT before the first one */
+static uint16_t as_previous[AS_MAX_CHANNELS];
+
+/** Which channels are to be converted with the processor asleep */
+static bool as_quiet[AS_MAX_CHANNELS];
+
+/** True when a quiet channel's conversion is waiting for run_quiet() to start it */
+static volatile bool as_waiting = false;
+
+/** True while the processor sleeps through a conversion; the interrupt clears it */
+static volatile bool as_asleep = false;
+
+/** True if every sample in the current oversampling group was taken asleep */
+static volatile bool as_group_quiet;
+
+/** When true, quiet channels are converted awake in every other scan so the noise with
+ *  and without sleeping can be compared */
+static bool as_compare = false;
+
+/** The double buffer; one half is filled while the other holds the last full scan */
+static volatile uint16_t as_results[2][AS_MAX_CHANNELS];
+
+/** The time at which the scan in each half of the buffer was started */
+static volatile uint32_t as_scan_time[2];
+
+/** The instant at which each channel in each half of the buffer was sampled, in timer
+ *  counts after the start of its scan; only those of fresh channels are meaningful */
+static volatile uint16_t as_offsets[2][AS_MAX_CHANNELS];
+
+/** Which half of the buffer the running scan writes into */
+static volatile uint8_t as_write_half = 0;
+
+/** Counts complete scans; the reader uses it to detect a scan finishing mid-copy */
+static volatile uint8_t as_sequence = 0;
+
+/** True from the start of a scan until its last conversion is done */
+static volatile bool as_running = false;
+
+/** True once at least one scan has been completed */
+static volatile bool as_have_frame = false;
+
+/** The time between timed scans in timer counts, or 0 if scans aren't timed */
+static volatile uint16_t as_period = 0;
+
+/** When the previous timed scan started, to measure the time between scans */
+static volatile uint32_t as_last_start;
+
+/** True once as_last_start holds the start of a timed scan */
+static volatile bool as_have_start = false;
+
+/** The greatest difference between the measured and set time between scans */
+static volatile uint16_t as_jitter = 0;
+
+/** The greatest time from a timer compare match to the start of a scan */
+static volatile uint16_t as_latency = 0;
+
+/** Number of timer triggers which came while a scan was still running */
+static volatile uint16_t as_overruns = 0;
+
+#ifdef AS_AUTO_TRIGGER
+    /** The time at which the timer will next trigger a scan */
+    static volatile uint32_t as_next_trigger;
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads the task timer, the same way task_timer::get_time_now() does,
+ *  but without turning interrupts back on, so it can be used in an interrupt service
+ *  routine. If the hardware counter has overflowed but the overflow interrupt hasn't 
+ *  run yet, the overflow is counted here. 
+ *  @return The current time in timer counts
+ */
+
+static inline uint32_t as_time_now (void)
+{
+    uint16_t low = TCNT1;
+    uint16_t high = ust_overflows;
+
+    if ((AS_TIMER_FLAGS & (1 << TOV1)) && low < 0x8000)
+        high++;
+
+    return (((uint32_t)high << 16) | low);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function points the A/D converter, and the external multiplexer, at the given
+ *  channel. The reference and adjustment bits of ADMUX are left alone. 
+ *  @param code The channel code, made with the AS_CHANNEL() macro
+ */
+
+static inline void as_select (uint8_t code)
+{
+    ADMUX = (ADMUX & 0xE0) | (code & 0x07);
+    AS_MUX_PORT = (AS_MUX_PORT & ~AS_MUX_BITS) | ((code >> 3) & AS_MUX_BITS);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the next channel which is due to be converted in this scan, 
+ *  starting with the given one, and selects it. Channels which aren't due keep their 
+ *  results from the previous scan in the half of the buffer being written. It must 
+ *  be called with interrupts disabled. 
+ *  @param index The place in the list of the first channel which might be due
+ *  @param bit The bit for that channel in the fresh channel bitmap
+ *  @param half The half of the buffer being written
+ *  @return True if a channel was selected, false if no more are due in this scan
+ */
+
+static inline bool as_find_due (uint8_t index, uint32_t bit, uint8_t half)
+{
+    for ( ; index < as_count; index++, bit <<= 1)
+    {
+        if (as_countdown[index] == 0)
+        {
+            as_index = index;
+            as_bit = bit;
+            as_select (as_codes[index]);
+            return (true);
+        }
+        as_results[half][index] = as_results[half ^ 1][index];
+    }
+    return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function starts the conversion of the channel at as_index. If it's a quiet 
+ *  channel, the conversion is left for run_quiet() to start as the processor goes to
+ *  sleep. It must be called with interrupts disabled. 
+ */
+
+static inline void as_convert (void)
+{
+    if (as_quiet[as_index])
+        as_waiting = true;
+    else
+        ADCSRA |= (1 << ADSC);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds how long it will be until the timer triggers the next scan. 
+ *  @return The time to the next trigger in timer counts, or 0xFFFF if scans aren't 
+ *      being started by the timer
+ */
+
+static inline uint16_t as_trigger_room (void)
+{
+    if (as_period == 0)
+        return (0xFFFF);
+    #ifdef AS_AUTO_TRIGGER
+        return ((uint16_t)(OCR1B - TCNT1));
+    #else
+        return (OCR3A - TCNT3);
+    #endif
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function moves the timers ahead by the time they were stopped while the 
+ *  processor slept through a conversion, since noise reduction mode stops the I/O 
+ *  clock which they count. Carries out of Timer 1 are counted as overflows. It must be
+ *  called with interrupts disabled. 
+ *  @param counts The time for which the timers were stopped, in timer counts
+ */
+
+static inline void as_catch_up (uint16_t counts)
+{
+    uint16_t before = TCNT1;
+    uint16_t after = before + counts;
+
+    TCNT1 = after;
+    if (after < before)
+        ust_overflows++;
+
+    #ifndef AS_AUTO_TRIGGER
+        if (as_period != 0)
+            TCNT3 += counts;
+    #endif
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function records the start of a timed scan and measures how far the time 
+ *  since the previous one is from the set period. It must be called with interrupts
+ *  disabled. 
+ *  @param time_now The time at which the scan started
+ */
+
+static inline void as_timed_start (uint32_t time_now)
+{
+    if (as_have_start)
+    {
+        int32_t error = (int32_t)(time_now - as_last_start) - (int32_t)as_period;
+        uint16_t size = (uint16_t)(error < 0 ? -error : error);
+        if (size > as_jitter)
+            as_jitter = size;
+    }
+    as_last_start = time_now;
+    as_have_start = true;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the integer square root of a number, rounded down. 
+ *  @param number The number whose square root is wanted
+ *  @return The square root
+ */
+
+static uint16_t as_sqrt (uint32_t number)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > number)
+        bit >>= 2;
+    while (bit != 0)
+    {
+        if (number >= root + bit)
+        {
+            number -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+            root >>= 1;
+        bit >>= 2;
+    }
+    return ((uint16_t)root);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor sets up the A/D converter for interrupt driven scans, with the 
+ *  AVCC pin as the reference. No scan is started until start() is called. 
+ */
+
+avr_adc_scan::avr_adc_scan (void)
+{
+    AS_MUX_DDR |= AS_MUX_BITS;              // Multiplexer address lines are outputs
+
+    ADMUX = (1 << REFS0);                   // Reference is AVCC, channel 0
+    ADCSRA = (1 << ADEN) | (1 << ADIE) | AS_PRESCALE;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the list of channels to be scanned, in the order in which they're
+ *  to be converted. It can't be changed while a scan is running. 
+ *  @param codes An array of channel codes made with the AS_CHANNEL() macro
+ *  @param count The number of channels in the array
+ *  @return True if the list was set, false if a scan is running or the list is too 
+ *      long or empty
+ */
+
+bool avr_adc_scan::set_channels (const uint8_t* codes, uint8_t count)
+{
+    if (as_running || as_period != 0 || count == 0 || count > AS_MAX_CHANNELS)
+        return (false);
+
+    for (uint8_t index = 0; index < count; index++)
+    {
+        as_codes[index] = codes[index];
+        as_shift[index] = 0;
+        as_quiet[index] = false;
+        as_divider[index] = 1;
+        as_countdown[index] = 0;
+        as_previous[index] = AS_NO_RESULT;
+        as_variance[0][index] = 0;
+        as_variance[1][index] = 0;
+    }
+    as_count = count;
+    as_fresh[0] = as_fresh[1] = 0;
+    as_have_frame = false;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets how many times a channel is converted for each result. The 
+ *  channel is converted 4^n times in a row and the sum shifted right by n bits, so
+ *  its results have 10 + n bits. It can't be changed while scans are running. 
+ *  @param index The channel's place in the scan list
+ *  @param n The oversampling exponent, from 0 (no oversampling) to AS_MAX_OVERSAMPLE
+ *  @return True if it was set, false if a scan is running or an argument is bad
+ */
+
+bool avr_adc_scan::set_oversample (uint8_t index, uint8_t n)
+{
+    if (as_running || as_period != 0 || index >= as_count || n > AS_MAX_OVERSAMPLE)
+        return (false);
+
+    as_shift[index] = n;
+    as_variance[0][index] = 0;
+    as_variance[1][index] = 0;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets how often a channel is converted, so that slow signals aren't
+ *  converted more often than they need to be. Channels with the same divider can be
+ *  given different phases so that they aren't all converted in the same scan, which
+ *  keeps the longest scan short. It can't be changed while scans are running. 
+ *  @param index The channel's place in the scan list
+ *  @param divider The channel is converted on one scan out of this many
+ *  @param phase Which scan of each cycle of the divider it's converted on, from 0
+ *  @return True if it was set, false if a scan is running or an argument is bad
+ */
+
+bool avr_adc_scan::set_divider (uint8_t index, uint8_t divider, uint8_t phase)
+{
+    if (as_running || as_period != 0 || index >= as_count || divider == 0)
+        return (false);
+
+    as_divider[index] = divider;
+    as_countdown[index] = phase % divider;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets whether a channel is converted with the processor asleep in ADC
+ *  noise reduction mode, which stops the processor, the timers and the serial ports
+ *  for the length of the conversion so that their switching doesn't get into the 
+ *  A/D converter. A quiet channel's conversions wait in each scan until the main 
+ *  loop calls run_quiet(). It can't be changed while scans are running. 
+ *  @param index The channel's place in the scan list
+ *  @param quiet True to convert the channel asleep, false to convert it awake
+ *  @return True if it was set, false if a scan is running or the index is bad
+ */
+
+bool avr_adc_scan::set_quiet (uint8_t index, bool quiet)
+{
+    if (as_running || as_period != 0 || index >= as_count)
+        return (false);
+
+    as_quiet[index] = quiet;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method turns on or off the noise comparison. While it's on, quiet channels
+ *  are converted awake in every other scan, so noise() measures them both ways under
+ *  the same conditions. It should be turned off again for flight. 
+ *  @param compare True to alternate sleeping and waking conversions
+ */
+
+void avr_adc_scan::compare_noise (bool compare)
+{
+    as_compare = compare;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method runs the conversions which quiet channels are waiting for, putting the
+ *  processor to sleep in ADC noise reduction mode for each one; the A/D complete 
+ *  interrupt wakes it. It's called from the main loop after the tasks have been 
+ *  scheduled. The processor is only put to sleep if no task will be due before the 
+ *  conversion is done, the timer won't trigger a scan during it, and nothing is going
+ *  in or out of the serial port, which stops during sleep; otherwise the conversion 
+ *  is made awake so the scan isn't held up. The timers are moved ahead afterwards by 
+ *  the time they were stopped, which is right to within an A/D clock or so. 
+ *  @param slack The time until the next task is due, in microseconds
+ *  @param io_idle True if the serial port has nothing to send and nothing will come
+ *      in, for example because the radio is asleep
+ *  @return True if the processor slept through at least one conversion
+ */
+
+bool avr_adc_scan::run_quiet (long slack, bool io_idle)
+{
+    const uint16_t lost = AS_CONVERT_TIME / USEC_PER_COUNT;
+    bool slept = false;
+
+    while (as_waiting)
+    {
+        cli ();
+        as_waiting = false;
+        if (!io_idle || slack < AS_CONVERT_TIME + AS_QUIET_MARGIN
+            || as_trigger_room () < lost + AS_QUIET_MARGIN / USEC_PER_COUNT
+            || (as_compare && (as_sequence & 1)))
+        {
+            ADCSRA |= (1 << ADSC);
+            sei ();
+            return (slept);
+        }
+
+        // Going to sleep starts the conversion. Any other interrupt which wakes the
+        // processor early just puts it back to sleep; the conversion keeps going
+        as_asleep = true;
+        set_sleep_mode (SLEEP_MODE_ADC);
+        sleep_enable ();
+        while (as_asleep)
+        {
+            sei ();                         // The instruction after sei() always runs
+            sleep_cpu ();                   // before an interrupt can, so the wake-up
+            cli ();                         // can't be missed
+        }
+        sleep_disable ();
+        as_catch_up (lost);
+        sei ();
+
+        slack -= AS_CONVERT_TIME;
+        slept = true;
+    }
+    return (slept);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of bits in a channel's results. 
+ *  @param index The channel's place in the scan list
+ *  @return The number of bits, 10 plus the oversampling exponent
+ */
+
+uint8_t avr_adc_scan::bits (uint8_t index)
+{
+    return (index < as_count ? 10 + as_shift[index] : 10);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the standard deviation of a channel's raw samples in 
+ *  hundredths of a 10-bit LSB. For an oversampled channel it's measured within the
+ *  oversampling groups, and the noise on a (10 + n)-bit result, in its own LSB's, is
+ *  the same number. For other channels it's found from the differences between 
+ *  successive results, which also counts any change in the signal from one scan to 
+ *  the next, so it's only a true noise floor for a steady signal. 
+ *  @param index The channel's place in the scan list
+ *  @param quiet True for the noise of conversions made asleep, false for awake ones
+ *  @return The noise in hundredths of an LSB, or 0 if none has been measured
+ */
+
+uint16_t avr_adc_scan::noise (uint8_t index, bool quiet)
+{
+    if (index >= as_count)
+        return (0);
+
+    uint8_t old_sreg = SREG;
+    cli ();
+    uint32_t variance = as_variance[quiet ? 1 : 0][index];
+    SREG = old_sreg;
+
+    // The variance is in LSB^2 times 16; times 625 makes it in hundredths of an LSB
+    // squared
+    if (variance > 0xFFFFFFFFUL / 625)
+        return (0xFFFF);
+    return (as_sqrt (variance * 625));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the time taken by the longest scan, including all the 
+ *  oversampled conversions. When channels have dividers, it's found by counting the
+ *  conversions in each of the next AS_CYCLE_SCANS scans. Timed scans must have a 
+ *  longer period than this. 
+ *  @return The time for the longest scan in microseconds
+ */
+
+long avr_adc_scan::scan_time_us (void)
+{
+    uint8_t countdown[AS_MAX_CHANNELS];     // Copy of the countdowns to be run ahead
+    uint16_t worst = 0;                     // Most conversions in any scan
+
+    for (uint8_t index = 0; index < as_count; index++)
+        countdown[index] = as_countdown[index];
+
+    for (uint16_t scan = 0; scan < AS_CYCLE_SCANS; scan++)
+    {
+        uint16_t conversions = 0;
+        for (uint8_t index = 0; index < as_count; index++)
+        {
+            if (countdown[index] == 0)
+            {
+                conversions += 1 << (2 * as_shift[index]);
+                countdown[index] = as_divider[index] - 1;
+            }
+            else
+                countdown[index]--;
+        }
+        if (conversions > worst)
+            worst = conversions;
+    }
+
+    return ((long)worst * AS_CONVERT_TIME);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts a scan of all the channels in the list. The rest of the scan is
+ *  run by the A/D complete interrupt. 
+ *  @return True if the scan was started, false if one is already running, there are
+ *      no channels to scan, or scans are being started by the timer
+ */
+
+bool avr_adc_scan::start (void)
+{
+    if (as_running || as_count == 0 || as_period != 0)
+        return (false);
+
+    uint8_t old_sreg = SREG;                // Don't let the timer overflow interrupt
+    cli ();                                 // run while the time is being read
+    as_find_due (0, 1, as_write_half);
+    as_scan_time[as_write_half] = as_time_now ();
+    as_running = true;
+    as_convert ();
+    SREG = old_sreg;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts scans at a fixed period, each one started by a hardware timer
+ *  rather than by a task, so that the time between samples doesn't depend on how 
+ *  busy the scheduler is. The period must be long enough for a whole scan to finish.
+ *  @param period The time between the starts of scans, in microseconds
+ *  @return True if timed scans were started, false if the period is too short or too
+ *      long for the timer, or there are no channels to scan
+ */
+
+bool avr_adc_scan::start_timed (long period)
+{
+    if (as_count == 0 || period > AS_MAX_PERIOD 
+        || period < scan_time_us () + AS_CONVERT_TIME)
+        return (false);
+
+    // Let a hand-started scan finish. Only run_quiet() starts the conversions quiet
+    // channels wait for, and it isn't called while this waits, so they're started 
+    // here, awake
+    stop_timed ();
+    while (as_running)
+    {
+        uint8_t sreg = SREG;
+        cli ();
+        if (as_waiting)
+        {
+            as_waiting = false;
+            ADCSRA |= (1 << ADSC);
+        }
+        SREG = sreg;
+    }
+
+    uint8_t old_sreg = SREG;
+    cli ();
+    as_period = (uint16_t)(period / USEC_PER_COUNT);
+    as_have_start = false;
+    as_find_due (0, 1, as_write_half);
+
+    #ifdef AS_AUTO_TRIGGER
+        // Timer 1 compare match B starts the first conversion of each scan
+        as_next_trigger = as_time_now () + as_period;
+        OCR1B = (uint16_t)as_next_trigger;
+        AS_TIMER_FLAGS = (1 << OCF1B);
+        ADCSRB = (1 << ADTS2) | (1 << ADTS0);
+        ADCSRA |= (1 << ADATE);
+    #else
+        // Timer 3 counts at the task timer's rate and clears at the period; its 
+        // compare match interrupt starts each scan
+        TCCR3A = 0x00;
+        TCCR3B = (1 << WGM32) | (1 << CS31);    // CTC mode, clock / 8
+        TCNT3 = 0;
+        OCR3A = as_period - 1;
+        ETIFR = (1 << OCF3A);
+        ETIMSK |= (1 << OCIE3A);
+    #endif
+    SREG = old_sreg;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method stops timed scans. A scan which is running is allowed to finish. 
+ */
+
+void avr_adc_scan::stop_timed (void)
+{
+    uint8_t old_sreg = SREG;
+    cli ();
+    #ifdef AS_AUTO_TRIGGER
+        ADCSRA &= ~(1 << ADATE);
+    #else
+        ETIMSK &= ~(1 << OCIE3A);
+        TCCR3B = 0x00;
+    #endif
+    as_period = 0;
+    SREG = old_sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the greatest difference, in microseconds, between the measured
+ *  time from one timed scan to the next and the period which was set. 
+ *  @return The worst sample period jitter since the measurements were cleared
+ */
+
+uint16_t avr_adc_scan::jitter_us (void)
+{
+    uint8_t old_sreg = SREG;
+    cli ();
+    uint16_t jitter = as_jitter;
+    SREG = old_sreg;
+
+    return (jitter * USEC_PER_COUNT);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the greatest delay, in microseconds, between a timer trigger 
+ *  and the start of the scan. On processors with A/D auto-triggering the hardware 
+ *  starts the scan, so this is always zero. 
+ *  @return The worst trigger latency since the measurements were cleared
+ */
+
+uint16_t avr_adc_scan::latency_us (void)
+{
+    uint8_t old_sreg = SREG;
+    cli ();
+    uint16_t latency = as_latency;
+    SREG = old_sreg;
+
+    return (latency * USEC_PER_COUNT);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of timed scans which were skipped because the 
+ *  previous scan hadn't finished. 
+ *  @return The number of skipped scans since the measurements were cleared
+ */
+
+uint16_t avr_adc_scan::overruns (void)
+{
+    uint8_t old_sreg = SREG;
+    cli ();
+    uint16_t count = as_overruns;
+    SREG = old_sreg;
+
+    return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method clears the timing measurements so that a new set can be taken. 
+ */
+
+void avr_adc_scan::clear_timing (void)
+{
+    uint8_t old_sreg = SREG;
+    cli ();
+    as_jitter = 0;
+    as_latency = 0;
+    as_overruns = 0;
+    as_have_start = false;
+    SREG = old_sreg;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether a scan is running. 
+ *  @return True if a scan has been started and hasn't finished yet
+ */
+
+bool avr_adc_scan::busy (void)
+{
+    return (as_running);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method copies the results of the most recent complete scan. If a scan finishes
+ *  while the copy is being made, the copy is made again from the newer scan, so all 
+ *  the results always come from the same scan. 
+ *  @param results An array with room for one result per channel in the list, in the 
+ *      same order as the list
+ *  @param seq A variable into which the scan's sequence number is put; it can be 
+ *      compared with the last one read to tell if the scan is a new one
+ *  @param time A variable into which the time the scan started is put
+ *  @param fresh A variable into which a bitmap of the channels converted in the scan
+ *      is put; bit 0 is the first channel in the list. The others hold old results
+ *  @param offsets An array into which the instant each fresh channel was sampled is
+ *      put, in timer counts after the scan started, in the same order as the list;
+ *      or NULL if the instants aren't wanted
+ *  @return True if a scan was copied, false if no scan has been completed yet
+ */
+
+bool avr_adc_scan::get_frame (uint16_t* results, uint8_t& seq, uint32_t& time,
+                              uint32_t& fresh, uint16_t* offsets)
+{
+    if (!as_have_frame)
+        return (false);
+
+    uint8_t before;
+    do
+    {
+        before = as_sequence;
+        uint8_t half = as_write_half ^ 1;
+        for (uint8_t index = 0; index < as_count; index++)
+            results[index] = as_results[half][index];
+        if (offsets != NULL)
+        {
+            for (uint8_t index = 0; index < as_count; index++)
+                offsets[index] = as_offsets[half][index];
+        }
+        time = as_scan_time[half];
+        fresh = as_fresh[half];
+    }
+    while (before != as_sequence);
+
+    seq = before;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the sequence number of the most recent complete scan. 
+ *  @return The number of scans completed, modulo 256
+ */
+
+uint8_t avr_adc_scan::sequence (void)
+{
+    return (as_sequence);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the number of channels in the scan list. 
+ *  @return The number of channels in each scan
+ */
+
+uint8_t avr_adc_scan::channels (void)
+{
+    return (as_count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This interrupt service routine runs when the A/D converter finishes a conversion. 
+ *  It saves the result and the instant it was sampled, then either starts the next 
+ *  channel in the list or, if that was the last one, publishes the scan by swapping 
+ *  the buffer halves. The sample was taken a conversion time, less the hold time, 
+ *  before now; if the processor slept through the conversion, the timers stopped as
+ *  it began, so the sample was taken a hold time after the time they show. 
+ */
+
+ISR (ADC_vect)
+{
+    uint8_t index = as_index;
+    uint8_t half = as_write_half;
+    uint16_t sample = ADCW;
+    uint8_t shift = as_shift[index];
+    bool quiet = as_asleep;                 // Whether this conversion was made asleep
+    int32_t variance;                       // Noise variance of this result
+
+    as_asleep = false;
+
+    #ifdef AS_AUTO_TRIGGER
+        // The timer started this scan by itself; its start time is the time of the 
+        // compare match. Set up the match for the next scan
+        if (!as_running && as_taken == 0 && as_period != 0)
+        {
+            as_running = true;
+            as_scan_time[half] = as_next_trigger;
+            as_timed_start (as_next_trigger);
+            as_next_trigger += as_period;
+            OCR1B = (uint16_t)as_next_trigger;
+            AS_TIMER_FLAGS = (1 << OCF1B);
+        }
+    #endif
+
+    // The scan's start time may be read just after its first conversion started
+    const uint16_t before = (AS_CONVERT_TIME - AS_HOLD_TIME) / USEC_PER_COUNT;
+    uint16_t instant = TCNT1 - (uint16_t)as_scan_time[half];
+    if (quiet)
+        instant += AS_HOLD_TIME / USEC_PER_COUNT;
+    else
+        instant = (instant > before) ? instant - before : 0;
+
+    if (shift == 0)
+    {
+        // Without a group, the noise comes from the change since the last result; 
+        // half the mean square difference is the variance of each result
+        as_results[half][index] = sample;
+        as_offsets[half][index] = instant;
+        int16_t diff = (int16_t)(sample - as_previous[index]);
+        variance = (as_previous[index] == AS_NO_RESULT)
+                   ? -1L : ((int32_t)diff * diff) << 3;
+        as_previous[index] = sample;
+    }
+    else
+    {
+        // Add up the group of samples, keeping the squared differences from the first
+        // sample so the noise can be found without big numbers
+        uint8_t taken = as_taken;
+        if (taken == 0)
+        {
+            as_first = sample;
+            as_sum = 0;
+            as_sum_sq = 0;
+            as_group_quiet = true;
+            as_group_start = instant;
+        }
+        as_group_quiet = as_group_quiet && quiet;
+        int16_t diff = (int16_t)(sample - as_first);
+        as_sum += sample;
+        as_sum_sq += (uint32_t)((int32_t)diff * diff);
+
+        // Until the group is complete, convert the same channel again
+        if (++taken < (uint8_t)(1 << (2 * shift)))
+        {
+            as_taken = taken;
+            as_convert ();
+            return;
+        }
+        as_taken = 0;
+        as_results[half][index] = as_sum >> shift;
+        as_offsets[half][index] = as_group_start
+                                  + (uint16_t)(instant - as_group_start) / 2;
+
+        // The variance is the mean squared difference less the squared mean 
+        // difference; keep a running average of it in 1/16 LSB^2 units
+        int32_t sum_diff = (int32_t)as_sum - ((int32_t)as_first << (2 * shift));
+        uint32_t size = (uint32_t)(sum_diff < 0 ? -sum_diff : sum_diff);
+        uint32_t spread = as_sum_sq - ((size * size) >> (2 * shift));
+        variance = (int32_t)((spread << 4) >> (2 * shift));
+        quiet = as_group_quiet;
+    }
+
+    as_fresh[half] |= as_bit;
+
+    // A channel's first difference is from nothing, so it isn't counted
+    if (variance >= 0)
+    {
+        volatile uint32_t* p_average = &as_variance[quiet ? 1 : 0][index];
+        *p_average += (variance - (int32_t)*p_average) / 8;
+    }
+
+    if (as_find_due (index + 1, as_bit << 1, half))
+    {
+        as_convert ();
+        return;
+    }
+
+    // The scan is complete. Swap halves, then count it so readers see the swap
+    as_write_half = half ^ 1;
+    as_sequence++;
+    as_have_frame = true;
+    as_running = false;
+
+    // Count down to each channel's next conversion. The first channel due in the 
+    // next scan is selected now so the multiplexers settle before it starts; if no
+    // channel is due, the first one is read anyway
+    for (index = 0; index < as_count; index++)
+    {
+        if (as_countdown[index] == 0)
+            as_countdown[index] = as_divider[index] - 1;
+        else
+            as_countdown[index]--;
+    }
+    half ^= 1;
+    as_fresh[half] = 0;
+    if (!as_find_due (0, 1, half))
+    {
+        as_countdown[0] = 0;
+        as_find_due (0, 1, half);
+    }
+}
+
+
+#ifndef AS_AUTO_TRIGGER
+//-------------------------------------------------------------------------------------
+/** This interrupt service routine runs when Timer 3 reaches the scan period. It only 
+ *  starts a scan; the first channel has already been selected. Timer 3 restarted at
+ *  zero on the compare match, so its count tells how late this routine is running. 
+ */
+
+ISR (TIMER3_COMPA_vect)
+{
+    uint16_t late = TCNT3;
+
+    if (as_running)
+    {
+        as_overruns++;
+        return;
+    }
+
+    as_convert ();
+    as_running = true;
+
+    uint32_t time_now = as_time_now ();
+    as_scan_time[as_write_half] = time_now;
+    as_timed_start (time_now);
+    if (late > as_latency)
+        as_latency = late;
+}
+#endif // AS_AUTO_TRIGGER
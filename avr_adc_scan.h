@@ -0,0 +1,191 @@
+//======================================================================================
+/** \file  avr_adc_scan.h
+ *  This file contains an interrupt driven A/D converter scan sequencer. The sequencer
+ *  is given a list of channels; when a scan is started, the A/D complete interrupt 
+ *  reads each result, switches to the next channel in the list and starts the next 
+ *  conversion, so a whole scan runs back to back and costs the processor one short
+ *  interrupt per channel rather than a task polling each conversion. 
+ *
+ *  Results go into one half of a double buffer while the other half holds the last
+ *  complete scan. When a scan finishes, the halves are swapped and a sequence number
+ *  is counted up. A reader copies the complete half and then checks that the 
+ *  sequence number hasn't changed; if it has, another scan finished while the copy 
+ *  was being made, and the copy is made again. Readers therefore always get all the
+ *  channels from one scan, and interrupts are never turned off for the copy. 
+ *
+ *  The ATmega128 has only eight single-ended A/D inputs, while the Para-Ceres has 18 
+ *  analog channels, so some channels come through external analog multiplexers. A
+ *  channel code holds the A/D input in its low three bits and the external mux 
+ *  address, which is put out on the low bits of AS_MUX_PORT, in the bits above. 
+ *
+ *  Scans can be started by hand with start(), but for evenly spaced samples they 
+ *  should be started by a hardware timer with start_timed(). On processors whose A/D
+ *  converter has an auto-trigger input (ATmega644, ATmega324P), a Timer 1 compare 
+ *  match starts the first conversion of each scan directly, so the sample instant is
+ *  set by the hardware alone. The ATmega128's A/D can't be triggered by a timer, so
+ *  Timer 3 runs in CTC mode at the scan period and its compare interrupt, which does 
+ *  nothing but start the scan, is the trigger; the sample instant then moves only by 
+ *  the interrupt latency. The spread in the times between scan starts is measured so
+ *  it can be checked. 
+ *
+ *  Each channel can be oversampled to get more resolution than the A/D converter's 
+ *  10 bits: the interrupt converts the channel 4^n times in a row, adds up the 
+ *  results and shifts the sum right by n bits, giving a (10 + n)-bit result. This 
+ *  only works if there's at least about half an LSB of noise on the signal to dither
+ *  it, so the interrupt also measures the spread of the samples in each group; 
+ *  bits() and noise() give each channel's resolution and noise, which the ground can
+ *  ask for (see task_uplink.h), so that bandwidth can be traded for resolution. 
+ *  Noise below about 0.5 LSB is too little to dither the extra bits. The extra 
+ *  conversions make the scan longer. 
+ *
+ *  Channels which need the lowest noise, such as the load cells and pressures, can be
+ *  marked quiet. The scan then stops at each of their conversions until the main loop
+ *  calls run_quiet(), which puts the processor into ADC noise reduction sleep; the 
+ *  conversion starts as it goes to sleep, and the A/D interrupt wakes it. The I/O 
+ *  clock is stopped meanwhile, so the timers and serial port stop too: run_quiet() 
+ *  only sleeps if no task is due and the serial port is idle, and it moves the timers
+ *  ahead afterwards. The noise of quiet channels is measured separately for sleeping 
+ *  and waking conversions, and compare_noise() alternates the two so they can be 
+ *  compared; the ground turns the comparison on and off by command. 
+ *
+ *  Channels whose signals change slowly can be given a divider so that they're only
+ *  converted on one scan out of every few, and the scan skips them the rest of the
+ *  time rather than wasting conversions on them; their last results are kept in the
+ *  buffer. get_frame() returns a bitmap of the channels which were converted in the
+ *  scan, so the reader can tell new results from old ones. 
+ *
+ *  The channels of a scan are converted one after another, so each is sampled at a
+ *  different instant; the six axes of a 6 DOF unit are more than half a millisecond 
+ *  apart. The interrupt notes the instant at which each channel's sample and hold 
+ *  closed, as a time after the start of the scan, and get_frame() can return these
+ *  so the reader can line the channels up. An oversampled result's instant is the 
+ *  middle of its group. Conversions made asleep are timed from when the processor 
+ *  went to sleep, as the timers are stopped until it wakes. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Scans started by a hardware timer at an exact rate
+ *    \li  10-18-26 DSC Per-channel oversampling and decimation
+ *    \li  10-18-26 DSC Quiet conversions in ADC noise reduction sleep
+ *    \li  10-18-26 DSC Channels can be converted on only some of the scans
+ *    \li  10-18-26 DSC The instant of each channel's conversion is recorded
+ *    \li  10-18-26 DSC Channel tables sized for the Para-Ceres, to save RAM
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _AVR_ADC_SCAN_H_                    // To prevent *.h file from being included
+#define _AVR_ADC_SCAN_H_                    // in a source file more than once
+
+#include <stdint.h>
+
+/** The greatest number of channels in a scan; the Para-Ceres has 18. Each one takes
+ *  23 bytes of RAM, so this shouldn't be made much bigger than it has to be */
+#define AS_MAX_CHANNELS     18
+
+/** The A/D clock prescaler setting. 0x06 divides by 64, giving a 125 kHz A/D clock at
+ *  8 MHz, within the 50 - 200 kHz range needed for full 10-bit accuracy. Each 
+ *  conversion then takes 13 A/D clocks, or 104 us */
+#define AS_PRESCALE         0x06
+
+/** The time taken by one conversion in microseconds, at 13 A/D clocks each */
+#define AS_CONVERT_TIME     ((long)(13L * (1L << AS_PRESCALE) * 1000000L / F_CPU))
+
+/** The time from the start of a conversion to the sample and hold, at 1.5 A/D clocks,
+ *  in microseconds; the sample is taken at this instant */
+#define AS_HOLD_TIME        ((long)(3L * (1L << AS_PRESCALE) * 1000000L / (2L * F_CPU)))
+
+/** The largest oversampling exponent; 4^3 = 64 samples of 1023 still fit in 16 bits
+ *  when added up, and give a 13-bit result */
+#define AS_MAX_OVERSAMPLE   3
+
+/** The time in microseconds beyond a conversion which must be free before the 
+ *  processor sleeps through it, to cover going to sleep and waking up */
+#define AS_QUIET_MARGIN     50L
+
+/** The number of scans scan_time_us() looks ahead to find the longest scan; it should 
+ *  be a multiple of every divider in use */
+#define AS_CYCLE_SCANS      240
+
+/** The longest period between timed scans, in microseconds, which the 16-bit trigger
+ *  timer can count */
+#define AS_MAX_PERIOD       65000L
+
+/** The output port whose low bits select the external analog multiplexer inputs */
+#define AS_MUX_PORT         PORTC
+
+/** The data direction register for the multiplexer address lines */
+#define AS_MUX_DDR          DDRC
+
+/** The bits of AS_MUX_PORT which are wired to the multiplexer address lines */
+#define AS_MUX_BITS         0x07
+
+/** This macro makes a channel code from an external mux address and an A/D input */
+#define AS_CHANNEL(mux, input)  ((uint8_t)(((mux) << 3) | ((input) & 0x07)))
+
+
+//-------------------------------------------------------------------------------------
+/** This class runs the A/D converter as an interrupt driven scan sequencer. Only one
+ *  object of this class should be created, as there's only one A/D converter. The 
+ *  data used by the interrupt service routine is kept in the *.cc file. 
+ */
+
+class avr_adc_scan
+{
+    public:
+        // The constructor sets up the A/D converter and its interrupt
+        avr_adc_scan (void);
+
+        // This method sets the list of channels to be scanned
+        bool set_channels (const uint8_t*, uint8_t);
+
+        // This method sets how many times a channel is oversampled
+        bool set_oversample (uint8_t, uint8_t);
+
+        // This method returns the number of bits in a channel's results
+        uint8_t bits (uint8_t);
+
+        // This method sets how often a channel is converted
+        bool set_divider (uint8_t, uint8_t, uint8_t = 0);
+
+        // These methods choose which channels are converted asleep and run them
+        bool set_quiet (uint8_t, bool);
+        bool run_quiet (long, bool);
+        void compare_noise (bool);
+
+        // This method returns the noise measured on a channel, in hundredths of an LSB
+        uint16_t noise (uint8_t, bool = false);
+
+        // This method returns the time taken by the longest scan, in microseconds
+        long scan_time_us (void);
+
+        // This method starts a scan unless one is already running
+        bool start (void);
+
+        // These methods start and stop scans triggered by a timer at a fixed period
+        bool start_timed (long);
+        void stop_timed (void);
+
+        // These methods return measurements of how evenly scans are started
+        uint16_t jitter_us (void);
+        uint16_t latency_us (void);
+        uint16_t overruns (void);
+        void clear_timing (void);
+
+        // This method checks if a scan is running
+        bool busy (void);
+
+        // This method copies the most recent complete scan
+        bool get_frame (uint16_t*, uint8_t&, uint32_t&, uint32_t&, uint16_t* = 0);
+
+        // This method returns the sequence number of the most recent complete scan
+        uint8_t sequence (void);
+
+        // This method returns the number of channels in the scan list
+        uint8_t channels (void);
+};
+
+#endif // _AVR_ADC_SCAN_H_
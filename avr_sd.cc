@@ -0,0 +1,424 @@
+//======================================================================================
+/** \file  avr_sd.cc
+ *  This file contains a driver for an SD card on the AVR's SPI port. See avr_sd.h for
+ *  details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "log_device.h"
+#include "avr_sd.h"
+
+// These are the card's commands and the tokens which go with blocks of data
+#define SD_GO_IDLE          0               // Reset, and go to SPI mode if selected
+#define SD_SEND_IF_COND     8               // Check the supply voltage, version 2 only
+#define SD_SEND_CSD         9               // Read the card specific data register
+#define SD_SET_BLOCKLEN     16              // Set the block size of a standard card
+#define SD_READ_SINGLE      17              // Read one block
+#define SD_WRITE_MULTIPLE   25              // Write blocks until the stop token
+#define SD_SEND_OP_COND     41              // Start up; must follow SD_APP_CMD
+#define SD_APP_CMD          55              // The next command is an application one
+#define SD_READ_OCR         58              // Read the operating conditions register
+
+#define SD_START_TOKEN      0xFE            // Begins a block read or a single write
+#define SD_WRITE_TOKEN      0xFC            // Begins each block of a multiple write
+#define SD_STOP_TOKEN       0xFD            // Ends a multiple block write
+#define SD_IDLE             0x01            // First answer byte while starting up
+#define SD_ILLEGAL          0x04            // Answer bit for an unknown command
+#define SD_ACCEPTED         0x05            // Data answer for a block which was taken
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor sets up the SPI port pins and leaves the card unselected. The
+ *  card isn't touched until begin() is called.
+ */
+
+avr_sd::avr_sd (void)
+{
+    SD_SPI_PORT |= SD_CS_PIN | SD_MISO_PIN;
+    SD_SPI_DDR |= SD_CS_PIN | SD_SCK_PIN | SD_MOSI_PIN;
+    SD_SPI_DDR &= ~SD_MISO_PIN;
+
+    version_2 = false;
+    high_capacity = false;
+    ready = false;
+    running = false;
+    fill = 0;
+    num_blocks = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends one byte through the SPI port and returns the byte which came
+ *  back at the same time.
+ *  @param data The byte to send; 0xFF when only reading
+ *  @return The byte which was received
+ */
+
+uint8_t avr_sd::spi (uint8_t data)
+{
+    SPDR = data;
+    while (!(SPSR & (1 << SPIF)));
+    return (SPDR);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method selects the card by pulling its chip select low.
+ */
+
+void avr_sd::select (void)
+{
+    SD_SPI_PORT &= ~SD_CS_PIN;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method lets go of the card. One more byte is clocked through so that the card
+ *  lets go of its data line.
+ */
+
+void avr_sd::deselect (void)
+{
+    SD_SPI_PORT |= SD_CS_PIN;
+    spi (0xFF);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends a command to the card, which must be selected, and waits for the
+ *  first byte of the answer. Any more bytes of the answer are read by the caller.
+ *  @param code The command number
+ *  @param argument The 32-bit argument of the command
+ *  @param crc The CRC byte; only the first two commands need a real one
+ *  @return The first answer byte, which is 0 if all is well, or 0xFF if the card
+ *      didn't answer
+ */
+
+uint8_t avr_sd::command (uint8_t code, uint32_t argument, uint8_t crc)
+{
+    spi (0xFF);
+    spi (0x40 | code);
+    spi ((uint8_t)(argument >> 24));
+    spi ((uint8_t)(argument >> 16));
+    spi ((uint8_t)(argument >> 8));
+    spi ((uint8_t)argument);
+    spi (crc);
+
+    for (uint8_t count = 0; count < SD_ANSWER_BYTES; count++)
+    {
+        uint8_t answer = spi (0xFF);
+        if (!(answer & 0x80))
+            return (answer);
+    }
+    return (0xFF);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads a block of data which the card sends after a read command. The
+ *  card sends 0xFF until the data is ready, then a start token, the data and a CRC,
+ *  which isn't checked.
+ *  @param data A buffer for the data
+ *  @param length The number of bytes to read
+ *  @return True if the data was read, false if the card never sent it
+ */
+
+bool avr_sd::read_data (uint8_t* data, uint16_t length)
+{
+    uint8_t token = 0xFF;
+
+    for (uint16_t count = 0; count < SD_READ_BYTES && token == 0xFF; count++)
+        token = spi (0xFF);
+    if (token != SD_START_TOKEN)
+        return (false);
+
+    while (length-- > 0)
+        *data++ = spi (0xFF);
+    spi (0xFF);
+    spi (0xFF);
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads the card's CSD register and works out the number of blocks on
+ *  the card. The register is laid out one way for standard cards and another for
+ *  high capacity ones.
+ *  @return True if the size was found
+ */
+
+bool avr_sd::read_size (void)
+{
+    uint8_t csd[16];
+
+    if (command (SD_SEND_CSD, 0) != 0 || !read_data (csd, sizeof (csd)))
+        return (false);
+
+    if ((csd[0] >> 6) == 1)
+    {
+        uint32_t c_size = ((uint32_t)(csd[7] & 0x3F) << 16) | ((uint16_t)csd[8] << 8)
+                        | csd[9];
+        num_blocks = (c_size + 1) << 10;
+    }
+    else
+    {
+        uint8_t read_bl_len = csd[5] & 0x0F;
+        uint16_t c_size = ((uint16_t)(csd[6] & 0x03) << 10) | ((uint16_t)csd[7] << 2)
+                        | (csd[8] >> 6);
+        uint8_t c_size_mult = ((csd[9] & 0x03) << 1) | (csd[10] >> 7);
+        num_blocks = (uint32_t)(c_size + 1) << (c_size_mult + 2 + read_bl_len - 9);
+    }
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gets the card's attention: it sends the clocks a card needs after
+ *  power-up, resets the card into SPI mode and finds out which version of the
+ *  standard it follows. The SPI port runs slowly until wake() finds the card ready.
+ *  @return SD_WAITING if the card answered, or SD_ERROR if it didn't
+ */
+
+uint8_t avr_sd::begin (void)
+{
+    ready = false;
+    running = false;
+    num_blocks = 0;
+
+    // The card must be clocked at 400 kHz or less until it's ready; CPU clock / 128
+    SPCR = (1 << SPE) | (1 << MSTR) | (1 << SPR1) | (1 << SPR0);
+    SPSR &= ~(1 << SPI2X);
+
+    SD_SPI_PORT |= SD_CS_PIN;
+    for (uint8_t count = 0; count < 10; count++)
+        spi (0xFF);
+
+    select ();
+    if (command (SD_GO_IDLE, 0, 0x95) != SD_IDLE)
+    {
+        deselect ();
+        return (SD_ERROR);
+    }
+
+    // Older cards don't know the voltage check; newer ones echo the check pattern
+    uint8_t answer = command (SD_SEND_IF_COND, 0x1AA, 0x87);
+    version_2 = !(answer & SD_ILLEGAL);
+    if (version_2)
+    {
+        uint8_t echo[4];
+        for (uint8_t index = 0; index < 4; index++)
+            echo[index] = spi (0xFF);
+        if ((echo[2] & 0x0F) != 0x01 || echo[3] != 0xAA)
+        {
+            deselect ();
+            return (SD_ERROR);
+        }
+    }
+    deselect ();
+    return (SD_WAITING);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method asks the card once to finish starting up. When the card says it has,
+ *  the method finds out how it's addressed and how big it is, sets the block size
+ *  if need be, and speeds the SPI port up to half the CPU clock.
+ *  @return SD_READY if the card is ready, SD_WAITING if it's still starting up, or
+ *      SD_ERROR if something went wrong
+ */
+
+uint8_t avr_sd::wake (void)
+{
+    if (ready)
+        return (SD_READY);
+
+    select ();
+    uint8_t answer = command (SD_APP_CMD, 0);
+    if (answer <= SD_IDLE)
+        answer = command (SD_SEND_OP_COND, version_2 ? 0x40000000UL : 0);
+    if (answer == SD_IDLE)
+    {
+        deselect ();
+        return (SD_WAITING);
+    }
+
+    bool good = (answer == 0);
+    high_capacity = false;
+    if (good && version_2)
+    {
+        good = (command (SD_READ_OCR, 0) == 0);
+        high_capacity = (spi (0xFF) & 0x40) != 0;
+        for (uint8_t count = 0; count < 3; count++)
+            spi (0xFF);
+    }
+    if (good && !high_capacity)
+        good = (command (SD_SET_BLOCKLEN, LOG_BLOCK_SIZE) == 0);
+    good = good && read_size ();
+    deselect ();
+    if (!good)
+        return (SD_ERROR);
+
+    SPCR = (1 << SPE) | (1 << MSTR);
+    SPSR |= (1 << SPI2X);
+    ready = true;
+    return (SD_READY);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether the card is busy saving a block, without waiting. The
+ *  card holds its data line low while it's busy; it's let go of once it's done unless
+ *  a multiple block write is open.
+ *  @return True if the card is busy
+ */
+
+bool avr_sd::busy (void)
+{
+    if (!ready)
+        return (false);
+
+    select ();
+    bool is_busy = (spi (0xFF) != 0xFF);
+    if (!is_busy && !running)
+        deselect ();
+    return (is_busy);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts a multiple block write.
+ *  @param block The number of the first block to be written
+ *  @return True if the card took the command
+ */
+
+bool avr_sd::write_start (uint32_t block)
+{
+    if (!ready || running)
+        return (false);
+
+    select ();
+    if (command (SD_WRITE_MULTIPLE, address (block)) != 0)
+    {
+        deselect ();
+        return (false);
+    }
+    running = true;
+    fill = 0;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends some bytes of the block being written, starting the block with
+ *  its token if they're the first. Bytes past the end of the block are ignored.
+ *  @param data A pointer to the bytes
+ *  @param length The number of bytes
+ */
+
+void avr_sd::write_data (const uint8_t* data, uint16_t length)
+{
+    if (!running)
+        return;
+    if (fill == 0)
+        spi (SD_WRITE_TOKEN);
+    for ( ; length > 0 && fill < LOG_BLOCK_SIZE; length--, fill++)
+        spi (*data++);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends a number of copies of one byte in the block being written.
+ *  @param value The byte
+ *  @param count The number of copies
+ */
+
+void avr_sd::write_fill (uint8_t value, uint16_t count)
+{
+    if (!running)
+        return;
+    if (fill == 0)
+        spi (SD_WRITE_TOKEN);
+    for ( ; count > 0 && fill < LOG_BLOCK_SIZE; count--, fill++)
+        spi (value);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finishes the block being written: it sends the CRC, which the card
+ *  doesn't check in SPI mode, and reads the card's answer. A block which is short is
+ *  filled out with zeros so the card stays in step, but it counts as turned down. The
+ *  card is busy afterwards until it has saved the block.
+ *  @return True if the card took the block
+ */
+
+bool avr_sd::write_end (void)
+{
+    if (!running)
+        return (false);
+
+    bool whole = (fill == LOG_BLOCK_SIZE);
+    write_fill (0, LOG_BLOCK_SIZE - fill);
+    spi (0xFF);
+    spi (0xFF);
+    uint8_t answer = spi (0xFF);
+    fill = 0;
+
+    return (whole && (answer & 0x1F) == SD_ACCEPTED);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method ends a multiple block write. The card must not be busy when it's
+ *  called, and is busy for a while after.
+ */
+
+void avr_sd::write_stop (void)
+{
+    if (!running)
+        return;
+
+    spi (SD_STOP_TOKEN);
+    spi (0xFF);
+    running = false;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads one block from the card, waiting until it has been read. It
+ *  first waits for the card to finish saving anything it was sent.
+ *  @param block The number of the block
+ *  @param data A buffer of LOG_BLOCK_SIZE bytes for the block
+ *  @return True if the block was read
+ */
+
+bool avr_sd::read_block (uint32_t block, uint8_t* data)
+{
+    if (!ready || running || block >= num_blocks)
+        return (false);
+
+    select ();
+    for (uint16_t count = 0; spi (0xFF) != 0xFF; count++)
+    {
+        if (count >= SD_BUSY_BYTES)
+        {
+            deselect ();
+            return (false);
+        }
+    }
+
+    bool good = (command (SD_READ_SINGLE, address (block)) == 0)
+                && read_data (data, LOG_BLOCK_SIZE);
+    deselect ();
+    return (good);
+}
@@ -0,0 +1,121 @@
+//======================================================================================
+/** \file  avr_sd.h
+ *  This file contains a driver for an SD card on the AVR's SPI port, which holds the
+ *  flight log (see log_writer.h). The card is run in SPI mode and used as a plain row
+ *  of 512-byte blocks, without a file system. Standard and high capacity cards both
+ *  work; standard ones are addressed in bytes and high capacity ones in blocks, which
+ *  the driver hides.
+ *
+ *  Getting a card ready takes up to a second, most of it spent asking the card over
+ *  and over whether it has finished starting up, so begin() just gets the card's
+ *  attention and wake() asks once each time it's called; a task calls wake() until
+ *  the card is ready. The SPI clock is slow until then, as cards require, and then
+ *  as fast as the AVR can go, half the CPU clock.
+ *
+ *  Blocks are written with multiple block writes: each block goes out as a start
+ *  token, 512 bytes and a CRC, which isn't checked in SPI mode, and the card answers
+ *  whether it took the block. The card holds its data line low while it's busy saving
+ *  a block, which busy() looks at without waiting.
+ *
+ *  The card's chip select is SS, PB0, so the SPI port stays a master. SCK, MOSI and
+ *  MISO are PB1, PB2 and PB3 on the ATmega128.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _AVR_SD_H_                          // To prevent *.h file from being included
+#define _AVR_SD_H_                          // in a source file more than once
+
+#include "log_device.h"
+
+/** The port, data direction register and pins used for the SPI port */
+#define SD_SPI_PORT         PORTB
+#define SD_SPI_DDR          DDRB
+#define SD_CS_PIN           (1 << PB0)
+#define SD_SCK_PIN          (1 << PB1)
+#define SD_MOSI_PIN         (1 << PB2)
+#define SD_MISO_PIN         (1 << PB3)
+
+/** The most bytes to wait for an answer to a command */
+#define SD_ANSWER_BYTES     10
+
+/** The most bytes to wait for a block of data being read to start */
+#define SD_READ_BYTES       20000U
+
+/** The most bytes to wait for the card to finish saving a block before a read */
+#define SD_BUSY_BYTES       60000U
+
+// These are the answers which begin() and wake() give
+#define SD_ERROR            0               // The card isn't there or didn't answer
+#define SD_WAITING          1               // The card is still starting up
+#define SD_READY            2               // The card is ready to use
+
+
+//-------------------------------------------------------------------------------------
+/** This class drives an SD card through the SPI port. Only one object of this class
+ *  should be created, as there's only one SPI port.
+ */
+
+class avr_sd : public log_device
+{
+    protected:
+        bool version_2;                     // The card knows the version 2 commands
+        bool high_capacity;                 // The card is addressed in blocks
+        bool ready;                         // The card has been made ready to use
+        bool running;                       // A multiple block write is open
+        uint16_t fill;                      // Bytes sent of the block being written
+        uint32_t num_blocks;                // Size of the card in blocks
+
+        // This method sends a byte and returns the one which came back
+        uint8_t spi (uint8_t);
+
+        // These methods select the card and let it go
+        void select (void);
+        void deselect (void);
+
+        // This method sends a command and returns the card's first answer byte
+        uint8_t command (uint8_t, uint32_t, uint8_t = 0xFF);
+
+        // This method reads a block of data which the card sends after a command
+        bool read_data (uint8_t*, uint16_t);
+
+        // This method finds the size of the card from its CSD register
+        bool read_size (void);
+
+        /** This method returns the address of a block as the card wants it, which is
+         *  a byte address for standard cards and the block number for high capacity
+         *  ones. */
+        uint32_t address (uint32_t block)
+            { return (high_capacity ? block : block * LOG_BLOCK_SIZE); }
+
+    public:
+        // The constructor sets up the SPI port
+        avr_sd (void);
+
+        // This method gets the card's attention and tells it to use SPI mode
+        uint8_t begin (void);
+
+        // This method asks the card once whether it's ready, finishing setup if it is
+        uint8_t wake (void);
+
+        /** This method returns true once the card is ready to use. */
+        bool is_ready (void) { return (ready); }
+
+        // These methods are those of every block device; see log_device.h
+        bool busy (void);
+        bool write_start (uint32_t);
+        void write_data (const uint8_t*, uint16_t);
+        void write_fill (uint8_t, uint16_t);
+        bool write_end (void);
+        void write_stop (void);
+        bool read_block (uint32_t, uint8_t*);
+        uint32_t size (void) { return (num_blocks); }
+};
+
+#endif // _AVR_SD_H_
@@ -18,26 +18,50 @@
  *      \li 04-16-07  JO   Added write (unsigned long)
  *      \li 07-19-07  JRR  Changed some character return values to bool, added m324p
  *      \li 12-18-07  JRR  Added write (unsigned long long) and CTS flow control
+ *      \li 10-18-26  DSC  Added binary write() and gathered transmission methods
+ *      \li 10-18-26  DSC  Double-speed mode chosen by the baud rate setting
+ *      \li 10-18-26  DSC  Fixed the transmitter test in ready_to_send()
+ *      \li 10-18-26  DSC  Added puts_P() for strings kept in program memory
  */
 //*************************************************************************************
 
 #include <stdint.h>
 #include <stdlib.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>                  // The gathered sender uses an interrupt
+#include <avr/pgmspace.h>                   // For strings kept in program memory
 #include "avr_serial.h"
 
 
+//-------------------------------------------------------------------------------------
+// These variables hold the progress of an interrupt driven gathered transmission. They
+// are shared between send_gather() and the data register empty interrupt service 
+// routine; since there's only one UART in use, they don't need to belong to an object
+
+/** Pointer to the segment which is currently being sent */
+static const uart_segment* volatile tx_segment;
+
+/** Pointer to the next byte to be put into the UART data register */
+static const unsigned char* volatile tx_pointer;
+
+/** Number of bytes left to send in the current segment */
+static volatile size_t tx_bytes_left;
+
+/** Number of segments left to send, including the current one */
+static volatile unsigned char tx_segments_left;
+
+
 //-------------------------------------------------------------------------------------
 /** This method sets up the AVR UART for communications.  It enables the appropriate 
- *  inputs and outputs and sets the baud rate divisor.
- *  @param divisor The baud rate divisor to be used for controlling the rate of
- *      communication.  See the *.h file in which various values of the divisor are 
- *      defined as macros. 
+ *  inputs and outputs and sets the baud rate divisor and speed mode.
+ *  @param setting The baud rate setting, which holds the divisor and a flag which 
+ *      turns on double-speed mode. It should be computed at compile time with the
+ *      uart_baud template in the *.h file, as in uart_baud<9600>::setting. 
  *  @param a_CTS_mask This is a bitmask for the Clear To Send flow control bit.  If
  *      this bitmask is 0 or left off, CTS flow control will not be used.
  */
 
-avr_uart::avr_uart (unsigned char divisor, unsigned char a_CTS_mask = 0)
+avr_uart::avr_uart (unsigned int setting, unsigned char a_CTS_mask = 0)
     {
     CTS_mask = a_CTS_mask;                  // Save the Clear To Send bitmask
 
@@ -48,10 +72,13 @@ avr_uart::avr_uart (unsigned char divisor, unsigned char a_CTS_mask = 0)
         }
 
     UART_modeN81 ();                        // Set No parity, 8 data bits, 1 stop bit
-    #ifdef UART_DOUBLE_SPEED                // If double-speed macro has been defined,
-        UART_STATUS |= 0x02;                // Turn on double-speed operation
+    #ifdef UART_2_SPEED                     // If the setting calls for double-speed
+        if (setting & UART_SETTING_2X)      // mode, turn it on; otherwise make sure
+            UART_STATUS |= UART_2_SPEED;    // it's off
+        else
+            UART_STATUS &= ~UART_2_SPEED;
     #endif
-    UART_set_baud_div (divisor);            // Set the baud rate divisor
+    UART_set_baud_div (setting & 0x0FFF);   // Set the baud rate divisor
 
     UART_tx_rx_on ();                       // Enable transmitter and receiver of UART
 
@@ -72,11 +99,11 @@ avr_uart::avr_uart (unsigned char divisor, unsigned char a_CTS_mask = 0)
 bool avr_uart::ready_to_send (void)
     {
     // If CTS is being used and it's high, we're not ready to send
-    if (CTS_mask && (UART_CTS_PORT & CTS_mask))
+    if (!clear_to_send ())
         return (false);
 
     // If transmitter buffer is full, we're not ready either
-    if (UART_STATUS & UART_DREG_MT)
+    if ((UART_STATUS & UART_DREG_MT) == 0)
         return (false);
 
     return (true);
@@ -135,6 +162,20 @@ void avr_uart::puts (char const* str)
     }
 
 
+//-------------------------------------------------------------------------------------
+/** This method writes a string which is kept in program memory, such as one made with
+ *  PSTR(), so that it doesn't take up RAM. Warning: This function blocks until it's
+ *  finished.
+ *  @param str The address of the string in program memory
+ */
+
+void avr_uart::puts_P (char const* str)
+    {
+    char ch;
+    while ((ch = pgm_read_byte (str++)) != '\0') putchar (ch);
+    }
+
+
 //-------------------------------------------------------------------------------------
 /** This method gets one character from the serial port, if one is there.  If not, it
  *  waits until there is a character available.  This can sometimes take a long time
@@ -189,6 +230,104 @@ bool avr_uart::check_for_char (void)
     }
 
 
+//-------------------------------------------------------------------------------------
+/** This method writes a block of binary data to the serial port. Unlike puts(), it 
+ *  doesn't stop at a '\\0' byte, so it can be used to send binary frames. Warning: 
+ *  This function blocks until it's finished, waiting for CTS before each byte. 
+ *  @param data A pointer to the bytes to be written
+ *  @param length The number of bytes to be written
+ *  @return True if all the bytes were sent and false if there was a timeout
+ */
+
+bool avr_uart::write (const void* data, size_t length)
+    {
+    const unsigned char* p_byte = (const unsigned char*)data;
+
+    while (length--)
+        {
+        if (!putchar (*p_byte++))
+            return (false);
+        }
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes several blocks of binary data to the serial port, one after 
+ *  another, as if they were one block. It can be used to send a frame whose header,
+ *  payload and checksum are kept in different places. Warning: This function blocks
+ *  until it's finished. 
+ *  @param segments An array of segments describing the blocks to be written
+ *  @param count The number of segments in the array
+ *  @return True if all the bytes were sent and false if there was a timeout
+ */
+
+bool avr_uart::write_gather (const uart_segment* segments, unsigned char count)
+    {
+    for ( ; count > 0; count--, segments++)
+        {
+        if (!write (segments->data, segments->length))
+            return (false);
+        }
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts an interrupt driven transmission of several blocks of data. It
+ *  returns right away; the data register empty interrupt then sends the bytes in the
+ *  background. Nothing is copied, so the segment array and the data it points to must
+ *  not be changed until tx_busy() returns false. If CTS is in use, it's checked once 
+ *  here rather than once per byte, so the caller must not send more data at once than
+ *  the device on the other end can buffer after it has asserted CTS. 
+ *  @param segments An array of segments describing the blocks to be written
+ *  @param count The number of segments in the array
+ *  @return True if the transmission was started, false if the port was busy with a
+ *      previous transmission or CTS was not asserted
+ */
+
+bool avr_uart::send_gather (const uart_segment* segments, unsigned char count)
+    {
+    // Don't clobber a transmission which is still running
+    if (tx_busy ())
+        return (false);
+
+    // If CTS is being used and it's high, the other end can't take data now
+    if (!clear_to_send ())
+        return (false);
+
+    // Skip any empty segments at the beginning; if they're all empty, we're done
+    for ( ; count > 0 && segments->length == 0; count--, segments++);
+    if (count == 0)
+        return (true);
+
+    tx_segment = segments;
+    tx_pointer = (const unsigned char*)segments->data;
+    tx_bytes_left = segments->length;
+    tx_segments_left = count;
+
+    // The interrupt will fire as soon as it's enabled if the data register is empty
+    UART_CONTROL |= UART_DRMT_IE;
+    return (true);
+    }
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether a transmission started by send_gather() is still going.
+ *  The data register empty interrupt is enabled for exactly as long as there are 
+ *  bytes waiting to be sent, so it serves as the busy flag. 
+ *  @return True if a gathered transmission is in progress, false if not
+ */
+
+bool avr_uart::tx_busy (void)
+    {
+    if (UART_CONTROL & UART_DRMT_IE)
+        return (true);
+    else
+        return (false);
+    }
+
+
 //-------------------------------------------------------------------------------------
 /** This method writes boolean value to the serial port as a character, either "T"
  *  or "F" depending on the value. 
@@ -410,3 +549,30 @@ void avr_uart::write_hex (unsigned long long num)
         write_hex (the_num.bytes[dcnt--]);
     while (dcnt >= 0);
     }
+
+
+//-------------------------------------------------------------------------------------
+/** This is the interrupt service routine which runs whenever the UART's data register
+ *  is empty while a gathered transmission is in progress. It puts the next byte into 
+ *  the data register, moving on to the next non-empty segment when one runs out; when
+ *  the last byte has been written, it turns itself off. 
+ */
+
+ISR (UART_UDRE_VECT)
+    {
+    UART_DATA = *tx_pointer++;
+
+    if (--tx_bytes_left == 0)
+        {
+        while (--tx_segments_left > 0)
+            {
+            tx_segment++;
+            if ((tx_bytes_left = tx_segment->length) != 0)
+                {
+                tx_pointer = (const unsigned char*)tx_segment->data;
+                return;
+                }
+            }
+        UART_CONTROL &= ~UART_DRMT_IE;
+        }
+    }
@@ -17,12 +17,18 @@
  *      \li 03-02-07  JRR  Ported back to C++. I've had it with the limitations of C.
  *      \li 04-16-07  JO   Added write (unsigned long)
  *      \li 07-19-07  JRR  Changed some character return values to bool, added m324p
+ *      \li 10-18-26  DSC  Added ATmega128, binary write() and gathered transmission
+ *      \li 10-18-26  DSC  Baud rate settings computed and checked at compile time
+ *      \li 10-18-26  DSC  Added clear_to_send(), fixed ready_to_send() test
+ *      \li 10-18-26  DSC  Added puts_P() for strings kept in program memory
  */
 //*************************************************************************************
 
 #ifndef _AVR_SERIAL_H_                      // To prevent *.h file from being included
 #define _AVR_SERIAL_H_                      // in a source file more than once
 
+#include <stddef.h>                         // For size_t in the binary write methods
+
 
 //-------------------------------------------------------------------------------------
 // This section contains macros to define the various I/O ports and bits on those 
@@ -68,6 +74,9 @@
     
     // Macro to turn transmitter and receiver both off (no interrupts)
     #define UART_tx_rx_off()  UCR = 0x00
+
+    // Interrupt vector for the data register empty interrupt
+    #define UART_UDRE_VECT  UART_UDRE_vect
 #endif
 
 #ifdef __AVR_ATmega8__                 // For the ATMega8 processor
@@ -97,7 +106,7 @@
     #define UART_modeN81()  UBRRH = 0x00; UCSRC = 0x86
 
     // Macro to set baud rate divisor
-    #define UART_set_baud_div(x)  UBRRL = (x)
+    #define UART_set_baud_div(x)  UBRRH = (x) >> 8; UBRRL = (x)
     
     // Macro to turn transmitter only on (no interrupts)
     #define UART_tx_only_on()  UCSRB = 0x08
@@ -110,6 +119,9 @@
     
     // Macro to turn transmitter and receiver both off (no interrupts)
     #define UART_tx_rx_off()  UCSRB = 0x00
+
+    // Interrupt vector for the data register empty interrupt
+    #define UART_UDRE_VECT  USART_UDRE_vect
 #endif
 
 #ifdef __AVR_ATmega8535__               // For the old ATMega8535 processor
@@ -139,7 +151,7 @@
     #define UART_modeN81()  UBRRH = 0x00; UCSRC = 0x86
 
     // Macro to set baud rate divisor
-    #define UART_set_baud_div(x)  UBRRL = (x)
+    #define UART_set_baud_div(x)  UBRRH = (x) >> 8; UBRRL = (x)
     
     // Macro to turn transmitter only on (no interrupts)
     #define UART_tx_only_on()  UCSRB = 0x08
@@ -152,6 +164,9 @@
     
     // Macro to turn transmitter and receiver both off (no interrupts)
     #define UART_tx_rx_off()  UCSRB = 0x00
+
+    // Interrupt vector for the data register empty interrupt
+    #define UART_UDRE_VECT  USART_UDRE_vect
 #endif // __AVR_ATmega8535__
 
 #ifdef __AVR_ATmega32__                 // For the ATMega32 processor
@@ -181,7 +196,7 @@
     #define UART_modeN81()  UBRRH = 0x00; UCSRC = 0x86
 
     // Macro to set baud rate divisor
-    #define UART_set_baud_div(x)  UBRRL = (x)
+    #define UART_set_baud_div(x)  UBRRH = (x) >> 8; UBRRL = (x)
 
     // Macro to turn transmitter only on (no interrupts)
     #define UART_tx_only_on()  UCSRB = 0x08
@@ -194,6 +209,9 @@
 
     // Macro to turn transmitter and receiver both off (no interrupts)
     #define UART_tx_rx_off()  UCSRB = 0x00
+
+    // Interrupt vector for the data register empty interrupt
+    #define UART_UDRE_VECT  USART_UDRE_vect
 #endif // __AVR_ATmega32__
 
 #if (defined __AVR_ATmega644__ || defined __AVR_ATmega324P__)
@@ -223,7 +241,7 @@
     #define UART_modeN81()  UBRR0H = 0x00; UCSR0C = 0x86
 
     // Macro to set baud rate divisor
-    #define UART_set_baud_div(x)  UBRR0L = (x)
+    #define UART_set_baud_div(x)  UBRR0H = (x) >> 8; UBRR0L = (x)
     
     // Macro to turn transmitter only on (no interrupts)
     #define UART_tx_only_on()  UCSR0B = 0x08
@@ -236,8 +254,137 @@
     
     // Macro to turn transmitter and receiver both off (no interrupts)
     #define UART_tx_rx_off()  UCSR0B = 0x00
+
+    // Interrupt vector for the data register empty interrupt
+    #define UART_UDRE_VECT  USART0_UDRE_vect
+#endif
+
+#ifdef __AVR_ATmega128__                // For the ATmega128, using USART 0
+    #define UART_DATA       UDR0        // USART data register
+
+    #define UART_STATUS     UCSR0A      // USART status register
+    #define UART_RX_CPT     0x80        // Receive complete bit
+    #define UART_TX_CPT     0x40        // Transmission complete bit
+    #define UART_DREG_MT    0x20        // UART data register empty bit
+    #define UART_FRAME_ERR  0x10        // Framing error bit
+    #define UART_OVRRN_ERR  0x08        // Overrun error bit
+    #define UART_PAR_ERR    0x04        // Parity error bit
+    #define UART_2_SPEED    0x02        // Double-speed bit
+    #define UART_MULPROC    0x01        // Multi-processor comm. mode bit
+
+    #define UART_CONTROL    UCSR0B      // UART control register
+    #define UART_RCV_IE     0x80        // Receive complete interrupt enable
+    #define UART_TXC_IE     0x40        // Transmit complete interrupt enable
+    #define UART_DRMT_IE    0x20        // Data register empty interrupt enable
+    #define UART_RX_EN      0x10        // UART receiver enable bit
+    #define UART_TX_EN      0x08        // UART transmitter enable bit
+
+    #define UART_BAUD_HI    UBRR0H      // High byte of baud rate divisor
+    #define UART_BAUD_LOW   UBRR0L      // Low (only) byte of baud divisor
+
+    // Macro sets mode to async, 8 bit, no parity, 1 stop bit. The Mega128 has no
+    // URSEL bit, so UCSR0C is written without bit 7 set
+    #define UART_modeN81()  UBRR0H = 0x00; UCSR0C = 0x06
+
+    // Macro to set baud rate divisor
+    #define UART_set_baud_div(x)  UBRR0H = (x) >> 8; UBRR0L = (x)
+
+    // Macro to turn transmitter only on (no interrupts)
+    #define UART_tx_only_on()  UCSR0B = 0x08
+
+    // Macro to turn receiver only on (no interrupts)
+    #define UART_rx_only_on()  UCSR0B = 0x10
+
+    // Macro to turn transmitter and receiver both on (no interrupts)
+    #define UART_tx_rx_on()  UCSR0B = 0x18
+
+    // Macro to turn transmitter and receiver both off (no interrupts)
+    #define UART_tx_rx_off()  UCSR0B = 0x00
+
+    // Interrupt vector for the data register empty interrupt
+    #define UART_UDRE_VECT  USART0_UDRE_vect
+#endif // __AVR_ATmega128__
+
+//-------------------------------------------------------------------------------------
+// This section computes baud rate divisors at compile time from the CPU clock rate. 
+// The AVR UART divides the clock by 16 (or by 8 in double-speed mode) and then by the 
+// divisor plus one, so many clock and baud rate combinations can't be matched well;
+// a receiver is generally unreliable when the rate is off by more than about 2%. 
+
+#ifndef F_CPU                               // The CPU clock frequency in Hz should be
+    #define F_CPU           8000000UL       // set in the Makefile; this is a fallback
+#endif
+
+/** The largest baud rate error which will be accepted, in tenths of a percent. A baud
+ *  rate which can't be made within this tolerance is a compile time error. */
+#ifndef UART_BAUD_TOLERANCE
+    #define UART_BAUD_TOLERANCE 20
 #endif
 
+/** This bit in a baud rate setting means that the UART's double-speed mode is used. 
+ *  The lower 12 bits of the setting hold the divisor. */
+#define UART_SETTING_2X     0x8000
+
+// Processors without a double-speed bit can only divide the clock by 16
+#ifdef UART_2_SPEED
+    #define UART_HAS_2X     true
+#else
+    #define UART_HAS_2X     false
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** This template computes the baud rate setting for a given baud rate and clock 
+ *  frequency when the program is compiled. It finds the nearest divisor both at
+ *  normal speed and in double-speed mode, and it uses double-speed mode only if that 
+ *  gives a smaller error, since normal speed samples each bit more times and is more 
+ *  tolerant of noise. If neither is within UART_BAUD_TOLERANCE, compiling fails. The
+ *  setting is used like this:
+ *  \code
+ *  avr_uart my_port (uart_baud<115200>::setting);
+ *  \endcode
+ *  Of the common rates, a plain 8 MHz crystal can't make 115200 or 230400 baud (the
+ *  errors are 3.5% and 8.5%) but makes 76800 within 0.2% and 250000 and 500000 with
+ *  no error at all. A 7.3728 or 14.7456 MHz crystal makes all the standard rates 
+ *  without error. 
+ */
+
+template <unsigned long baud, unsigned long clock = F_CPU>
+struct uart_baud
+    {
+    /** The divisor plus one, rounded to the nearest integer, at normal speed */
+    static const unsigned long count_1x = (clock + 8 * baud) / (16 * baud);
+
+    /** The divisor plus one, rounded to the nearest integer, in double-speed mode */
+    static const unsigned long count_2x = (clock + 4 * baud) / (8 * baud);
+
+    /** The baud rates which those divisors actually produce */
+    static const unsigned long actual_1x = count_1x ? clock / (16 * count_1x) : 0;
+    static const unsigned long actual_2x = count_2x ? clock / (8 * count_2x) : 0;
+
+    /** The baud rate errors in tenths of a percent; a divisor which won't fit in the
+     *  12-bit register is given an impossibly large error */
+    static const unsigned long error_1x = (count_1x == 0 || count_1x > 4096) ? 1000UL 
+        : (actual_1x > baud ? actual_1x - baud : baud - actual_1x) * 1000UL / baud;
+    static const unsigned long error_2x = (!UART_HAS_2X || count_2x == 0 
+        || count_2x > 4096) ? 1000UL
+        : (actual_2x > baud ? actual_2x - baud : baud - actual_2x) * 1000UL / baud;
+
+    /** Whether double-speed mode is to be used */
+    static const bool use_2x = error_2x < error_1x;
+
+    /** The error in tenths of a percent for the setting which was chosen */
+    static const unsigned long error = use_2x ? error_2x : error_1x;
+
+    /** The setting to be given to the UART constructor */
+    static const unsigned int setting = use_2x 
+        ? (unsigned int)(count_2x - 1) | UART_SETTING_2X : (unsigned int)(count_1x - 1);
+
+    static_assert (error <= UART_BAUD_TOLERANCE, 
+        "Baud rate can't be made accurately enough from this CPU clock frequency");
+    };
+
+
 /** The number of tries to wait for the transmitter buffer to become empty */
 #define UART_TX_TOUT        20000
 
@@ -250,6 +397,20 @@
 #define UART_CTS_DDR        DDRD
 
 
+//-------------------------------------------------------------------------------------
+/** This structure describes one piece of a gathered transmission: a pointer to some
+ *  bytes and the number of bytes to be sent from there. An array of these allows a 
+ *  frame whose header, payload and checksum live in different places to be sent as
+ *  one transmission without first copying the pieces into a staging buffer. 
+ */
+
+typedef struct
+    {
+    const void* data;                       // Pointer to the first byte to be sent
+    size_t length;                          // Number of bytes to send from there
+    } uart_segment;
+
+
 //-------------------------------------------------------------------------------------
 /** This class controls a UART (Universal Asynchronous Receiver Transmitter), a common 
  *  serial interface. It talks to old-style RS232 serial ports (through a voltage
@@ -278,14 +439,28 @@ class avr_uart
     // pointer or reference to an object of this class
     public:
         // The constructor sets up the UART, saving its location, CTS bit, etc.
-        avr_uart (unsigned char, unsigned char);
+        avr_uart (unsigned int, unsigned char);
         bool ready_to_send (void);          // Check if the port is ready to transmit
+
+        /** This method checks the CTS line once, without waiting. It returns true if
+         *  CTS isn't used or if the other end is ready to take data. */
+        bool clear_to_send (void) 
+            { return (!CTS_mask || !(UART_CTS_PORT & CTS_mask)); }
+
         bool putchar (char);                // Write one character to serial port
         void puts (char const*);            // Write a string constant to serial port
+        void puts_P (char const*);          // Write a string from program memory
         bool check_for_char (void);         // Check if a character is in the buffer
         char getchar (void);                // Get a character; wait if none is ready
         char getch_timeout (unsigned int);  // Get a character unless we time out
 
+        bool write (const void*, size_t);   // Write a block of binary data
+        bool write_gather (const uart_segment*, unsigned char);  // Write several
+
+        // Start an interrupt driven gathered transmission which doesn't block
+        bool send_gather (const uart_segment*, unsigned char);
+        bool tx_busy (void);                // Check if a gathered send is running
+
         void write (bool);                  //
         void write_bin (unsigned char);     // 
         void write_hex (unsigned char);     // These functions write various sizes of
@@ -0,0 +1,114 @@
+//======================================================================================
+/** \file  cal_channel.cc
+ *  This file contains a fixed point calibration which turns raw A/D readings into 
+ *  engineering units. See cal_channel.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "cal_channel.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a calibration which leaves readings as they are, with no
+ *  offset, a gain of one and no lookup table. 
+ */
+
+cal_channel::cal_channel (void)
+{
+    set_linear (0, 1, 0);
+    p_table = NULL;
+    table_bits = 0;
+    table_last = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the offset and gain of the calibration. 
+ *  @param an_offset The reading, in counts, which gives a value of zero
+ *  @param a_gain The number of units per count, times 2 to the power of a_shift
+ *  @param a_shift The number of fraction bits in the gain, from 0 to 15
+ */
+
+void cal_channel::set_linear (int16_t an_offset, int16_t a_gain, uint8_t a_shift)
+{
+    offset = an_offset;
+    gain = a_gain;
+    shift = a_shift;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the offset and gain of the calibration from a structure which is
+ *  kept in program memory. 
+ *  @param p_linear A pointer to the calibration in program memory
+ */
+
+void cal_channel::set_linear_P (const cal_linear* p_linear)
+{
+    set_linear ((int16_t)pgm_read_word (&p_linear->offset), 
+                (int16_t)pgm_read_word (&p_linear->gain),
+                pgm_read_byte (&p_linear->shift));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets a lookup table which turns the result of the linear calibration
+ *  into the final value. Point i of the table holds the value for an input of 
+ *  i * 2^bits; inputs between points are interpolated, inputs below zero give the 
+ *  first point and inputs past the last point give the last one. 
+ *  @param a_table A pointer to the table in program memory, or NULL for no table
+ *  @param points The number of points in the table, at least 2
+ *  @param bits Log base 2 of the spacing between points
+ */
+
+void cal_channel::set_table (const int16_t* a_table, uint8_t points, uint8_t bits)
+{
+    if (points < 2)
+        a_table = NULL;
+    p_table = a_table;
+    table_last = points - 1;
+    table_bits = bits;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method converts an A/D reading into engineering units. 
+ *  @param reading The reading in A/D counts
+ *  @return The value in the units for which the calibration was made
+ */
+
+int16_t cal_channel::convert (uint16_t reading)
+{
+    // Apply the offset and gain, rounding to the nearest unit
+    int32_t product = (int32_t)((int16_t)reading - offset) * gain;
+    if (shift != 0)
+        product += (int32_t)1 << (shift - 1);
+    int16_t value = (int16_t)(product >> shift);
+
+    if (p_table == NULL)
+        return (value);
+
+    // Find the table points on each side of the value and interpolate between them
+    if (value <= 0)
+        return ((int16_t)pgm_read_word (p_table));
+    uint16_t index = (uint16_t)value >> table_bits;
+    if (index >= table_last)
+        return ((int16_t)pgm_read_word (p_table + table_last));
+
+    int16_t below = (int16_t)pgm_read_word (p_table + index);
+    int16_t above = (int16_t)pgm_read_word (p_table + index + 1);
+    uint16_t fraction = (uint16_t)value & ((1 << table_bits) - 1);
+
+    return (below + (int16_t)(((int32_t)(above - below) * fraction) >> table_bits));
+}
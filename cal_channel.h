@@ -0,0 +1,76 @@
+//======================================================================================
+/** \file  cal_channel.h
+ *  This file contains a calibration which turns raw A/D readings into engineering 
+ *  units, so that the code which uses a sensor reading doesn't have to know how the 
+ *  sensor is wired or scaled. Everything is done in fixed point: first an offset is 
+ *  taken off the reading and the difference multiplied by a gain which is scaled by
+ *  a power of two, 
+ *
+ *      \li  value = ((reading - offset) * gain) >> shift
+ *
+ *  then, for sensors which aren't linear, the value can be looked up in a table kept
+ *  in program memory. The table's points are evenly spaced by a power of two, so
+ *  finding the two points around a value and interpolating between them takes a 
+ *  shift, a mask and one multiply rather than any division. A conversion takes a few
+ *  dozen processor cycles, most of them in the two 16 x 16 bit multiplies. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _CAL_CHANNEL_H_                     // To prevent *.h file from being included
+#define _CAL_CHANNEL_H_                     // in a source file more than once
+
+#include <stdint.h>
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds a linear calibration. Arrays of them can be kept in program 
+ *  memory and given to cal_channel::set_linear_P(). */
+
+typedef struct
+{
+    int16_t offset;                         // Reading which gives a value of zero
+    int16_t gain;                           // Units per count, times 2^shift
+    uint8_t shift;                          // Number of fraction bits in the gain
+} cal_linear;
+
+
+//-------------------------------------------------------------------------------------
+/** This class converts the readings from one A/D channel into engineering units. A 
+ *  new calibration is the identity, which leaves readings as they are. 
+ */
+
+class cal_channel
+{
+    protected:
+        int16_t offset;                     // Reading which gives a value of zero
+        int16_t gain;                       // Units per count, times 2^shift
+        uint8_t shift;                      // Number of fraction bits in the gain
+        const int16_t* p_table;             // Lookup table in program memory, or NULL
+        uint8_t table_bits;                 // Log base 2 of the spacing of the points
+        uint8_t table_last;                 // Index of the table's last point
+
+    public:
+        // The constructor creates a calibration which doesn't change readings
+        cal_channel (void);
+
+        // This method sets the offset and gain
+        void set_linear (int16_t, int16_t, uint8_t);
+
+        // This method sets the offset and gain from a structure in program memory
+        void set_linear_P (const cal_linear*);
+
+        // This method sets the lookup table which follows the linear calibration
+        void set_table (const int16_t*, uint8_t, uint8_t);
+
+        // This method converts a reading into engineering units
+        int16_t convert (uint16_t);
+};
+
+#endif // _CAL_CHANNEL_H_
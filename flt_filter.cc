@@ -0,0 +1,51 @@
+//======================================================================================
+/** \file  flt_filter.cc
+ *  This file contains the parts of the fixed point sensor filters which aren't 
+ *  templates. See flt_filter.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "stl_us_timer.h"
+#include "flt_filter.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This function measures how many processor cycles a filter takes to filter one 
+ *  sample, by running it FLT_TIMING_RUNS times on Timer 1, which the task timer runs 
+ *  at one count per microsecond. Interrupts are held off meanwhile so they aren't 
+ *  counted, which takes a few hundred microseconds for the slower filters. The 
+ *  result includes a few cycles of loop and call overhead. The filter is left in a 
+ *  steady state at the given input. 
+ *  @param p_filter A pointer to the filter to be measured
+ *  @param input A typical input value for the filter
+ *  @return The number of processor cycles for each sample
+ */
+
+uint16_t flt_cycles (flt_base* p_filter, int16_t input)
+{
+    uint8_t old_sreg = SREG;
+    cli ();
+
+    uint16_t start = TCNT1;
+    for (uint8_t run = 0; run < FLT_TIMING_RUNS; run++)
+        p_filter->step (input + (run & 0x03));
+    uint16_t counts = TCNT1 - start;
+
+    SREG = old_sreg;
+    p_filter->reset (input);
+
+    return ((uint16_t)((uint32_t)counts * USEC_PER_COUNT * (F_CPU / 1000000L) 
+                       / FLT_TIMING_RUNS));
+}
@@ -0,0 +1,217 @@
+//======================================================================================
+/** \file  flt_filter.h
+ *  This file contains fixed point digital filters for sensor channels. Each filter 
+ *  is a template whose coefficients or length are template parameters, so the 
+ *  compiler builds a separate, fully unrolled version for each filter which is used,
+ *  with the coefficients as constants in the instructions. All arithmetic is on 
+ *  16-bit samples with 32-bit sums, so every multiply is a 16 x 16 -> 32 bit one, 
+ *  which the AVR's hardware multiplier does in a few instructions. 
+ *
+ *      \li  flt_biquad       A second order IIR section, in direct form I, with Q2.14
+ *                            coefficients. Higher orders are made by cascading them
+ *      \li  flt_average      A moving average of 2^n samples, kept as a running sum
+ *      \li  flt_median       The median of the last N samples, which throws out 
+ *                            spikes that are shorter than half the window
+ *      \li  flt_cascade      Two filters one after the other
+ *
+ *  All the filters are descendents of flt_base, so a channel can be given a pointer
+ *  to whatever filter it needs. flt_cycles() measures the number of processor cycles
+ *  a filter takes for each sample, so the filters can be budgeted. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _FLT_FILTER_H_                      // To prevent *.h file from being included
+#define _FLT_FILTER_H_                      // in a source file more than once
+
+#include <stdint.h>
+
+/** The number of fraction bits in biquad coefficients; 16384 means 1.0 */
+#define FLT_Q               14
+
+/** The number of samples flt_cycles() runs a filter for to measure its speed */
+#define FLT_TIMING_RUNS     16
+
+
+//-------------------------------------------------------------------------------------
+/** This is the base class for the filters, so that any filter can be attached to a
+ *  sensor channel through a pointer. 
+ */
+
+class flt_base
+{
+    public:
+        /** This method filters one sample. 
+         *  @param input The new sample
+         *  @return The filtered sample
+         */
+        virtual int16_t step (int16_t input) = 0;
+
+        /** This method puts the filter in the state it would be in if its input had 
+         *  held the given value for a long time, so there's no startup transient. 
+         *  @param value The steady input value
+         */
+        virtual void reset (int16_t value) = 0;
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a second order IIR filter section, computed in direct form I: 
+ *
+ *      y[k] = b0 x[k] + b1 x[k-1] + b2 x[k-2] - a1 y[k-1] - a2 y[k-2]
+ *
+ *  The coefficients are Q2.14 numbers (FLT_Q fraction bits), so they must be between 
+ *  -2 and 2. The sum is kept in 32 bits and rounded once at the end. 
+ */
+
+template <int16_t B0, int16_t B1, int16_t B2, int16_t A1, int16_t A2>
+class flt_biquad : public flt_base
+{
+    protected:
+        int16_t x1, x2;                     // The last two inputs
+        int16_t y1, y2;                     // The last two outputs
+
+    public:
+        flt_biquad (void) { reset (0); }
+
+        int16_t step (int16_t input)
+        {
+            int32_t sum = (int32_t)B0 * input + (int32_t)B1 * x1 + (int32_t)B2 * x2
+                        - (int32_t)A1 * y1 - (int32_t)A2 * y2;
+            int16_t output = (int16_t)((sum + (1L << (FLT_Q - 1))) >> FLT_Q);
+
+            x2 = x1;
+            x1 = input;
+            y2 = y1;
+            y1 = output;
+            return (output);
+        }
+
+        void reset (int16_t value)
+        {
+            x1 = x2 = y1 = y2 = value;
+        }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a moving average of the last 2^LOG_N samples. A running sum is kept,
+ *  so each sample costs one add, one subtract and a shift however long the window is.
+ */
+
+template <uint8_t LOG_N>
+class flt_average : public flt_base
+{
+    protected:
+        int16_t history[1 << LOG_N];        // The samples in the window
+        int32_t sum;                        // The sum of the samples in the window
+        uint8_t oldest;                     // Index of the oldest sample
+
+    public:
+        flt_average (void) { reset (0); }
+
+        int16_t step (int16_t input)
+        {
+            sum += input - history[oldest];
+            history[oldest] = input;
+            oldest = (oldest + 1) & ((1 << LOG_N) - 1);
+            return ((int16_t)(sum >> LOG_N));
+        }
+
+        void reset (int16_t value)
+        {
+            for (uint8_t index = 0; index < (1 << LOG_N); index++)
+                history[index] = value;
+            sum = (int32_t)value << LOG_N;
+            oldest = 0;
+        }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class finds the median of the last N samples, where N is odd. A spike which
+ *  lasts fewer than (N + 1) / 2 samples never gets through, while a step gets through
+ *  with a delay of (N - 1) / 2 samples and without being smoothed. The window is 
+ *  copied and sorted for each sample, which is quick for the short windows used here;
+ *  the three sample median, the usual choice, is done with comparisons alone. 
+ */
+
+template <uint8_t N>
+class flt_median : public flt_base
+{
+    protected:
+        int16_t history[N];                 // The samples in the window
+        uint8_t oldest;                     // Index of the oldest sample
+
+    public:
+        flt_median (void) { reset (0); }
+
+        int16_t step (int16_t input)
+        {
+            history[oldest] = input;
+            if (++oldest >= N)
+                oldest = 0;
+
+            if (N == 3)
+            {
+                int16_t a = history[0], b = history[1], c = history[2];
+                if (a > b) { int16_t t = a; a = b; b = t; }
+                if (b > c) b = c;
+                return (a > b ? a : b);
+            }
+
+            int16_t sorted[N];
+            for (uint8_t index = 0; index < N; index++)
+            {
+                int16_t sample = history[index];
+                uint8_t place = index;
+                for ( ; place > 0 && sorted[place - 1] > sample; place--)
+                    sorted[place] = sorted[place - 1];
+                sorted[place] = sample;
+            }
+            return (sorted[N / 2]);
+        }
+
+        void reset (int16_t value)
+        {
+            for (uint8_t index = 0; index < N; index++)
+                history[index] = value;
+            oldest = 0;
+        }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class runs two filters one after the other, such as a median to take out 
+ *  spikes followed by a low pass filter, or two biquads for a fourth order filter. 
+ *  Cascades can be cascaded to make longer chains. 
+ */
+
+template <class FIRST, class SECOND>
+class flt_cascade : public flt_base
+{
+    protected:
+        FIRST first;                        // The filter which sees the input
+        SECOND second;                      // The filter which makes the output
+
+    public:
+        int16_t step (int16_t input) { return (second.step (first.step (input))); }
+
+        void reset (int16_t value)
+        {
+            first.reset (value);
+            second.reset (value);
+        }
+};
+
+
+// This function measures how many processor cycles a filter takes for each sample
+uint16_t flt_cycles (flt_base*, int16_t);
+
+#endif // _FLT_FILTER_H_
@@ -0,0 +1,66 @@
+//======================================================================================
+/** \file  log_device.h
+ *  This file contains the interface between the flight log writer and the storage
+ *  it writes to. On the aircraft that's an SD card on the SPI port (see avr_sd.h);
+ *  on the PC it's an image file which stands in for the card (see log_image.h), so
+ *  the log writer and reader can be tested and logs read back on the ground.
+ *
+ *  Storage is a row of 512-byte blocks. Blocks are written in runs of consecutive
+ *  blocks, as SD cards write fastest that way: write_start() begins a run, each
+ *  block's bytes are sent with write_data() and write_fill() in as many pieces as
+ *  are convenient, write_end() finishes the block, and write_stop() ends the run.
+ *  The card is busy for a while after each block and after the run ends; busy()
+ *  must return false before anything else is sent. Nothing here waits for the card,
+ *  so the writer can go on taking samples while it's busy.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _LOG_DEVICE_H_                      // To prevent *.h file from being included
+#define _LOG_DEVICE_H_                      // in a source file more than once
+
+#include <stdint.h>
+
+/** The number of bytes in each block of storage */
+#define LOG_BLOCK_SIZE      512
+
+
+//-------------------------------------------------------------------------------------
+/** This is the base class for block storage which the flight log can be written to.
+ */
+
+class log_device
+{
+    public:
+        // This method returns true while the storage is busy with a write
+        virtual bool busy (void) = 0;
+
+        // This method starts a run of blocks written one after another
+        virtual bool write_start (uint32_t) = 0;
+
+        // This method sends some of the bytes of the block being written
+        virtual void write_data (const uint8_t*, uint16_t) = 0;
+
+        // This method sends a number of copies of one byte
+        virtual void write_fill (uint8_t, uint16_t) = 0;
+
+        // This method finishes a block, returning true if it was accepted
+        virtual bool write_end (void) = 0;
+
+        // This method ends a run of blocks
+        virtual void write_stop (void) = 0;
+
+        // This method reads one whole block, waiting until it has been read
+        virtual bool read_block (uint32_t, uint8_t*) = 0;
+
+        // This method returns the number of blocks of storage
+        virtual uint32_t size (void) = 0;
+};
+
+#endif // _LOG_DEVICE_H_
@@ -0,0 +1,203 @@
+//======================================================================================
+/** \file  log_format.cc
+ *  This file contains the functions which build and check the blocks of the flight
+ *  log on the SD card. See log_format.h for the layout.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdint.h>
+#include <string.h>
+#include "tlm_crc16.h"
+#include "log_device.h"
+#include "log_format.h"
+
+
+//-------------------------------------------------------------------------------------
+// These functions put numbers into blocks and take them out, least significant byte
+// first, so that logs read the same on the AVR and on the PC
+
+static void put16 (uint8_t* p_byte, uint16_t value)
+{
+    p_byte[0] = (uint8_t)value;
+    p_byte[1] = (uint8_t)(value >> 8);
+}
+
+static void put32 (uint8_t* p_byte, uint32_t value)
+{
+    put16 (p_byte, (uint16_t)value);
+    put16 (p_byte + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t get16 (const uint8_t* p_byte)
+{
+    return (p_byte[0] | ((uint16_t)p_byte[1] << 8));
+}
+
+static uint32_t get32 (const uint8_t* p_byte)
+{
+    return (get16 (p_byte) | ((uint32_t)get16 (p_byte + 2) << 16));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function builds a card header which gives the generation of the blocks
+ *  written after it.
+ *  @param block A buffer of LOG_BLOCK_SIZE bytes for the header, all of which is set
+ *  @param generation The generation number
+ */
+
+void log_card_build (uint8_t* block, uint16_t generation)
+{
+    memset (block, 0, LOG_BLOCK_SIZE);
+    put16 (block, LF_CARD_MAGIC);
+    block[2] = LF_VERSION;
+    put16 (block + 4, generation);
+    put16 (block + 6, tlm_crc16 (block, 6));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that a block is a card header in this version's format.
+ *  @param block The block which was read from block 0 of the card
+ *  @param generation A variable into which the card's generation is put
+ *  @return True if the block is a good card header
+ */
+
+bool log_card_check (const uint8_t* block, uint16_t& generation)
+{
+    if (get16 (block) != LF_CARD_MAGIC || block[2] != LF_VERSION
+        || get16 (block + 6) != tlm_crc16 (block, 6))
+        return (false);
+
+    generation = get16 (block + 4);
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function builds the bytes at the start of an index block. The rest of the
+ *  block is written as zeros.
+ *  @param header A buffer of LF_INDEX_BYTES bytes
+ *  @param generation The card's generation
+ *  @param flight The flight which the index block describes
+ */
+
+void log_index_build (uint8_t* header, uint16_t generation, const log_flight& flight)
+{
+    put16 (header, LF_INDEX_MAGIC);
+    put16 (header + 2, generation);
+    put16 (header + 4, flight.number);
+    put32 (header + 6, flight.first);
+    put32 (header + 10, flight.start_time);
+    put32 (header + 14, flight.blocks);
+    put16 (header + 18, tlm_crc16 (header, 18));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that a block is the index block of a flight of this
+ *  generation which begins where the block was read from.
+ *  @param block The block which was read
+ *  @param generation The card's generation
+ *  @param number The number of the block which was read
+ *  @param flight A structure into which the index block's contents are put
+ *  @return True if the block is a good index block
+ */
+
+bool log_index_check (const uint8_t* block, uint16_t generation, uint32_t number,
+                      log_flight& flight)
+{
+    if (get16 (block) != LF_INDEX_MAGIC || get16 (block + 2) != generation
+        || get32 (block + 6) != number || get16 (block + 18) != tlm_crc16 (block, 18))
+        return (false);
+
+    flight.number = get16 (block + 4);
+    flight.first = number;
+    flight.start_time = get32 (block + 10);
+    flight.blocks = get32 (block + 14);
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function fills in the header of a data block whose records are already in
+ *  place and sets the bytes after the records to zero. The CRC isn't put in; the
+ *  writer works it out as the block is sent, so it doesn't hold up the sensor task.
+ *  @param block The data block
+ *  @param generation The card's generation
+ *  @param info What the header says
+ */
+
+void log_data_build (uint8_t* block, uint16_t generation, const log_block_info& info)
+{
+    put16 (block, LF_DATA_MAGIC);
+    put16 (block + 2, generation);
+    put16 (block + 4, info.flight);
+    put32 (block + 6, info.number);
+    put32 (block + 10, info.time);
+    put16 (block + 14, info.used);
+    block[16] = info.records;
+    block[17] = 0;
+    memset (block + info.used, 0, LF_DATA_CRC - info.used);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that a block is a data block of this generation which came
+ *  through whole, and reads its header.
+ *  @param block The block which was read
+ *  @param generation The card's generation
+ *  @param info A structure into which the header's contents are put
+ *  @return True if the block is a good data block
+ */
+
+bool log_data_check (const uint8_t* block, uint16_t generation, log_block_info& info)
+{
+    if (get16 (block) != LF_DATA_MAGIC || get16 (block + 2) != generation
+        || get16 (block + LF_DATA_CRC) != tlm_crc16 (block, LF_DATA_CRC))
+        return (false);
+
+    info.flight = get16 (block + 4);
+    info.number = get32 (block + 6);
+    info.time = get32 (block + 10);
+    info.used = get16 (block + 14);
+    info.records = block[16];
+    return (info.used >= LF_DATA_HEADER && info.used <= LF_DATA_CRC);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads the index block of a flight, then looks at the blocks after
+ *  those the index counts to find any which were written after the index was last
+ *  brought up to date, as when the power was cut in flight.
+ *  @param p_device The card or image holding the log
+ *  @param block A buffer of LOG_BLOCK_SIZE bytes which is used to read blocks
+ *  @param generation The card's generation
+ *  @param number The block where the flight's index block should be
+ *  @param flight A structure into which the flight is put, counting every data block
+ *  @return True if there's a flight at that block
+ */
+
+bool log_find_flight (log_device* p_device, uint8_t* block, uint16_t generation,
+                      uint32_t number, log_flight& flight)
+{
+    if (number >= p_device->size () || !p_device->read_block (number, block)
+        || !log_index_check (block, generation, number, flight))
+        return (false);
+
+    log_block_info info;
+    while (flight.first + 1 + flight.blocks < p_device->size ()
+           && p_device->read_block (flight.first + 1 + flight.blocks, block)
+           && log_data_check (block, generation, info)
+           && info.flight == flight.number && info.number == flight.blocks)
+        flight.blocks++;
+
+    return (true);
+}
@@ -0,0 +1,121 @@
+//======================================================================================
+/** \file  log_format.h
+ *  This file describes how the flight log is laid out on the SD card, and contains
+ *  the functions which build and check its blocks; the log writer on the aircraft and
+ *  the log reader on the ground both use them. The card is written from the front,
+ *  one block after another, and nothing is ever written twice except a flight's index
+ *  block, so a log survives the power being cut at any moment. There's no file
+ *  system; the card is read back block by block from an image of it.
+ *
+ *  Block 0 is the card header, which holds a generation number. Formatting the card
+ *  just writes a new header with the next generation; every other block carries the
+ *  generation it was written in, so blocks left over from before are ignored without
+ *  having to erase them. Flights follow from block 1, each one an index block and
+ *  then its data blocks, the next flight's index block right after the last of them:
+ *
+ *      \li  Index block: LF_INDEX_MAGIC, generation, flight number, the block's own
+ *           number, start time, number of data blocks and a CRC of those bytes, then
+ *           zeros. It's written when the flight's first scan comes in and rewritten
+ *           every so often and when the flight ends.
+ *      \li  Data block: LF_DATA_MAGIC, generation, flight number, the block's number
+ *           in the flight counting from 0, the time of its first scan, the number of
+ *           bytes used and the number of scans it holds, then the scans as records
+ *           built by tlm_record_build(), then zeros, with a CRC of bytes 0 through
+ *           LF_DATA_CRC - 1 in the last two bytes. The first record in each block has
+ *           its time in full, so each block can be read on its own.
+ *
+ *  A flight's data blocks written after its index block was last brought up to date
+ *  are found by reading the blocks after the ones the index counts for as long as
+ *  they belong to the flight and are numbered in order. All numbers are stored least
+ *  significant byte first.
+ *
+ *  This file and log_format.cc build both for the AVR and for the ground station PC.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _LOG_FORMAT_H_                      // To prevent *.h file from being included
+#define _LOG_FORMAT_H_                      // in a source file more than once
+
+#include <stdint.h>
+#include "log_device.h"
+
+/** The number which begins the card header, "ML" */
+#define LF_CARD_MAGIC       0x4C4D
+
+/** The version of the format described here */
+#define LF_VERSION          1
+
+/** The number which begins each flight's index block, "FI" */
+#define LF_INDEX_MAGIC      0x4946
+
+/** The number which begins each data block, "LD" */
+#define LF_DATA_MAGIC       0x444C
+
+/** The number of bytes at the start of the card header which are used */
+#define LF_CARD_BYTES       8
+
+/** The number of bytes at the start of an index block which are used */
+#define LF_INDEX_BYTES      20
+
+/** Where the records start in a data block */
+#define LF_DATA_HEADER      18
+
+/** Where the CRC goes in a data block; records must end before it */
+#define LF_DATA_CRC         (LOG_BLOCK_SIZE - 2)
+
+/** The block in which the first flight begins */
+#define LF_FIRST_FLIGHT     1
+
+
+//-------------------------------------------------------------------------------------
+/** This structure describes one flight as its index block does. */
+
+typedef struct
+{
+    uint16_t number;                        // Flight number, counting from 1
+    uint32_t first;                         // Block number of the index block
+    uint32_t start_time;                    // Time of the flight's first scan
+    uint32_t blocks;                        // Number of data blocks in the flight
+} log_flight;
+
+//-------------------------------------------------------------------------------------
+/** This structure holds what the header of a data block says. */
+
+typedef struct
+{
+    uint16_t flight;                        // The flight the block belongs to
+    uint32_t number;                        // Its number in the flight, from 0
+    uint32_t time;                          // Time of the first scan in the block
+    uint16_t used;                          // Bytes used, counting the header
+    uint8_t records;                        // Number of scans in the block
+} log_block_info;
+
+// This function builds a card header in a whole block
+void log_card_build (uint8_t*, uint16_t);
+
+// This function checks a card header and finds its generation
+bool log_card_check (const uint8_t*, uint16_t&);
+
+// This function builds the used bytes at the start of an index block
+void log_index_build (uint8_t*, uint16_t, const log_flight&);
+
+// This function checks an index block which was read from a given block number
+bool log_index_check (const uint8_t*, uint16_t, uint32_t, log_flight&);
+
+// This function fills in the header of a data block and zeros the unused bytes
+void log_data_build (uint8_t*, uint16_t, const log_block_info&);
+
+// This function checks a data block, CRC and all, and reads its header
+bool log_data_check (const uint8_t*, uint16_t, log_block_info&);
+
+// This function reads a flight's index block and counts all its data blocks
+bool log_find_flight (log_device*, uint8_t*, uint16_t, uint32_t, log_flight&);
+
+#endif // _LOG_FORMAT_H_
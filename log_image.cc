@@ -0,0 +1,176 @@
+//======================================================================================
+/** \file  log_image.cc
+ *  This file contains a block device which keeps its blocks in a file on the PC. It
+ *  builds on the PC, not on the AVR. See log_image.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "log_device.h"
+#include "log_image.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor opens an image file for reading and writing. If there's no such
+ *  file, an empty one is made; blocks which haven't been written read as zeros, as
+ *  on an erased card.
+ *  @param name The name of the image file
+ *  @param a_blocks The number of blocks the image holds
+ */
+
+log_image::log_image (const char* name, uint32_t a_blocks)
+{
+    p_file = fopen (name, "r+b");
+    if (p_file == NULL)
+        p_file = fopen (name, "w+b");
+
+    num_blocks = a_blocks;
+    block = 0;
+    fill = 0;
+    running = false;
+    busy_polls = 0;
+    busy_after = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This destructor closes the image file.
+ */
+
+log_image::~log_image (void)
+{
+    if (p_file != NULL)
+        fclose (p_file);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns true for as many calls as set_busy() asked for after each
+ *  block and each run is written.
+ *  @return True if the image is pretending to be busy
+ */
+
+bool log_image::busy (void)
+{
+    if (busy_polls == 0)
+        return (false);
+    busy_polls--;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts a run of blocks.
+ *  @param first The number of the first block to be written
+ *  @return True if the run was started, false if the block isn't in the image
+ */
+
+bool log_image::write_start (uint32_t first)
+{
+    if (p_file == NULL || first >= num_blocks)
+        return (false);
+
+    block = first;
+    fill = 0;
+    running = true;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes some bytes of the block being written. Bytes past the end of
+ *  the block are ignored.
+ *  @param data A pointer to the bytes
+ *  @param length The number of bytes
+ */
+
+void log_image::write_data (const uint8_t* data, uint16_t length)
+{
+    if (!running || block >= num_blocks)
+        return;
+    if (length > LOG_BLOCK_SIZE - fill)
+        length = LOG_BLOCK_SIZE - fill;
+
+    fseek (p_file, (long)block * LOG_BLOCK_SIZE + fill, SEEK_SET);
+    fwrite (data, 1, length, p_file);
+    fill += length;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes a number of copies of one byte into the block being written.
+ *  @param value The byte
+ *  @param count The number of copies
+ */
+
+void log_image::write_fill (uint8_t value, uint16_t count)
+{
+    uint8_t chunk[64];
+
+    memset (chunk, value, sizeof (chunk));
+    while (count > 0)
+    {
+        uint16_t length = (count < sizeof (chunk)) ? count : sizeof (chunk);
+        write_data (chunk, length);
+        count -= length;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finishes a block. A block is accepted only if all its bytes were
+ *  written, as a card would reject a short one.
+ *  @return True if the block was accepted
+ */
+
+bool log_image::write_end (void)
+{
+    bool accepted = running && block < num_blocks && fill == LOG_BLOCK_SIZE;
+
+    fflush (p_file);
+    block++;
+    fill = 0;
+    busy_polls = busy_after;
+    return (accepted);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method ends a run of blocks.
+ */
+
+void log_image::write_stop (void)
+{
+    running = false;
+    busy_polls = busy_after;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads one block from the image. Parts of the image past the end of
+ *  the file read as zeros.
+ *  @param number The number of the block
+ *  @param data A buffer of LOG_BLOCK_SIZE bytes for the block
+ *  @return True if the block was read, false if it isn't in the image
+ */
+
+bool log_image::read_block (uint32_t number, uint8_t* data)
+{
+    if (p_file == NULL || number >= num_blocks)
+        return (false);
+
+    memset (data, 0, LOG_BLOCK_SIZE);
+    fseek (p_file, (long)number * LOG_BLOCK_SIZE, SEEK_SET);
+    if (fread (data, 1, LOG_BLOCK_SIZE, p_file) == 0)
+        clearerr (p_file);
+    return (true);
+}
@@ -0,0 +1,66 @@
+//======================================================================================
+/** \file  log_image.h
+ *  This file contains a block device which keeps its blocks in a file on the PC. It
+ *  stands in for the SD card, so the flight log writer can be run and tested on the
+ *  ground, and it reads image files copied from the card so that logs can be read
+ *  back. It can pretend to be busy for a while after each write, as a card is, to
+ *  test that the writer doesn't lose samples while it waits.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _LOG_IMAGE_H_                       // To prevent *.h file from being included
+#define _LOG_IMAGE_H_                       // in a source file more than once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "log_device.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a block device kept in an image file.
+ */
+
+class log_image : public log_device
+{
+    protected:
+        FILE* p_file;                       // The image file, or NULL if not open
+        uint32_t num_blocks;                // Number of blocks in the image
+        uint32_t block;                     // Block being written
+        uint16_t fill;                      // Bytes of it written so far
+        bool running;                       // A run of blocks has been started
+        uint16_t busy_polls;                // Calls to busy() which return true
+        uint16_t busy_after;                // after each write
+
+    public:
+        // The constructor opens an image file, making it if it isn't there
+        log_image (const char*, uint32_t);
+
+        // The destructor closes the file
+        ~log_image (void);
+
+        /** This method returns true if the image file was opened. */
+        bool is_open (void) { return (p_file != NULL); }
+
+        /** This method sets how many times busy() returns true after each block
+         *  and after each run, to act like a card. */
+        void set_busy (uint16_t polls) { busy_after = polls; }
+
+        // These methods are those of every block device; see log_device.h
+        bool busy (void);
+        bool write_start (uint32_t);
+        void write_data (const uint8_t*, uint16_t);
+        void write_fill (uint8_t, uint16_t);
+        bool write_end (void);
+        void write_stop (void);
+        bool read_block (uint32_t, uint8_t*);
+        uint32_t size (void) { return (num_blocks); }
+};
+
+#endif // _LOG_IMAGE_H_
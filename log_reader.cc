@@ -0,0 +1,102 @@
+//======================================================================================
+/** \file  log_reader.cc
+ *  This file contains the flight log reader. See log_reader.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdint.h>
+#include "tlm_frame.h"
+#include "tlm_record.h"
+#include "log_device.h"
+#include "log_format.h"
+#include "log_reader.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor reads the card header of a log. No flight is selected until
+ *  next_flight() is called.
+ *  @param a_device The card or image which holds the log
+ */
+
+log_reader::log_reader (log_device* a_device)
+{
+    p_device = a_device;
+    generation = 0;
+    formatted = p_device->read_block (0, block) && log_card_check (block, generation);
+    next_first = LF_FIRST_FLIGHT;
+    flight.number = 0;
+    flight.first = 0;
+    flight.start_time = 0;
+    flight.blocks = 0;
+    block_number = 0;
+    records_left = 0;
+    bad_blocks = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method moves on to the next flight in the log, the first one the first time
+ *  it's called.
+ *  @return True if there's another flight, false if the end of the log was reached
+ */
+
+bool log_reader::next_flight (void)
+{
+    if (!formatted
+        || !log_find_flight (p_device, block, generation, next_first, flight))
+        return (false);
+
+    next_first = flight.first + 1 + flight.blocks;
+    block_number = 0;
+    records_left = 0;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads the next scan in the flight.
+ *  @param sequence A variable into which the scan's sequence number is put
+ *  @param a_time A variable into which the time the scan started is put
+ *  @param channel_map A variable into which the scan's channel bitmap is put
+ *  @param samples An array of TLM_MAX_CHANNELS samples indexed by slot, into which
+ *      the scan's samples are put
+ *  @return True if a scan was read, false if there are no more in the flight
+ */
+
+bool log_reader::next_record (uint8_t& sequence, uint32_t& a_time,
+                              uint32_t& channel_map, uint16_t* samples)
+{
+    log_block_info info;
+
+    while (records_left == 0)
+    {
+        if (block_number >= flight.blocks)
+            return (false);
+
+        if (!p_device->read_block (flight.first + 1 + block_number, block)
+            || !log_data_check (block, generation, info)
+            || info.flight != flight.number || info.number != block_number)
+        {
+            bad_blocks++;
+        }
+        else
+        {
+            place = LF_DATA_HEADER;
+            records_left = info.records;
+            time = info.time;
+        }
+        block_number++;
+    }
+
+    place += tlm_record_read (block + place, sequence, time, channel_map, samples);
+    records_left--;
+    a_time = time;
+    return (true);
+}
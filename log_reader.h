@@ -0,0 +1,65 @@
+//======================================================================================
+/** \file  log_reader.h
+ *  This file contains the flight log reader, which goes through an image of the SD
+ *  card on the ground station PC and gives back each flight and the scans in it. The
+ *  log is laid out as described in log_format.h. Blocks which don't come through
+ *  whole are skipped and counted, so a damaged card still gives up what it can.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _LOG_READER_H_                      // To prevent *.h file from being included
+#define _LOG_READER_H_                      // in a source file more than once
+
+#include <stdint.h>
+#include "log_device.h"
+#include "log_format.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This class reads the flights in a log. Call next_flight() to move to each flight
+ *  in turn, then next_record() to read each of its scans.
+ */
+
+class log_reader
+{
+    protected:
+        log_device* p_device;               // The card or image read from
+        uint8_t block[LOG_BLOCK_SIZE];      // The data block being read
+        uint16_t generation;                // The card's generation
+        bool formatted;                     // The card has a good header
+        log_flight flight;                  // The flight being read
+        uint32_t next_first;                // Where the next flight's index is
+        uint32_t block_number;              // Next data block in the flight
+        uint16_t place;                     // Where the next record is in the block
+        uint8_t records_left;               // Records in the block not yet read
+        uint32_t time;                      // Time of the last record read
+        uint16_t bad_blocks;                // Blocks skipped because they were bad
+
+    public:
+        // The constructor reads the card header
+        log_reader (log_device*);
+
+        // This method moves on to the next flight
+        bool next_flight (void);
+
+        // This method reads the next scan in the flight
+        bool next_record (uint8_t&, uint32_t&, uint32_t&, uint16_t*);
+
+        /** This method returns true if the card has a good header. */
+        bool is_formatted (void) { return (formatted); }
+
+        /** This method returns the flight being read. */
+        const log_flight& get_flight (void) { return (flight); }
+
+        /** This method returns the number of data blocks which were skipped. */
+        uint16_t blocks_bad (void) { return (bad_blocks); }
+};
+
+#endif // _LOG_READER_H_
@@ -0,0 +1,421 @@
+//======================================================================================
+/** \file  log_writer.cc
+ *  This file contains the flight log writer, which appends every sensor scan to the
+ *  SD card. See log_writer.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC One block buffer and a staging area instead of two buffers
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdint.h>
+#include <string.h>
+#include "tlm_crc16.h"
+#include "tlm_frame.h"
+#include "tlm_record.h"
+#include "log_device.h"
+#include "log_format.h"
+#include "log_writer.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a writer which isn't logging a flight yet.
+ *  @param a_device The card or image to which the log is written
+ */
+
+log_writer::log_writer (log_device* a_device)
+{
+    p_device = a_device;
+    step = LW_CLOSED;
+    generation = 0;
+    flight.number = 0;
+    flight.first = 0;
+    flight.start_time = 0;
+    flight.blocks = 0;
+    dropped = 0;
+    rejected = 0;
+    retries = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method waits until the card has finished what it was doing, giving up if it
+ *  takes too long. It's only used while the log is being opened, when nothing else
+ *  needs the processor yet.
+ *  @return True if the card is ready, false if it stayed busy
+ */
+
+bool log_writer::wait_ready (void)
+{
+    for (uint32_t polls = 0; polls < LW_BUSY_POLLS; polls++)
+    {
+        if (!p_device->busy ())
+            return (true);
+    }
+    return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes a new card header with the next generation number, after which
+ *  every block written before is ignored, so the card is as good as empty. It waits
+ *  for the card, so it must not be called while a flight is being logged.
+ *  @return True if the header was written
+ */
+
+bool log_writer::format (void)
+{
+    uint8_t* p_block = block;
+    uint16_t old_generation;
+
+    if (is_open () || !p_device->read_block (0, p_block))
+        return (false);
+
+    generation = log_card_check (p_block, old_generation) ? old_generation + 1 : 1;
+    if (generation == 0)
+        generation = 1;
+    log_card_build (p_block, generation);
+
+    bool written = wait_ready () && p_device->write_start (0);
+    if (written)
+    {
+        p_device->write_data (p_block, LOG_BLOCK_SIZE);
+        written = p_device->write_end ();
+        if (wait_ready ())
+            p_device->write_stop ();
+        written = wait_ready () && written;
+    }
+    step = written ? LW_CLOSED : LW_FAILED;
+    return (written);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads the card header, formatting the card if there's none, then walks
+ *  through the flights already on the card to find where the log ends, and gets ready
+ *  to log a new flight there. It reads the card and waits for it, so it should be
+ *  called before the tasks start running.
+ *  @return True if the log is ready for scans
+ */
+
+bool log_writer::open (void)
+{
+    uint8_t* p_block = block;
+
+    if (is_open ())
+        return (true);
+
+    if (!p_device->read_block (0, p_block))
+    {
+        step = LW_FAILED;
+        return (false);
+    }
+    if (!log_card_check (p_block, generation) && !format ())
+        return (false);
+
+    // Each flight begins right after the last data block of the one before
+    log_flight found;
+    flight.number = 1;
+    flight.first = LF_FIRST_FLIGHT;
+    while (log_find_flight (p_device, p_block, generation, flight.first, found))
+    {
+        flight.number = found.number + 1;
+        flight.first = found.first + 1 + found.blocks;
+    }
+    flight.start_time = 0;
+    flight.blocks = 0;
+
+    block_full = false;
+    fill_info.used = LF_DATA_HEADER;
+    fill_info.records = 0;
+    sealed = 0;
+    run_open = false;
+    stop_due = false;
+    index_due = false;
+    closing = false;
+    index_final = false;
+    retries = 0;
+
+    step = (flight.first + 1 < p_device->size ()) ? LW_IDLE : LW_FAILED;
+    return (step == LW_IDLE);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finishes the block being filled, filling in its header, and marks it
+ *  to be sent. The next block is begun at once, but its scans go into the staging
+ *  area until the full block has been sent.
+ */
+
+void log_writer::seal (void)
+{
+    fill_info.flight = flight.number;
+    fill_info.number = sealed++;
+    log_data_build (block, generation, fill_info);
+
+    block_full = true;
+    fill_info.used = LF_DATA_HEADER;
+    fill_info.records = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called once the card has taken the full block. The scans which
+ *  were staged while it was being sent are moved into the block, where they're the
+ *  start of the next one; their header is already in fill_info. If the flight is
+ *  being closed, they're sealed into a block of their own.
+ */
+
+void log_writer::unstage (void)
+{
+    block_full = false;
+    memcpy (block + LF_DATA_HEADER, stage, fill_info.used - LF_DATA_HEADER);
+
+    if (closing && fill_info.records != 0)
+        seal ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds a scan to the block being filled, or to the staging area if the
+ *  block is full and waiting for the card. It only copies a few dozen bytes and never
+ *  waits for the card. The first record in each block has the time in full; the rest
+ *  have the time since the record before.
+ *  @param sequence The scan's sequence number
+ *  @param time The time at which the scan started
+ *  @param channel_map A bitmap of the slots which were read in the scan
+ *  @param samples An array of TLM_MAX_CHANNELS 12-bit samples indexed by slot
+ *  @return True if the scan was put in, false if it was dropped because the staging
+ *      area is full or no flight is being logged
+ */
+
+bool log_writer::put (uint8_t sequence, uint32_t time, uint32_t channel_map,
+                      const uint16_t* samples)
+{
+    if (!is_open () || closing)
+        return (false);
+
+    // The flight's index block is written once it has a start time
+    if (sealed == 0 && fill_info.records == 0)
+    {
+        flight.start_time = time;
+        index_due = true;
+    }
+
+    uint8_t record[TR_RECORD_MAX];
+    uint32_t delta = fill_info.records ? time - last_time : TR_ABS_TIME;
+    uint8_t length = tlm_record_build (record, sequence, delta, time, channel_map,
+                                       samples);
+    if (fill_info.used + length > LF_DATA_CRC)
+    {
+        seal ();
+        length = tlm_record_build (record, sequence, TR_ABS_TIME, time, channel_map,
+                                   samples);
+    }
+
+    // While the block is full, the scans which will start the next one are staged
+    uint8_t* p_record = block + fill_info.used;
+    if (block_full)
+    {
+        uint16_t staged = fill_info.used - LF_DATA_HEADER;
+        if (staged + length > LW_STAGE_SIZE)
+        {
+            dropped++;
+            return (false);
+        }
+        p_record = stage + staged;
+    }
+
+    if (fill_info.records == 0)
+        fill_info.time = time;
+    memcpy (p_record, record, length);
+    fill_info.used += length;
+    fill_info.records++;
+    last_time = time;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gets ready to send a block, a piece at a time.
+ *  @param p_data The bytes at the start of the block; the rest of it is zeros
+ *  @param length The number of those bytes
+ *  @param check True if a CRC of the bytes is to be sent right after them
+ */
+
+void log_writer::begin_block (const uint8_t* p_data, uint16_t length, bool check)
+{
+    p_out = p_data;
+    out_length = length;
+    out_sent = 0;
+    out_check = check;
+    out_crc = TLM_CRC16_INIT;
+    step = LW_SEND;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends the next piece of the block being sent: up to LW_CHUNK bytes of
+ *  its data, then its CRC, then the zeros which fill it out. The CRC is worked out a
+ *  piece at a time as the data goes out. Once the whole block is sent, it's finished,
+ *  and if the card turned it down it will be sent again in a new write.
+ */
+
+void log_writer::send_piece (void)
+{
+    uint16_t count;
+
+    if (out_sent < out_length)
+    {
+        count = out_length - out_sent;
+        if (count > LW_CHUNK)
+            count = LW_CHUNK;
+        p_device->write_data (p_out + out_sent, count);
+        if (out_check)
+            out_crc = tlm_crc16 (p_out + out_sent, count, out_crc);
+        out_sent += count;
+        return;
+    }
+    if (out_check)
+    {
+        uint8_t crc_bytes[2] = { (uint8_t)out_crc, (uint8_t)(out_crc >> 8) };
+        p_device->write_data (crc_bytes, 2);
+        out_sent += 2;
+        out_check = false;
+    }
+    if (out_sent < LOG_BLOCK_SIZE)
+    {
+        count = LOG_BLOCK_SIZE - out_sent;
+        if (count > LW_CHUNK)
+            count = LW_CHUNK;
+        p_device->write_fill (0, count);
+        out_sent += count;
+        return;
+    }
+
+    bool accepted = p_device->write_end ();
+    step = LW_IDLE;
+
+    // The index block is written on its own, as it's behind the data blocks, so its
+    // write is ended once the card has saved it; so is a write the card turned down
+    if (p_out == index_header)
+    {
+        stop_due = true;
+        if (!accepted)
+            index_due = true;
+    }
+    else if (accepted)
+    {
+        unstage ();
+        if (++flight.blocks % LW_INDEX_EVERY == 0)
+            index_due = true;
+    }
+    else
+        stop_due = true;
+
+    if (accepted)
+        retries = 0;
+    else
+    {
+        rejected++;
+        if (++retries > LW_RETRIES)
+            step = LW_FAILED;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method does the next bit of writing to the card, if the card is ready for it,
+ *  and returns without waiting. It sends one piece of a block, or starts on the next
+ *  block to be sent: the flight's index block if it needs to be brought up to date,
+ *  otherwise a full data block, which goes on the end of the multiple block write
+ *  already open if there is one. The write is left open between data blocks, so the
+ *  card can go on saving them quickly. This should be called every few milliseconds.
+ */
+
+void log_writer::service (void)
+{
+    if (step == LW_SEND)
+    {
+        send_piece ();
+        return;
+    }
+
+    // Nothing more may be sent until the card has saved what it was sent last
+    if (step != LW_IDLE || p_device->busy ())
+        return;
+
+    // Data blocks go first, so the block is free for scans again; the index block is
+    // only brought up to date between them
+    if (run_open && (stop_due || (!block_full && (index_due || closing))))
+    {
+        p_device->write_stop ();
+        run_open = false;
+        stop_due = false;
+    }
+    else if (block_full)
+    {
+        if (!run_open)
+        {
+            uint32_t number = flight.first + 1 + flight.blocks;
+            if (number >= p_device->size () || !p_device->write_start (number))
+            {
+                step = LW_FAILED;
+                return;
+            }
+            run_open = true;
+        }
+        begin_block (block, LF_DATA_CRC, true);
+    }
+    else if (index_due)
+    {
+        if (!p_device->write_start (flight.first))
+        {
+            step = LW_FAILED;
+            return;
+        }
+        run_open = true;
+        log_index_build (index_header, generation, flight);
+        index_due = false;
+        begin_block (index_header, LF_INDEX_BYTES, false);
+    }
+    else if (closing)
+    {
+        // Once the last data block is out, the index block is written once more
+        if (!index_final)
+        {
+            index_final = true;
+            index_due = true;
+        }
+        else
+            step = LW_CLOSED;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method ends the flight. The scans in the block being filled are sealed into a
+ *  block of their own, as are any staged ones once the full block is out, and
+ *  service() goes on being called until is_open() returns false, by which time every
+ *  scan put in and the flight's index are on the card.
+ */
+
+void log_writer::close (void)
+{
+    if (!is_open () || closing)
+        return;
+
+    if (fill_info.records != 0 && !block_full)
+        seal ();
+
+    // A flight which never got a scan has no index block to bring up to date
+    closing = true;
+    if (sealed == 0)
+        step = LW_CLOSED;
+}
@@ -0,0 +1,163 @@
+//======================================================================================
+/** \file  log_writer.h
+ *  This file contains the flight log writer, which appends every sensor scan to the
+ *  SD card so that nothing is lost when the radio link drops out. Scans are stored as
+ *  compact records (see tlm_record.h), packed into 512-byte blocks laid out as
+ *  described in log_format.h.
+ *
+ *  There is one block buffer, as two don't fit in the ATmega128's RAM beside the rest
+ *  of the program. Once the block is full, it's sent to the card, and scans put in
+ *  meanwhile go into a small staging area; they become the start of the next block
+ *  as soon as the card has taken the full one. The sensor task never waits for the
+ *  card. Blocks are sent LW_CHUNK bytes at a time, one piece each time service() is
+ *  called, so that sending them doesn't hold up the other tasks either; consecutive
+ *  blocks go out as one multiple block write, which the card saves much faster than
+ *  single blocks. A block is taken as soon as it has been sent, and the card goes on
+ *  saving it while the next one fills, so the writer rides out the card being busy
+ *  for as long as the block and then the staging area take to fill: about 85 ms at
+ *  the full scan rate. While a flight's index block is brought up to date, every
+ *  LW_INDEX_EVERY blocks, the card is waited for four times in that time, so each
+ *  wait must be under about 20 ms. If the card stays busy longer than that, which it
+ *  can for a good fraction of a second now and then, the staging area fills up and
+ *  scans are dropped and counted; the ground can read the counts by command (see
+ *  task_uplink.h). A second block buffer would double the time covered, but there's
+ *  no room for one.
+ *
+ *  This file and log_writer.cc build both for the AVR and for the ground station PC,
+ *  where the writer is tested with an image file standing in for the card.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC One block buffer and a staging area instead of two buffers
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _LOG_WRITER_H_                      // To prevent *.h file from being included
+#define _LOG_WRITER_H_                      // in a source file more than once
+
+#include <stdint.h>
+#include "log_device.h"
+#include "log_format.h"
+
+/** The number of bytes sent to the card each time service() is called */
+#define LW_CHUNK            128
+
+/** The number of bytes of scans which can be put aside while the full block is being
+ *  sent; about three scans, or 15 ms at the full scan rate, which is twice the time
+ *  it takes to send a block LW_CHUNK bytes at a time with service() run every ms.
+ *  Once the block has been sent, it fills again while the card is busy */
+#define LW_STAGE_SIZE       96
+
+/** A flight's index block is brought up to date after this many data blocks */
+#define LW_INDEX_EVERY      64
+
+/** The most times busy() is asked while the writer waits for the card to finish
+ *  a write it has to wait for, which is only while the card is being opened */
+#define LW_BUSY_POLLS       60000UL
+
+/** The number of blocks in a row which the card may turn down before the writer
+ *  gives up on it */
+#define LW_RETRIES          3
+
+// These are the things the writer can be doing between calls to service()
+#define LW_CLOSED           0               // No flight is being logged
+#define LW_IDLE             1               // Waiting for something to send
+#define LW_SEND             2               // Partway through sending a block
+#define LW_FAILED           3               // The card stopped working
+
+
+//-------------------------------------------------------------------------------------
+/** This class writes a flight log on a block device. Call open() once the card is
+ *  ready, then put() with each scan and service() often. The log can be closed with
+ *  close(), but it doesn't have to be; if the power is cut, all but the scans still in
+ *  the buffers can be read back.
+ */
+
+class log_writer
+{
+    protected:
+        log_device* p_device;               // The card or image written to
+        uint8_t block[LOG_BLOCK_SIZE];      // Block being filled or sent
+        bool block_full;                    // The block is waiting to be sent
+        uint8_t stage[LW_STAGE_SIZE];       // Scans put in while the block is sent
+        log_block_info fill_info;           // Header of the block being filled
+        uint32_t last_time;                 // Time of the latest scan put in
+        uint16_t generation;                // Card's generation
+        log_flight flight;                  // The flight, counting blocks written
+        uint32_t sealed;                    // Data blocks filled this flight
+
+        uint8_t step;                       // What the writer is doing, LW_CLOSED...
+        bool run_open;                      // A multiple block write is open
+        bool stop_due;                      // It's to be ended before anything else
+        bool index_due;                     // The index block needs writing
+        bool closing;                       // close() was called
+        bool index_final;                   // The last index write has been asked for
+        const uint8_t* p_out;               // Bytes of the block being sent
+        uint16_t out_length;                // How many of them there are
+        uint16_t out_sent;                  // Bytes of the block sent so far
+        bool out_check;                     // Append a CRC to the bytes
+        uint16_t out_crc;                   // CRC of the bytes sent so far
+        uint8_t index_header[LF_INDEX_BYTES];   // Index block being sent
+
+        uint32_t dropped;                   // Scans which didn't fit in the buffers
+        uint16_t rejected;                  // Blocks the card turned down
+        uint8_t retries;                    // Blocks turned down in a row
+
+        // This method waits until the card isn't busy, for a while at most
+        bool wait_ready (void);
+
+        // This method finishes the block being filled and starts on the next
+        void seal (void);
+
+        // This method starts the next block with the scans which were staged
+        void unstage (void);
+
+        // This method begins sending a block
+        void begin_block (const uint8_t*, uint16_t, bool);
+
+        // This method sends the next piece of the block being sent
+        void send_piece (void);
+
+    public:
+        // The constructor creates a writer for a block device
+        log_writer (log_device*);
+
+        // This method writes a new card header, so old flights are forgotten
+        bool format (void);
+
+        // This method finds the end of the log and begins a new flight there
+        bool open (void);
+
+        // This method adds a scan to the log
+        bool put (uint8_t, uint32_t, uint32_t, const uint16_t*);
+
+        // This method does the next bit of writing to the card
+        void service (void);
+
+        // This method writes out everything that's been put and ends the flight
+        void close (void);
+
+        /** This method returns true while a flight is being logged. */
+        bool is_open (void) { return (step == LW_IDLE || step == LW_SEND); }
+
+        /** This method returns true if the card stopped working. */
+        bool has_failed (void) { return (step == LW_FAILED); }
+
+        /** This method returns the number of the flight being logged. */
+        uint16_t flight_number (void) { return (flight.number); }
+
+        /** This method returns the number of data blocks written this flight. */
+        uint32_t blocks_written (void) { return (flight.blocks); }
+
+        /** This method returns the number of scans which had to be dropped. */
+        uint32_t scans_dropped (void) { return (dropped); }
+
+        /** This method returns the number of blocks the card turned down. */
+        uint16_t blocks_rejected (void) { return (rejected); }
+};
+
+#endif // _LOG_WRITER_H_
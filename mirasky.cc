@@ -19,6 +19,28 @@
  *    \li  04-01-08  DSC  Mirasky is born
  *    \li  04-05-08  DSC  Structure created
  *    \li  04-08-08  DSC  Basic classes included
+ *    \li  10-18-26  DSC  RAM budget worked out; messages kept in program memory
+ *    \li  10-18-26  DSC  Leftover robot tasks which were never written taken out
+ *
+ *  RAM budget, in bytes, of the ATmega128's 4096. The tasks are made in main(), so
+ *  they're on the stack, but they're there for good and are counted with the static
+ *  data, which 'make size' shows once the program is built. The rest of the stack 
+ *  must fit in what's left. There's no room for a second log block buffer, a bigger
+ *  telemetry queue or an onboard scan history; check this before adding anything.
+ *	Sensor task: readings, calibrations, encoder, attitude, air data	1062
+ *	Telemetry task: 320 byte queue, critical frame window, API link		 840
+ *	Logger task: 512 byte block buffer and 96 byte staging area		 716
+ *	Radio setup and uplink tasks, radio, SD card, timer, main's locals	 160
+ *	A/D scan sequencer's tables, 23 bytes for each of 18 channels		 468
+ *	Channel filters								 192
+ *	Serial port, timer and task counters					  10
+ *	Radio setup commands, CORDIC table, virtual tables, other strings	 221
+ *	Total									3669
+ *	Left for the stack							 427
+ *  The deepest the stack goes is when the sensor task logs a scan, about 280 bytes,
+ *  and an interrupt can come on top of that, about 60 more. Those are estimates from
+ *  the local variables and saved registers along the way, as is the 100 bytes or so
+ *  of virtual tables. 
  */
 //======================================================================================
                                             // System headers included with < >
@@ -26,16 +48,26 @@
 #include <avr/io.h>                         // Input-output ports, special registers
 #include <avr/interrupt.h>                  // Interrupt handling functions
 #include <stdint.h>
+#include <avr/pgmspace.h>                   // Messages kept in program memory
 
                                             // User written headers included with " "
-#include "avr_adc.h"
 #include "avr_serial.h"                     // Serial port header
+#include "avr_adc_scan.h"                   // Interrupt driven A/D scan sequencer
 #include "stl_us_timer.h"                   // Microsecond-resolution timer
 #include "stl_debug.h"                      // Handy debugging macros
 #include "stl_task.h"                       // Base class for all task classes
+#include "avr_9xtend.h"                     // Radio modem header
+#include "task_radio_setup.h"               // Configures the radio in the background
+#include "tlm_frame.h"                      // Telemetry frame sizes
+#include "task_telemetry.h"                 // Sends telemetry in power-saving bursts
+#include "task_logger.h"                    // Keeps the flight log on the SD card
+#include "task_sensors.h"                   // Reads the sensors
+#include "task_uplink.h"                    // Carries out commands from the ground
 #include "avr_adc.h"			    // ADC header
 
-#define  BAUD_DIV        52                 // For Mega128 with 8MHz crystal
+#define  RADIO_BAUD      9600               // Baud rate for the radio modem
+#define  RADIO_CTS       (1 << PD4)         // Pin on UART_CTS_PORT wired to radio CTS
+#define  RADIO_SLEEP     (1 << PD5)         // Pin on A9XS_SLEEP_PRT wired to SLEEP
 
 /** The main function is the "entry point" of every C program, the one which runs first
  *  (after standard setup code has finished). For mechatronics programs, main() runs an
@@ -44,30 +76,53 @@
 
 int main ()
 {
-    char time_string[16];                   // Character buffer holds printable time
-
     // Create a radio modem to act as the serial port object. Output will be printed to 
     // this port, which should be hooked up to a dumb terminal program like minicom
-    avr_9xtend the_radio (BAUD_DIV);
+    avr_9xtend the_radio (uart_baud<RADIO_BAUD>::setting, RADIO_CTS, RADIO_SLEEP);
 
     // Print a greeting message. This is almost always a good thing because it lets 
     // the user know that the program is actually running
-    the_radio.puts ("\r\n\nInitiating Mirasky Routine. Hello!\r\n");
+    the_radio.puts_P (PSTR ("\r\n\nInitiating Mirasky Routine. Hello!\r\n"));
 
-    // Create a really basic no-frills analog to digital converter interface object
-    avr_adc my_adc (&the_serial_port);
+    // Create the A/D scan sequencer, which reads all the sensors in its interrupt
+    avr_adc_scan the_scanner;
 
     // Create a microsecond-resolution timer
     task_timer the_timer;
 
-    // Create the sensor controller object
-    sensor_controller my_sensor_control ();
+    // Create the task which configures the radio modem in the background, so the
+    // sensors don't have to wait through the radio's command mode guard times
+    time_stamp radio_setup_interval (0, 10000L);
+    task_radio_setup radio_setup_task (&radio_setup_interval, &the_radio, &the_timer);
+
+    // Create the task which sends telemetry, keeping the radio asleep between bursts
+    time_stamp telemetry_interval (0, 2000L);
+    task_telemetry telemetry_task (&telemetry_interval, &the_radio, &the_timer);
+
+    // Create the task which writes every scan to the flight log on the SD card. It runs
+    // often so that it keeps the card busy, but each run only sends a few bytes
+    avr_sd the_card;
+    time_stamp logger_interval (0, 1000L);
+    task_logger logger_task (&logger_interval, &the_card);
 
-    // Create tasks to control robot's movements
-    task_sensors sensor_task (&interval_time, &the_serial_port, &my_sensor_control);
-    task_find search_task (&interval_time, &the_serial_port, &sen_control);
-    task_avoid avo_task (&interval_time, &my_motor_control, &the_serial_port, &sensor_task);
-    task_wander move_task (&interval_time, &my_motor_control, &the_serial_port);
+    // Create the task which reads the sensors. The scan timer sets the sample rate;
+    // the sensor task runs more often than that so it never misses a scan
+    time_stamp sensor_interval (0, 2000L);
+    task_sensors sensor_task (&sensor_interval, &the_radio, &the_scanner, &telemetry_task,
+                              &logger_task);
+
+    // Create the task which carries out commands from the ground; the numbers given
+    // to add_task() are the ones TLM_CMD_INTERVAL commands use for each task
+    time_stamp uplink_interval (0, 2000L);
+    task_uplink uplink_task (&uplink_interval, &the_radio, &telemetry_task, 
+                             &sensor_task, &logger_task);
+    uplink_task.add_task (0, &sensor_task);
+    uplink_task.add_task (1, &telemetry_task);
+
+    // The tasks which the main loop must not keep waiting while the processor sleeps
+    // through a quiet A/D conversion
+    stl_task* timed_tasks[] = { &radio_setup_task, &uplink_task, &telemetry_task, 
+                                &sensor_task, &logger_task };
 
     // Turn on interrupt processing so the timer can work
     sei ();
@@ -78,10 +133,26 @@ int main ()
     // will be used in other more sophisticated programs
     while (true)
     {
+	radio_setup_task.schedule (the_timer.get_time_now ());
+	uplink_task.schedule (the_timer.get_time_now ());
+	telemetry_task.schedule (the_timer.get_time_now ());
 	sensor_task.schedule (the_timer.get_time_now ());
-	search_task.schedule (the_timer.get_time_now ());
-        avo_task.schedule (the_timer.get_time_now ());
-        move_task.schedule (the_timer.get_time_now ());
+	logger_task.schedule (the_timer.get_time_now ());
+
+	// If a quiet A/D conversion is waiting, sleep through it if there's time before
+	// the next task is due. The serial port stops during sleep, so the radio must
+	// be asleep and have nothing left to send
+	time_stamp now = the_timer.get_time_now ();
+	long slack = 0x7FFFFFFFL;
+	for (uint8_t index = 0; index < sizeof (timed_tasks) / sizeof (timed_tasks[0]); 
+	     index++)
+	{
+	    long until = timed_tasks[index]->time_to_run (now);
+	    if (until < slack)
+		slack = until;
+	}
+	the_scanner.run_quiet (slack * USEC_PER_COUNT, 
+	                       the_radio.asleep () && !the_radio.tx_busy ());
     }
 
     return (0);
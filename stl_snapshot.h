@@ -0,0 +1,131 @@
+//======================================================================================
+/** \file  stl_snapshot.h
+ *  This file contains a sequence lock, which lets one writer publish a structure of
+ *  data to readers which may interrupt it, or be interrupted by it, without either
+ *  side turning interrupts off for the length of a copy. On an 8-bit processor even
+ *  a 16-bit number is read a byte at a time, so a reader which is interrupted by the
+ *  writer, or which interrupts it, could see half of an old value and half of a new
+ *  one, or a reading from one scan with the time stamp of another.
+ *
+ *  The writer adds one to a sequence count before it changes the data and one again
+ *  when it's done, so the count is odd while the data are being changed. A reader
+ *  notes the count, copies what it needs, and checks the count again; if the count
+ *  was odd or has changed, the copy may be torn and is made again. Readers never
+ *  hold the writer up. The count is a single byte, so reading it can't tear, and a
+ *  reader would have to be held up through 128 writes to be fooled by it wrapping.
+ *
+ *  A reader in task code simply tries until it gets a good copy, as the writer, if
+ *  it's an interrupt, soon finishes. A reader in an interrupt service routine must
+ *  not wait, as the writer it interrupted can't finish until it returns; it makes
+ *  one try and keeps its previous copy if that fails. The A/D scan sequencer uses
+ *  the same idea with two buffers, as its writer is an interrupt.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _STL_SNAPSHOT_H_                    // To prevent *.h file from being included
+#define _STL_SNAPSHOT_H_                    // in a source file more than once
+
+#include <stdint.h>
+
+/** This keeps the compiler from moving reads or writes of memory from one side of it
+ *  to the other, or from keeping them in registers across it; the AVR runs its
+ *  instructions in order, so that's all the ordering which is needed */
+#define STL_BARRIER()       __asm__ __volatile__ ("" : : : "memory")
+
+
+//-------------------------------------------------------------------------------------
+/** This class holds a structure of data which one writer publishes, guarded by a
+ *  sequence count. The writer changes the data between begin_write() and end_write();
+ *  readers either copy all of it with read() or try_read(), or copy parts of it from
+ *  peek() between begin_read() and end_read().
+ */
+
+template <class T>
+class stl_snapshot
+{
+    protected:
+        volatile uint8_t sequence;          // Odd while the data are being changed
+        T data;                             // The data which are published
+
+    public:
+        /** The constructor creates a snapshot whose data haven't been written. */
+        stl_snapshot (void) { sequence = 0; }
+
+        /** This method marks the data as being changed and returns them to be
+         *  changed. It must be followed by end_write().
+         *  @return A reference to the data */
+        T& begin_write (void)
+        {
+            sequence++;
+            STL_BARRIER ();
+            return (data);
+        }
+
+        /** This method publishes the changes made since begin_write(). */
+        void end_write (void)
+        {
+            STL_BARRIER ();
+            sequence++;
+        }
+
+        /** This method starts reading part of the data from peek().
+         *  @return The sequence count, which is given to end_read() */
+        uint8_t begin_read (void) const
+        {
+            uint8_t start = sequence;
+            STL_BARRIER ();
+            return (start);
+        }
+
+        /** This method checks whether what was read since begin_read() is whole.
+         *  @param start The count which begin_read() returned
+         *  @return True if the copy is good, false if it must be made again */
+        bool end_read (uint8_t start) const
+        {
+            STL_BARRIER ();
+            return (!(start & 1) && sequence == start);
+        }
+
+        /** This method returns the data, which may only be read between begin_read()
+         *  and end_read(), except by the writer. */
+        const T& peek (void) const { return (data); }
+
+        /** This method copies the data, trying until the copy is whole. It mustn't be
+         *  called from an interrupt which may have interrupted the writer.
+         *  @param copy A structure into which the data are copied */
+        void read (T& copy) const
+        {
+            uint8_t start;
+            do
+            {
+                start = begin_read ();
+                copy = data;
+            }
+            while (!end_read (start));
+        }
+
+        /** This method tries once to copy the data, for readers in interrupts.
+         *  @param copy A structure into which the data are copied; if the copy isn't
+         *      whole it's left as it was
+         *  @return True if the data were copied, false if the writer was busy */
+        bool try_read (T& copy) const
+        {
+            uint8_t start = begin_read ();
+            if (start & 1)
+                return (false);
+            T attempt = data;
+            if (!end_read (start))
+                return (false);
+            copy = attempt;
+            return (true);
+        }
+};
+
+#endif // _STL_SNAPSHOT_H_
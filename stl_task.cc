@@ -34,6 +34,7 @@
  *    \li  04-21-07  JRR  Original of this file, derived from UCB's TranRun4 and
  *                        simplified greatly for efficient use in AVR processors
  *    \li  05-07-07  JRR  Small bug fixes
+ *    \li  10-18-26  DSC  Added time_to_run() so the main loop can find idle time
  *
  *  License
  *      This file released under the Lesser GNU Public License. This program is for 
@@ -44,6 +45,7 @@
 #include <stdlib.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "stl_debug.h"                      // Definitions for debugging serial port
 #include "stl_us_timer.h"                   // Timer measures real time
 #include "stl_task.h"                       // The state transition logic header
@@ -188,6 +190,32 @@ bool stl_task::schedule (time_stamp& the_time)
     }
 
 
+//--------------------------------------------------------------------------------------
+/** This method finds how long it will be until the task next needs to run. It's 
+ *  useful for deciding whether the processor can do something which would hold up
+ *  the tasks, such as going to sleep for a while. 
+ *  @param the_time The current time
+ *  @return The time until the task is due in timer counts; zero if it's due now, or 
+ *      a very long time if it's suspended
+ */
+
+long stl_task::time_to_run (time_stamp& the_time)
+    {
+    long until;                             // Time until the next run
+
+    if (op_state == TASK_SUSPENDED)
+        return (0x7FFFFFFFL);
+    if (op_state != TASK_WAITING)
+        return (0L);
+
+    time_stamp difference = next_run_time;
+    difference -= the_time;
+    difference.get_time (until);
+
+    return (until > 0L ? until : 0L);
+    }
+
+
 //--------------------------------------------------------------------------------------
 /** This is a base method which the user should overload in each descendent of this 
  *  task class. The run method is where all the user-defined action in the task takes
@@ -303,7 +331,7 @@ void stl_task::error_stop (char const* message)
 
 void stl_task::print_profile_method (avr_uart* a_port)
     {
-    a_port->puts ("Execution profiling not yet enabled\r\n");
+    a_port->puts_P (PSTR ("Execution profiling not yet enabled\r\n"));
     }
 
 #endif  // STL_PROFILING
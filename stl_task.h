@@ -9,6 +9,7 @@
  *    \li  05-01-07  JRR  Original of this file, derived from UCB's TranRun4 and
  *                        simplified greatly for efficient use in AVR processors
  *    \li  05-07-07  JRR  Small bug fixes
+ *    \li  10-18-26  DSC  Added time_to_run() so the main loop can find idle time
  *
  *  License
  *    This file released under the Lesser GNU Public License. This program is for 
@@ -87,6 +88,7 @@ class stl_task
         void set_next_run_time (const time_stamp&);
 
         bool schedule (time_stamp&);        // Scheduler calls this to try to run task
+        long time_to_run (time_stamp&);     // Find how long until the task is due
         virtual char run (char);            // Base method which the user overloads
         void suspend (void);                // Set operational state to suspended
         void resume (void);                 // Un-suspend a task so it can run again
@@ -0,0 +1,116 @@
+//======================================================================================
+/** \file  task_logger.cc
+ *  This file contains the task which keeps the flight log on the SD card. See 
+ *  task_logger.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "avr_serial.h"
+#include "stl_debug.h"
+#include "stl_us_timer.h"
+#include "stl_task.h"
+#include "task_logger.h"
+
+// State name definitions
+#define TL_START            0               // Get the card's attention
+#define TL_WAKE             1               // Wait for the card to start up
+#define TL_OPEN             2               // Find the end of the log
+#define TL_LOG              3               // Write scans to the card
+#define TL_FAILED           4               // No card; the task suspends itself
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a logging task. The card isn't touched until the task
+ *  runs.
+ *  @param t_stamp A timestamp which contains the time between runs of this task
+ *  @param a_card A pointer to the SD card on which the log is kept
+ */
+
+task_logger::task_logger (time_stamp* t_stamp, avr_sd* a_card)
+    : stl_task (*t_stamp), writer (a_card)
+{
+    p_card = a_card;
+    tries = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This is the function which runs when it is called by the task scheduler. Except
+ *  while the log is being opened, which reads through the flights already on the card
+ *  once at startup, no state waits for the card.
+ *  @param state The state of the task when this run method begins running
+ *  @return The state to which the task will transition, or STL_NO_TRANSITION if no
+ *      transition is called for at this time
+ */
+
+char task_logger::run (char state)
+{
+    switch (state)
+    {
+        // In State 0, we reset the card into SPI mode
+        case (TL_START):
+            if (p_card->begin () != SD_WAITING)
+                return (TL_FAILED);
+            tries = 0;
+            return (TL_WAKE);
+
+        // In State 1, we ask the card once each run whether it has started up
+        case (TL_WAKE):
+            switch (p_card->wake ())
+            {
+                case (SD_READY):
+                    return (TL_OPEN);
+                case (SD_WAITING):
+                    if (++tries < TL_WAKE_TRIES)
+                        break;
+                    return (TL_FAILED);
+                default:
+                    return (TL_FAILED);
+            }
+            break;
+
+        // In State 2, the log is opened after the last flight on the card
+        case (TL_OPEN):
+            if (!writer.open ())
+                return (TL_FAILED);
+            STL_DEBUG_PUTS ("Logging flight ");
+            STL_DEBUG_WRITE (writer.flight_number ());
+            STL_DEBUG_PUTS ("\r\n");
+            return (TL_LOG);
+
+        // In State 3, each run sends the card a little more of the log
+        case (TL_LOG):
+            writer.service ();
+            if (writer.has_failed ())
+                return (TL_FAILED);
+            break;
+
+        // In State 4, there's no card to log on, so the task takes itself out of the
+        // schedule
+        case (TL_FAILED):
+            STL_DEBUG_PUTS ("No flight log\r\n");
+            suspend ();
+            break;
+
+        // If the state isn't a known state, call Houston; we have a problem
+        default:
+            STL_DEBUG_PUTS ("WARNING: Logger task in state ");
+            STL_DEBUG_WRITE (state);
+            STL_DEBUG_PUTS ("\r\n");
+            return (TL_START);
+    };
+
+    // If we get here, no transition is called for
+    return (STL_NO_TRANSITION);
+}
@@ -0,0 +1,65 @@
+//======================================================================================
+/** \file  task_logger.h
+ *  This file contains the task which keeps the flight log on the SD card. Everything
+ *  the sensors measure goes to the ground by radio, and whatever the radio misses
+ *  during a dropout would otherwise be gone for good; the log keeps every scan. The
+ *  task gets the card ready, opens the log at the end of the flights already on it,
+ *  and from then on hands the card a piece of a block each time it runs. The sensor
+ *  task gives it each scan with put(), which never waits for the card (see
+ *  log_writer.h).
+ *
+ *  If there's no card, or it stops working, the task gives up and the aircraft flies
+ *  on without a log.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _TASK_LOGGER_H_                         // To prevent *.h file from being included
+#define _TASK_LOGGER_H_                         // in a source file more than once
+
+#include "log_device.h"                         // Block storage the log is kept on
+#include "avr_sd.h"                             // SD card on the SPI port
+#include "log_writer.h"                         // Writes the log a piece at a time
+
+/** The number of times the card is asked whether it's ready before the task gives
+ *  up on it; with the task run every millisecond this is about a second and a half,
+ *  more than the one second cards are allowed */
+#define TL_WAKE_TRIES       1500
+
+
+//-------------------------------------------------------------------------------------
+/** This task writes the flight log on the SD card. It should be run about once a
+ *  millisecond, so the card is kept busy while it's logging.
+ */
+
+class task_logger : public stl_task
+{
+    protected:
+        avr_sd* p_card;                         // The card the log goes on
+        log_writer writer;                      // Writes the log on the card
+        uint16_t tries;                         // Times the card has been asked
+
+    public:
+        // The constructor creates the task and saves a pointer to the card
+        task_logger (time_stamp*, avr_sd*);
+
+        // This method runs the logging state machine
+        char run (char);
+
+        /** This method adds a scan to the log. It returns false if the scan couldn't
+         *  be logged because the log isn't open or the card has fallen behind. */
+        bool put (uint8_t sequence, uint32_t time, uint32_t channel_map, 
+                  const uint16_t* samples)
+            { return (writer.put (sequence, time, channel_map, samples)); }
+
+        /** This method returns the log writer, so its counts can be looked at. */
+        log_writer* get_writer (void) { return (&writer); }
+};
+
+#endif // _TASK_LOGGER_H_
@@ -0,0 +1,262 @@
+//======================================================================================
+/** \file  task_radio_setup.cc
+ *  This file contains a task which configures the 9XTend radio modem through its AT
+ *  command mode without holding up the processor. See task_radio_setup.h for the 
+ *  reasons this is done in a task. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file, replacing the delay loops in avr_9xtend
+ *    \li  10-18-26 DSC Put the radio in API mode
+ *    \li  10-18-26 DSC Set the RF packet size to the telemetry packet size
+ *    \li  10-18-26 DSC CTS lowered early enough to leave room for a whole packet
+ *    \li  10-18-26 DSC Setup errors reported through debugging, not over the air
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <string.h>
+#include <avr/io.h>
+
+#include "avr_serial.h"
+#include "avr_9xtend.h"
+#include "stl_debug.h"
+#include "stl_us_timer.h"
+#include "stl_task.h"
+#include "task_radio_setup.h"
+
+// State name definitions
+#define RS_START            0               // Wait for the serial line to go quiet
+#define RS_GUARD            1               // Keep quiet for the guard time
+#define RS_WAIT_ESCAPE      2               // Wait for "OK" after sending "+++"
+#define RS_SEND_COMMAND     3               // Send the next command
+#define RS_WAIT_REPLY       4               // Wait for "OK" after the command
+#define RS_GIVE_UP          5               // Wait for the radio to leave command mode
+#define RS_DONE             6               // Finished; the task suspends itself
+
+/** The commands sent to the radio, in order. SM1 selects pin sleep, in which the 
+ *  radio's sleep pin controls whether it's awake; AP1 selects API mode, in which data
+ *  is sent in packets whose delivery the radio reports (see xt_api.h); PK100 sets the
+ *  RF packet size to 0x100 = 256 bytes, which must match XT_API_MAX_PAYLOAD; FT600 
+ *  makes the radio de-assert CTS once 0x600 = 1536 bytes of its 2 KB serial input 
+ *  buffer are full, rather than 17 bytes short of full, so a whole API frame always
+ *  fits after CTS was seen asserted; WR saves the settings in the radio's nonvolatile
+ *  memory, and CN leaves command mode. */
+static char const* const setup_commands[] = 
+{
+    "ATSM1\r",
+    "ATAP1\r",
+    "ATPK100\r",
+    "ATFT600\r",
+    "ATWR\r",
+    "ATCN\r"
+};
+
+/** The number of commands in the list above */
+const unsigned char num_commands = sizeof (setup_commands) / sizeof (setup_commands[0]);
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a radio setup task. The radio object has already blocked
+ *  other senders by the time this runs; the task releases it when setup is finished. 
+ *  @param t_stamp A timestamp which contains the time between runs of this task; 
+ *      about 10 ms is plenty, as the deadlines are all in the hundreds of ms
+ *  @param a_radio A pointer to the radio modem which is to be set up
+ *  @param a_timer A pointer to the task timer, used to check the deadlines
+ */
+
+task_radio_setup::task_radio_setup (time_stamp* t_stamp, avr_9xtend* a_radio, 
+    task_timer* a_timer)
+    : stl_task (*t_stamp)
+{
+    p_radio = a_radio;
+    p_timer = a_timer;
+    command = 0;
+    tries = 0;
+    matched = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the deadline for the current step to a given time from now. 
+ *  @param microsec The number of microseconds from now at which the step times out
+ */
+
+void task_radio_setup::set_deadline (long microsec)
+{
+    deadline = p_timer->get_time_now ();
+    deadline += time_stamp (0, microsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether the deadline for the current step has passed. 
+ *  @return True if the deadline has passed, false if there's still time
+ */
+
+bool task_radio_setup::past_deadline (void)
+{
+    return (p_timer->get_time_now () >= deadline);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts sending a string to the radio. The string is sent by the serial
+ *  port's interrupt driven sender, so this method doesn't wait for it to go out. 
+ *  @param text The string to be sent, which must not be changed while it's sent
+ *  @return True if sending was started, false if the port was still busy
+ */
+
+bool task_radio_setup::send_text (char const* text)
+{
+    out_segment.data = text;
+    out_segment.length = strlen (text);
+    return (p_radio->send_gather (&out_segment, 1));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads whatever characters the radio has sent, without waiting for 
+ *  more, and looks for the "OK" and carriage return with which the radio answers a
+ *  good command. Any other characters are ignored. 
+ *  @return True if a complete "OK\r" has been received, false if not (yet)
+ */
+
+bool task_radio_setup::got_ok (void)
+{
+    static char const ok_text[] = "OK\r";
+
+    while (p_radio->check_for_char ())
+    {
+        char ch = p_radio->getchar ();
+
+        if (ch == ok_text[matched])
+        {
+            if (ok_text[++matched] == '\0')
+            {
+                matched = 0;
+                return (true);
+            }
+        }
+        else
+        {
+            matched = (ch == ok_text[0]) ? 1 : 0;
+        }
+    }
+    return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This is the function which runs when it is called by the task scheduler. Each 
+ *  state checks for a reply or a deadline and returns right away if neither has 
+ *  happened yet, so the task never holds up the scheduler for more than a few 
+ *  microseconds. 
+ *  @param state The state of the task when this run method begins running
+ *  @return The state to which the task will transition, or STL_NO_TRANSITION if no
+ *      transition is called for at this time
+ */
+
+char task_radio_setup::run (char state)
+{
+    switch (state)
+    {
+        // In State 0, we wait until anything being sent has gone out, then start 
+        // timing the quiet period which must come before the escape sequence
+        case (RS_START):
+            if (p_radio->tx_busy ())
+                break;
+            set_deadline (RS_GUARD_TIME);
+            return (RS_GUARD);
+
+        // In State 1, once the line has been quiet long enough, send "+++"
+        case (RS_GUARD):
+            if (!past_deadline ())
+                break;
+            while (p_radio->check_for_char ())  // Throw away anything received
+                p_radio->getchar ();
+            matched = 0;
+            if (!send_text ("+++"))
+                return (RS_START);
+            set_deadline (RS_ESCAPE_TIMEOUT);
+            return (RS_WAIT_ESCAPE);
+
+        // In State 2, we wait for the radio to say "OK" after the second guard time
+        case (RS_WAIT_ESCAPE):
+            if (got_ok ())
+            {
+                command = 0;
+                tries = 0;
+                return (RS_SEND_COMMAND);
+            }
+            if (past_deadline ())
+            {
+                if (++tries < RS_RETRIES)
+                    return (RS_START);
+                set_deadline (RS_CMD_MODE_TIMEOUT);
+                return (RS_GIVE_UP);
+            }
+            break;
+
+        // In State 3, we send the next command as soon as the port is free
+        case (RS_SEND_COMMAND):
+            if (!send_text (setup_commands[command]))
+                break;
+            set_deadline (RS_REPLY_TIMEOUT);
+            return (RS_WAIT_REPLY);
+
+        // In State 4, we wait for the radio to answer the command
+        case (RS_WAIT_REPLY):
+            if (got_ok ())
+            {
+                tries = 0;
+                if (++command < num_commands)
+                    return (RS_SEND_COMMAND);
+
+                // The last command took the radio out of command mode
+                p_radio->command_mode = false;
+                STL_DEBUG_PUTS ("Radio modem setup OK\r\n");
+                return (RS_DONE);
+            }
+            if (past_deadline ())
+            {
+                if (++tries < RS_RETRIES)
+                    return (RS_SEND_COMMAND);
+                set_deadline (RS_CMD_MODE_TIMEOUT);
+                return (RS_GIVE_UP);
+            }
+            break;
+
+        // In State 5, setup has failed. The radio may still be in command mode, so
+        // we wait until it must have timed out of it before letting anyone send 
+        case (RS_GIVE_UP):
+            if (!past_deadline ())
+                break;
+            p_radio->setup_error = true;
+            p_radio->command_mode = false;
+
+            // Complain on the debugging port; anything written to the radio now would
+            // go out over the air
+            STL_DEBUG_PUTS ("Error setting up radio modem\r\n");
+            return (RS_DONE);
+
+        // In State 6, there's nothing left to do, so the task takes itself out of
+        // the schedule
+        case (RS_DONE):
+            suspend ();
+            break;
+
+        // If the state isn't a known state, call Houston; we have a problem
+        default:
+            STL_DEBUG_PUTS ("WARNING: Radio setup task in state ");
+            STL_DEBUG_WRITE (state);
+            STL_DEBUG_PUTS ("\r\n");
+            return (RS_START);
+    };
+
+    // If we get here, no transition is called for
+    return (STL_NO_TRANSITION);
+}
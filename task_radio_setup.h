@@ -0,0 +1,67 @@
+//======================================================================================
+/** \file  task_radio_setup.h
+ *  This file contains a task which configures the 9XTend radio modem through its AT
+ *  command mode without holding up the processor. The radio needs a second or so of
+ *  silence on its serial line before and after the "+++" escape sequence, and it
+ *  takes a while to answer each command; the old setup code in the avr_9xtend
+ *  constructor waited through all of that in delay loops, so nothing else could run
+ *  for several seconds after power-up. This task waits for those deadlines with the
+ *  task timer instead, so the other tasks (sensor sampling in particular) start 
+ *  running right away. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TASK_RADIO_SETUP_H_                    // To prevent *.h file from being included
+#define _TASK_RADIO_SETUP_H_                    // in a source file more than once
+
+// Times for the radio's command mode, in microseconds
+#define RS_GUARD_TIME       1100000L            // Silence around "+++" (radio's GT is 1 s)
+#define RS_ESCAPE_TIMEOUT   2000000L            // Wait for "OK" after "+++"
+#define RS_REPLY_TIMEOUT    500000L             // Wait for "OK" after a command
+#define RS_CMD_MODE_TIMEOUT 11000000L           // Radio drops command mode by itself (CT)
+
+/** The number of times the escape sequence or a command is tried before giving up */
+#define RS_RETRIES          3
+
+
+//-------------------------------------------------------------------------------------
+/** This task puts the 9XTend radio into command mode, sends it a list of setup 
+ *  commands, checks that each one is answered with "OK", and then releases the radio 
+ *  so that other tasks can send data through it. Each step has a deadline; when an
+ *  answer doesn't arrive in time, the step is tried again a few times. If the radio
+ *  still won't cooperate, the task gives up, waits until the radio must have left
+ *  command mode on its own, and releases the radio with its setup error flag set. 
+ */
+
+class task_radio_setup : public stl_task
+{
+    protected:
+        avr_9xtend* p_radio;                    // The radio which is being set up
+        task_timer* p_timer;                    // Timer used to check deadlines
+        time_stamp deadline;                    // When the current step times out
+        unsigned char command;                  // Index of the command being sent
+        unsigned char tries;                    // Tries made at the current step
+        unsigned char matched;                  // Characters of "OK\r" received
+        uart_segment out_segment;               // Describes the text being sent
+
+        void set_deadline (long);               // Set a deadline from now
+        bool past_deadline (void);              // Check if the deadline has passed
+        bool send_text (char const*);           // Start sending a string to the radio
+        bool got_ok (void);                     // Check for an "OK" from the radio
+
+    public:
+        // The constructor creates the task and saves pointers to the radio and timer
+        task_radio_setup (time_stamp*, avr_9xtend*, task_timer*);
+
+        // This method runs the setup state machine
+        char run (char);
+};
+
+#endif // _TASK_RADIO_SETUP_H_
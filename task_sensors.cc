@@ -18,49 +18,195 @@
  *    \li  04-19-08 DSC Minor adjustments to task state diagram (Allowing six DOF to block)
  *    \li  04-23-08 DSC	Added printing functions (for now testing through the serial port
  *			future version will send data through the XTend radio module)
+ *    \li  10-18-26 DSC	Printing functions replaced by binary telemetry frames; fixed
+ *			overlapping slot numbers for the second 6 DOF and later devices
+ *    \li  10-18-26 DSC	Channels sent can be chosen from the ground
+ *    \li  10-18-26 DSC	Channels thinned out when the radio link is congested
+ *    \li  10-18-26 DSC	Sensors read by the interrupt driven A/D scan sequencer
+ *    \li  10-18-26 DSC	Scans started by a hardware timer instead of by this task
+ *    \li  10-18-26 DSC	Pitot and static pressures oversampled; 12-bit frames sent
+ *    \li  10-18-26 DSC	Load cells and pressures converted in noise reduction sleep
+ *    \li  10-18-26 DSC	Readings converted to engineering units for use onboard
+ *    \li  10-18-26 DSC	Fixed point filters attached to the sensor channels
+ *    \li  10-18-26 DSC	Channels described by a table; slow ones read less often
+ *    \li  10-18-26 DSC	Every scan kept in a compact history before it's thinned
+ *    \li  10-18-26 DSC	Telemetry frames compressed as Rice coded differences
+ *    \li  10-18-26 DSC	Every scan written to the flight log on the SD card
+ *    \li  10-18-26 DSC	Chassis and canopy attitudes estimated at the 6 DOF rate
+ *    \li  10-18-26 DSC	Air data worked out onboard and sent as derived slots
+ *    \li  10-18-26 DSC	Thinned out slots send the mean and spread of what's skipped
+ *    \li  10-18-26 DSC	Readings published through a sequence lock, so none are torn
+ *    \li  10-18-26 DSC	6 DOF axes interpolated to one instant; the skew is measured
+ *    \li  10-18-26 DSC	History of recent scans dropped; it held too little to be of use
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
  *    for educational use only, but its use is not restricted thereto. 
  */
 //======================================================================================
 
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "avr_serial.h"
+#include "avr_9xtend.h"
+#include "avr_adc_scan.h"
+#include "stl_debug.h"
+#include "stl_us_timer.h"
+#include "stl_task.h"
+#include "tlm_frame.h"
+#include "cal_channel.h"
+#include "flt_filter.h"
+#include "tlm_aggregate.h"
+#include "att_estimator.h"
+#include "air_data.h"
+#include "stl_snapshot.h"
+#include "task_telemetry.h"
+#include "task_logger.h"
+#include "task_sensors.h"
+
 // State name definitions
-#define  INIT		=  0
-#define	 WAIT		=  1
-#define  ACT_A		=  2
-#define  ACT_B	        =  3
-#define  SIX_DOF_A	=  4
-#define  SIX_DOF_B	=  5
-#define  PITOTTUBE	=  6
-#define  STATICM	=  7
-#define  LOAD_A		=  8
-#define  LOAD_B		=  9
-
-// Channel definitions for the linear actuators
-const unsigned char linAct_1    =  ;
-const unsigned char linAct_2    =  ;
-
-// Channel definitions for various measurement devices
-const unsigned char loadCell_1  =  ;
-const unsigned char loadCell_2  =  ;
-const unsigned char pitot_1	=  ;
-const unsigned char static_1    =  ;
-
-// Channels for 6 DOF on chassis
-const unsigned char sixDOF_1    =  ;                             
-
-// Channels for 6 DOF on parachute
-const unsigned char sixDOF_2    =  ;               
+#define  TS_INIT	0		// Give the scan list to the A/D sequencer
+#define  TS_SCAN	1		// Collect each scan as the timer finishes it
 
 // Array Slot Labels
 const int actuatorA 		= 0;		// Linear actuator #1
 const int actuatorB		= 1;		// Linear actuator #2
 const int sixDOFA		= 2;		// Start of the first six DOF slots
-const int sixDOFB		= 7;		// Start of the second six DOF slots
-const int pitotA		= 13;		// Pitot tube
-const int staticA		= 14;		// Static measurement device
-const int loadCellA		= 15;		// Load cell #1
-const int loadCellB		= 16;		// Load cell #2
+const int sixDOFB		= 8;		// Start of the second six DOF slots
+const int pitotA		= 14;		// Pitot tube
+const int staticA		= 15;		// Static measurement device
+const int loadCellA		= 16;		// Load cell #1
+const int loadCellB		= 17;		// Load cell #2
+const int airspeedD		= 18;		// Indicated airspeed, derived
+const int altitudeD		= 19;		// Pressure altitude, derived
+const int climbD		= 20;		// Rate of climb, derived
+
+/** Airspeed in cm/s for each 16 counts of dynamic pressure from the 12-bit pitot 
+ *  reading, from v = sqrt (2 q / rho) at sea level density; one count is 1.22 Pa */
+#define  PITOT_TABLE_BITS	4
+static const int16_t pitot_table[] PROGMEM =
+{
+       0,  565,  799,  978, 1129, 1263, 1383, 1494, 1597, 1694,
+    1786, 1873, 1956, 2036, 2113, 2187, 2259, 2328, 2396, 2461,
+    2525, 2588, 2649, 2708, 2766, 2823, 2879, 2934, 2988, 3041,
+    3093, 3144, 3194, 3244, 3293, 3341, 3388, 3435, 3481, 3527,
+    3571, 3616, 3660, 3703, 3746, 3788, 3830, 3871, 3912, 3953,
+    3993, 4033, 4072, 4111, 4150, 4188, 4226, 4263, 4301, 4337,
+    4374, 4410, 4446, 4482, 4518, 4553, 4588, 4622, 4657, 4691,
+    4725, 4758, 4792, 4825, 4858, 4890, 4923, 4955, 4987, 5019,
+    5051, 5082, 5114, 5145, 5175, 5206, 5237, 5267, 5297, 5327,
+    5357, 5387, 5416, 5446, 5475, 5504, 5533, 5562, 5590, 5619,
+    5647, 5675, 5703, 5731, 5759, 5786, 5814, 5841, 5868, 5896,
+    5923, 5949, 5976, 6003, 6029, 6056, 6082, 6108, 6134, 6160,
+    6186, 6212, 6237, 6263, 6288, 6313, 6339, 6364, 6389
+};
+
+/** The 6 DOF channels get a second order Butterworth low pass filter with its corner 
+ *  at 40 Hz, a fifth of their 200 Hz sample rate, to take out high frequency noise */
+typedef flt_biquad<3384, 6769, 3384, -6054, 3208> ts_imu_filter;
+
+/** The load cells get a three sample median to throw out spikes, then a Butterworth
+ *  low pass at 10 Hz, a fifth of their 50 Hz rate; the loads the control loop needs 
+ *  are much slower than that */
+typedef flt_cascade< flt_median<3>, flt_biquad<3384, 6769, 3384, -6054, 3208> > 
+    ts_load_filter;
+
+/** The actuator positions are averaged over four readings */
+typedef flt_average<2> ts_actuator_filter;
+
+static ts_imu_filter imu_filters[12];
+static ts_load_filter load_filters[2];
+static ts_actuator_filter actuator_filters[2];
+
+/** The sensor channels, in the order they're scanned. Each entry gives the A/D channel,
+ *  the slot, the rate divider and phase, the oversampling, whether the channel is
+ *  converted asleep, its filter and its calibration. Scans start at 200 Hz; the 
+ *  actuators and 6 DOF's are read in every scan, the load cells at 50 Hz and the
+ *  pressures at 20 Hz. The load cells take the odd scans and the pressures even ones 
+ *  apart, pitot at phase 0 and static at 6, so that no two slow channels share a scan.
+ *
+ *  The actuators, pitot tube, static port and load cells are wired straight to A/D 
+ *  inputs 0 - 5; the chassis 6 DOF comes through an external multiplexer into input 6
+ *  and the parachute 6 DOF through a second one into input 7, with both multiplexers 
+ *  on the same address lines. These must be kept in step with the wiring harness. 
+ *
+ *  The calibrations are nominal ones from the sensor data sheets, to be replaced by 
+ *  bench calibrations. A/D full scale is AVCC, 5 V. The units are:
+ *	Actuators:	0.1 mm of stroke; 100 mm potentiometers
+ *	6 DOF:		Accelerations in mg on channels 0 - 2 (300 mV/g, 1.5 V at 0 g),
+ *			rates in 0.1 deg/s on channels 3 - 5 (2 mV/deg/s, 1.5 V at rest)
+ *	Pitot tube:	The linear stage gives counts of dynamic pressure above the 
+ *			2.5 V zero of the 1 kPa/V sensor; the table turns those into
+ *			airspeed in cm/s
+ *	Static port:	10 Pa units, from a 12-bit reading of an MPX4115A
+ *	Load cells:	0.1 N, with 2.5 V at no load and 4 mV/N from the amplifier */
+#define  TS_ACCEL_CAL	{ 307, 4167, 8 }
+#define  TS_GYRO_CAL	{ 307, 6250, 8 }
+#define  PITOT_TABLE_POINTS  (sizeof (pitot_table) / sizeof (pitot_table[0]))
+
+static const ts_channel ts_channels[] PROGMEM =
+{
+    // Linear actuators
+    { AS_CHANNEL (0, 0), actuatorA, 1, 0, 0, false, &actuator_filters[0],
+      { 0, 1001, 10 }, NULL, 0, 0 },
+    { AS_CHANNEL (0, 1), actuatorB, 1, 0, 0, false, &actuator_filters[1],
+      { 0, 1001, 10 }, NULL, 0, 0 },
+
+    // Chassis 6 DOF
+    { AS_CHANNEL (0, 6), sixDOFA + 0, 1, 0, 0, false, &imu_filters[0], TS_ACCEL_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (1, 6), sixDOFA + 1, 1, 0, 0, false, &imu_filters[1], TS_ACCEL_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (2, 6), sixDOFA + 2, 1, 0, 0, false, &imu_filters[2], TS_ACCEL_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (3, 6), sixDOFA + 3, 1, 0, 0, false, &imu_filters[3], TS_GYRO_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (4, 6), sixDOFA + 4, 1, 0, 0, false, &imu_filters[4], TS_GYRO_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (5, 6), sixDOFA + 5, 1, 0, 0, false, &imu_filters[5], TS_GYRO_CAL, 
+      NULL, 0, 0 },
+
+    // Parachute 6 DOF
+    { AS_CHANNEL (0, 7), sixDOFB + 0, 1, 0, 0, false, &imu_filters[6], TS_ACCEL_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (1, 7), sixDOFB + 1, 1, 0, 0, false, &imu_filters[7], TS_ACCEL_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (2, 7), sixDOFB + 2, 1, 0, 0, false, &imu_filters[8], TS_ACCEL_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (3, 7), sixDOFB + 3, 1, 0, 0, false, &imu_filters[9], TS_GYRO_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (4, 7), sixDOFB + 4, 1, 0, 0, false, &imu_filters[10], TS_GYRO_CAL, 
+      NULL, 0, 0 },
+    { AS_CHANNEL (5, 7), sixDOFB + 5, 1, 0, 0, false, &imu_filters[11], TS_GYRO_CAL, 
+      NULL, 0, 0 },
+
+    // Pitot tube and static port, oversampled to 12 bits; smooth enough without filters
+    { AS_CHANNEL (0, 2), pitotA, TS_PRESSURE_DIVIDER, 0, 
+      TS_PRESSURE_OVERSAMPLE, true, NULL,
+      { 2048, 1, 0 }, pitot_table, PITOT_TABLE_POINTS, PITOT_TABLE_BITS },
+    { AS_CHANNEL (0, 3), staticA, TS_PRESSURE_DIVIDER, 6, 
+      TS_PRESSURE_OVERSAMPLE, true, NULL,
+      { -389, 11111, 12 }, NULL, 0, 0 },
+
+    // Load cells
+    { AS_CHANNEL (0, 4), loadCellA, 4, 1, 0, true, &load_filters[0], 
+      { 512, 3125, 8 }, NULL, 0, 0 },
+    { AS_CHANNEL (0, 5), loadCellB, 4, 3, 0, true, &load_filters[1], 
+      { 512, 3125, 8 }, NULL, 0, 0 }
+};
+
+/** The number of channels in the table */
+#define  TS_NUM_CHANNELS  (sizeof (ts_channels) / sizeof (ts_channels[0]))
+
+/** The scan period in timer counts */
+#define  TS_PERIOD_COUNTS  ((uint16_t)(TS_SCAN_PERIOD / USEC_PER_COUNT))
+
+/** A time in timer counts times this, shifted right by 8 bits, is the fraction of a
+ *  scan period it takes up, with 15 fraction bits */
+#define  TS_ALIGN_SCALE	((uint16_t)((32768L << 8) / TS_PERIOD_COUNTS))
 
 //-------------------------------------------------------------------------------------
 /** This constructor creates a sensor control task. The sensor control operates the various
@@ -75,27 +221,90 @@ const int loadCellB		= 16;		// Load cell #2
  *
  *  @param t_stamp   	     A timestamp which contains the time between runs of this task
  *  @param p_ser     	     A pointer to a serial port for sending messages if required
+ *  @param a_scan	     A pointer to the A/D scan sequencer which reads the sensors
+ *  @param a_telemetry	     A pointer to the task which sends telemetry to the ground
+ *  @param a_logger	     A pointer to the task which keeps the flight log, or NULL
+ *			     if there's no log
  */
 
-task_sensors::task_sensors (time_stamp* t_stamp, avr_uart* p_ser, avr_adc p_avr_adc)
-    : stl_task (*t_stamp, p_ser)
+task_sensors::task_sensors (time_stamp* t_stamp, avr_uart* p_ser, avr_adc_scan* a_scan,
+			    task_telemetry* a_telemetry, task_logger* a_logger)
+    : stl_task (*t_stamp, p_ser), chassis_att (TS_SCAN_PERIOD), 
+      canopy_att (TS_SCAN_PERIOD), 
+      air (1000000L / (TS_SCAN_PERIOD * TS_PRESSURE_DIVIDER))
 {
-    // Save pointers to serial and A/D
+    // Save pointers to serial, A/D, telemetry and the log
     p_serial = p_ser;
-    p_adc = p_avr_adc;
+    p_scan = a_scan;
+    p_telemetry = a_telemetry;
+    p_logger = a_logger;
 
     // Initialize private variables
-    int dataArray[18] = 0;
-    long timeArray[18] = 0;
+    for (int i = 0; i < TS_NUM_SLOTS; i++)
+    {
+	dataArray[i] = 0;
+	values[i] = 0;
+	offsets[i] = 0;
+	filters[i] = NULL;
+    }
+    fresh_map = 0;
+    primed_map = 0;
+    scan_time = 0;
+    last_sequence = 0;
+    have_sequence = false;
+    scans_missed = 0;
+    channel_map = 0;
+    att_cycles = 0;
+    att_cycles_max = 0;
+    att_overruns = 0;
+    aligning = true;
+    imu_primed = false;
+    imu_time = 0;
+    skew = 0;
+    skew_max = 0;
+    skew_aligned = 0;
+    skew_aligned_max = 0;
+
+    ts_snapshot& latest = snapshot.begin_write ();
+    memset (&latest, 0, sizeof (latest));
+    snapshot.end_write ();
+
+    // Give each slot in the channel table its calibration and filter, and send it
+    num_channels = TS_NUM_CHANNELS;
+    for (uint8_t index = 0; index < num_channels; index++)
+    {
+	ts_channel entry;
+	memcpy_P (&entry, &ts_channels[index], sizeof (entry));
+
+	slots[index] = entry.slot;
+	calibration[entry.slot].set_linear (entry.cal.offset, entry.cal.gain, 
+					    entry.cal.shift);
+	if (entry.table != NULL)
+	    calibration[entry.slot].set_table (entry.table, entry.table_points, 
+					       entry.table_bits);
+	filters[entry.slot] = entry.filter;
+	channel_map |= 1UL << entry.slot;
+    }
+    channel_map |= (1UL << airspeedD) | (1UL << altitudeD) | (1UL << climbD);
+
+    // The actuator positions close the control loop on the ground, so keep them at
+    // full rate until the link is badly congested
+    p_telemetry->get_rate ()->set_priority (actuatorA, 2);
+    p_telemetry->get_rate ()->set_priority (actuatorB, 2);
+
+    // When they're thinned out, the load cells and accelerometers send the lowest and
+    // highest readings they skipped, so shocks such as the canopy opening aren't lost
+    aggregate.set_channels ((1UL << loadCellA) | (1UL << loadCellB) 
+			    | (7UL << sixDOFA) | (7UL << sixDOFB));
 
     // Say hello
-    p_serial->puts ("Sensor control task constructor\r\n");
+    p_serial->puts_P (PSTR ("Sensor control task constructor\r\n"));
 }
 
 //-------------------------------------------------------------------------------------
-/** This is the function which runs when it is called by the task scheduler. It runs through
- *  each sensor collecting data and storing it in arrays before sending it through the radio
- *  to the ground station.
+/** This is the function which runs when it is called by the task scheduler. The A/D 
+ *  scan sequencer reads every sensor in the background; this function collects each
+ *  complete scan and sends it through the radio to the ground station.
  *  @param state The state of the task when this run method begins running
  *  @return The state to which the task will transition, or STL_NO_TRANSITION if no
  *      transition is called for at this time
@@ -103,184 +312,436 @@ task_sensors::task_sensors (time_stamp* t_stamp, avr_uart* p_ser, avr_adc p_avr_
 
 char task_sensors::run (char state)
 {
+    uint8_t sequence;				// Sequence number of the latest scan
+    uint16_t readings[TS_NUM_SLOTS];		// Readings in scan list order
+    uint32_t fresh;				// Channels read in the latest scan
+    uint16_t instants[TS_NUM_SLOTS];		// When each channel was sampled
+    uint32_t coarse;				// Slots which have only 10 bits
+
     switch (state)
     {
-        // In State 0, we do nothing for now 
-        case (INIT):
-	    // Check A/D connections?
-	    return (WAIT);
-	    break;
-
-	// In State 1, we wait for the right count before polling the sensors for data
-	case (WAIT):
-	    // If the right time has been reached, start moving through the devices for data
-	    if (timeUP)
-	        return (ACT_A);
-	    break;
-
-	// In State 2, we get data for the first linear actuator and wait for it to be done
-	// before transitioning to the next device
-	case (ACT_A):
-	    p_adc->startConversion(linAct_1);
-
-	    if (p_adc->convertDone())
+	// In State 0, the channel table is given to the A/D sequencer and a hardware 
+	// timer is set to start every scan, so the sample rate doesn't depend on when 
+	// this task gets to run. The pressures are oversampled, so frames carry 12 bits.
+	// Frames are compressed; the encoder and aggregator are told which slots have
+	// only 10 bits so their differences and means are kept in 10-bit units
+	case (TS_INIT):
+	    if (!setup_scanner () || !p_scan->start_timed (TS_SCAN_PERIOD))
+		break;
+	    coarse = 0;
+	    for (uint8_t index = 0; index < num_channels; index++)
 	    {
-		dataArray[actuatorA] = p_adc->getValue();
-		timeArray[actuatorA] = currentTIME;
-		return (ACT_B);
+		if (p_scan->bits (index) == 10)
+		    coarse |= 1UL << slots[index];
 	    }
-
-	    break;
-
-	// In State 3, we get data for the second linear actuator and wait for it to be done
-	// before transitioning to the next device
-	case (ACT_B):
-	    p_adc -> startConversion(linAct_2);
-
-	    if (p_adc -> convertDone())
+	    encoder.set_bits (10 + TS_PRESSURE_OVERSAMPLE);
+	    encoder.set_compress (true, coarse);
+	    aggregate.set_coarse (coarse);
+	    return (TS_SCAN);
+
+	// In State 1, each new scan is copied and sent to the ground. The timer and
+	// the A/D interrupt do all the sampling, so this state never waits for one. 
+	// Only the channels read in this scan are copied into their slots. If the 
+	// sequence number skipped, the scans in between were overwritten before they
+	// could be sent, and each one is counted.
+	// The 6 DOF axes are lined up in time, the attitudes and air data are brought
+	// up to date, and everything is published to other tasks before the scan goes
+	case (TS_SCAN):
+	    if (p_scan->get_frame (readings, sequence, scan_time, fresh, instants)
+		&& (!have_sequence || sequence != last_sequence))
 	    {
-		dataArray[actuatorB] = p_adc -> getValue();
-		timeArray[actuatorB] = currentTIME;
-		return (SIX_DOF_A);
+		if (have_sequence)
+		    scans_missed += (uint8_t)(sequence - last_sequence) - 1;
+		last_sequence = sequence;
+		have_sequence = true;
+		fresh_map = 0;
+		for (uint8_t index = 0; index < num_channels; index++, fresh >>= 1)
+		{
+		    if (fresh & 1)
+		    {
+			dataArray[slots[index]] = readings[index];
+			offsets[slots[index]] = instants[index];
+			fresh_map |= 1UL << slots[index];
+		    }
+		}
+		filter_readings ();
+		align_axes ();
+		update_attitude ();
+		update_air_data ();
+		publish ();
+		send_telemetry ();
 	    }
-
 	    break;
 
-        // In State 4, we check all the A/D channels for data on the first 6 DOF
-        case (DOF_A):
-	    for (int i = 0; i < 6; i++)
-	    {
-	        dataArray[sixDOFA + i] = p_adc->read_once(sixDOF_1 + i);
-		timeArray[sixDOFA + i] = currentTIME; 	 
-	    }
+        // If the state isn't a known state, call Houston; we have a problem
+        default:
+            STL_DEBUG_PUTS ("WARNING: Sensor task in state ");
+            STL_DEBUG_WRITE (state);
+            STL_DEBUG_PUTS ("\r\n");
+            return (TS_INIT);
+    };
 
-	    return (DOF_B);
-            break;
+    // If we get here, no transition is called for
+    return (STL_NO_TRANSITION);
+}
 
-        // In State 5, we check all the A/D channels for data on the second 6 DOF
-        case (DOF_B):
-	    for (int i = 0; i < 6; i++)
-	    {
-		dataArray[sixDOFB + i] = p_adc->read_once(sixDOF_1 + i);
-	   	timeArray[sixDOFB + i] = currentTIME;
-	    }
-	
-	    return (PITOTTUBE);
-            break;
-	
-	case (PITOTTUBE):
-	    p_adc->startConversion(pitot_1);
-
-	    if (p_adc->convertDone())
-	    {
-		dataArray[pitotA] = p_adc->getValue();
-		timeArray[pitotA] = currentTIME; 
-	   	return (STATICM);
-	    }
+//-------------------------------------------------------------------------------------
+/** This function gives the scan list in the channel table to the A/D sequencer, along
+ *  with each channel's oversampling, rate divider and whether it's converted asleep.
+ *  @return True if the sequencer took all of it, false if something was refused
+ */
 
-	    break;
+bool task_sensors::setup_scanner (void)
+{
+    uint8_t codes[TS_NUM_SLOTS];
 
-	case (STATICM):
-	    p_adc->startConversion(static_1)
-	   
-	    if (p_adc->convertDone())
-	    {
-		dataArray[staticA + i] = p_adc->getValue();
-		timeArray[staticA + i] = currentTIME;
-		return (LOAD_A);
-	    }
+    for (uint8_t index = 0; index < num_channels; index++)
+	codes[index] = pgm_read_byte (&ts_channels[index].channel);
+    if (!p_scan->set_channels (codes, num_channels))
+	return (false);
 
-	    break;
+    for (uint8_t index = 0; index < num_channels; index++)
+    {
+	ts_channel entry;
+	memcpy_P (&entry, &ts_channels[index], sizeof (entry));
 
-	case (LOAD_A):
-	    p_adc->startConversion(loadCell_1);
+	if (!p_scan->set_oversample (index, entry.oversample)
+	    || !p_scan->set_divider (index, entry.divider, entry.phase)
+	    || !p_scan->set_quiet (index, entry.quiet))
+	    return (false);
+    }
+    return (true);
+}
 
-	    if (p_adc->convertDone())
-	    {
-		dataArray[loadCellA + i] = p_adc->getValue();
-		timeArray[loadCellA + i] = currentTIME;
-	        return (LOAD_B);
-	    }
+//-------------------------------------------------------------------------------------
+/** This function runs each new reading through its slot's filter, if it has one, 
+ *  then converts it to engineering units. Slots which weren't read in this scan are
+ *  left alone, so each filter runs at its own channel's rate. The filtered readings 
+ *  replace the raw ones, so the ground sees the same data as the control loop. A 
+ *  filter is reset to its first reading so that it doesn't start from zero. 
+ */
 
-	    break;
+void task_sensors::filter_readings (void)
+{
+    for (uint8_t slot = 0; slot < TS_NUM_SLOTS; slot++)
+    {
+	uint32_t bit = 1UL << slot;
+	if (!(fresh_map & bit))
+	    continue;
+	if (filters[slot] != NULL)
+	{
+	    if (!(primed_map & bit))
+		filters[slot]->reset ((int16_t)dataArray[slot]);
+	    dataArray[slot] = (uint16_t)filters[slot]->step ((int16_t)dataArray[slot]);
+	}
+	primed_map |= bit;
+	values[slot] = calibration[slot].convert (dataArray[slot]);
+    }
+}
 
+//-------------------------------------------------------------------------------------
+/** This function measures how many processor cycles a slot's filter takes for each 
+ *  sample (see flt_cycles()), so the filters can be budgeted. Measuring disturbs the
+ *  filter, so it's done on the latest reading and the filter is reset to it after. 
+ *  Interrupts are held off while it runs, which delays the scan it lands in, so it's
+ *  meant for checking the budget on the ground rather than in flight.
+ *  @param slot The slot whose filter is measured
+ *  @return The number of processor cycles for each sample, or 0 if the slot has no
+ *      filter
+ */
 
-	case (LOAD_B):
-	    p_adc->startConversion(loadCell_2);
+uint16_t task_sensors::filter_cycles (uint8_t slot)
+{
+    if (slot >= TS_NUM_SLOTS || filters[slot] == NULL)
+	return (0);
 
-	    if (p_adc->convertDone())
-	    {
-		dataArray[loadCellB + i] = p_adc->getValue();
-		timeArray[loadCellB + i] = currentTIME;
-	        return (WAIT);
-	    }
+    return (flt_cycles (filters[slot], (int16_t)dataArray[slot]));
+}
 
-	    break;
+//-------------------------------------------------------------------------------------
+/** This function lines the twelve 6 DOF axes up in time. The scanner converts them one
+ *  after another, so by the last axis over a millisecond has gone by, and during 
+ *  fast canopy motion the rates and accelerations an attitude is worked out from 
+ *  would belong to different attitudes. Each axis is interpolated back to the 
+ *  instant the first axis was sampled, along the straight line from its reading in
+ *  the previous scan; the filters are linear and the same on every axis, so this can
+ *  be done on the filtered readings. Taking the line's slope over exactly one scan 
+ *  period saves a division for each axis. 
+ *
+ *  The spread of the axes' instants is measured as sampled. The spread once lined up
+ *  is modelled, not measured: it's worked out from the same fraction as the 
+ *  interpolation and the actual time between each axis's samples, so it only shows
+ *  what the scan period's jitter leaves behind. The interpolation is skipped after a
+ *  scan was missed, and the telemetry and log keep the readings as they were sampled.
+ */
 
-        // If the state isn't a known state, call Houston; we have a problem
-        default:
-            STL_DEBUG_PUTS ("WARNING: Avoid task in state ");
-            STL_DEBUG_WRITE (state);
-            STL_DEBUG_PUTS ("\r\n");
-            return (ALL_ON);
-    };
+void task_sensors::align_axes (void)
+{
+    const uint32_t imu_bits = 0xFFFUL << sixDOFA;
 
-    // If we get here, no transition is called for
-    return (STL_NO_TRANSITION);
+    if ((fresh_map & imu_bits) != imu_bits)
+    {
+	imu_primed = false;
+	return;
+    }
+
+    uint16_t first = 0xFFFF;
+    uint16_t last = 0;
+    for (uint8_t axis = 0; axis < TS_IMU_AXES; axis++)
+    {
+	uint16_t instant = offsets[sixDOFA + axis];
+	if (instant < first)
+	    first = instant;
+	if (instant > last)
+	    last = instant;
+    }
+    skew = last - first;
+    if (skew > skew_max)
+	skew_max = skew;
+
+    uint16_t period = (uint16_t)(scan_time - imu_time);
+    bool interpolate = aligning && imu_primed 
+		       && period < TS_PERIOD_COUNTS + TS_PERIOD_COUNTS / 4;
+    uint16_t low = 0xFFFF;
+    uint16_t high = 0;
+    for (uint8_t axis = 0; axis < TS_IMU_AXES; axis++)
+    {
+	uint8_t slot = sixDOFA + axis;
+	int16_t value = values[slot];
+	uint16_t instant = offsets[slot];
+
+	if (interpolate)
+	{
+	    // How far back the first axis is, as a fraction of a scan period 
+	    uint16_t lag = instant - first;
+	    uint16_t fraction = (uint16_t)(((uint32_t)lag * TS_ALIGN_SCALE) >> 8);
+	    int32_t change = (int32_t)value - imu_previous[axis];
+	    values[slot] = value - (int16_t)((change * fraction) >> 15);
+
+	    // The same fraction of the actual time since this axis was last sampled
+	    uint16_t since = period + instant - imu_offsets[axis];
+	    imu_offsets[axis] = instant;
+	    instant -= (uint16_t)(((uint32_t)fraction * since) >> 15);
+	    offsets[slot] = first;
+	}
+	else
+	    imu_offsets[axis] = instant;
+	imu_previous[axis] = value;
+
+	if (instant < low)
+	    low = instant;
+	if (instant > high)
+	    high = instant;
+    }
+    skew_aligned = high - low;
+    if (skew_aligned > skew_aligned_max)
+	skew_aligned_max = skew_aligned;
+
+    imu_time = scan_time;
+    imu_primed = true;
 }
 
-void task_sensors::printLinActA ()
+//-------------------------------------------------------------------------------------
+/** This function returns the spread of the instants at which the 6 DOF axes were 
+ *  sampled, or the residual spread align_axes() models once they're lined up. 
+ *  @param aligned True for the modelled spread once lined up, false for the spread 
+ *      as sampled
+ *  @param worst True for the widest spread so far, false for the latest scan's
+ *  @return The spread in microseconds
+ */
+
+uint16_t task_sensors::get_skew_us (bool aligned, bool worst)
 {
-    p_serial << timeArray[linActA] << " " << dataArray[linActA] << "\r\n" <<endl;
-    return;
+    uint16_t counts;
+
+    if (aligned)
+	counts = worst ? skew_aligned_max : skew_aligned;
+    else
+	counts = worst ? skew_max : skew;
+
+    return (counts * USEC_PER_COUNT);
 }
 
-void task_sensors::printLinActB ()
+//-------------------------------------------------------------------------------------
+/** This function brings the chassis and parachute attitudes up to date with the new
+ *  6 DOF readings, which are filtered and in engineering units by now. The 6 DOF's 
+ *  are read in every scan, so the estimators run at the scan rate they were made
+ *  for. The time the update takes is measured on the task timer, interrupts and all,
+ *  and kept with the worst so far; updates over TS_ATT_BUDGET cycles are counted.
+ */
+
+void task_sensors::update_attitude (void)
 {
-    p_serial << timeArray[linActA] << " " << dataArray[linActB] << "\r\n" <<endl;
-    return;
+    const uint32_t chassis_bits = 0x3FUL << sixDOFA;
+    const uint32_t canopy_bits = 0x3FUL << sixDOFB;
+
+    uint16_t start = TCNT1;
+    if ((fresh_map & chassis_bits) == chassis_bits)
+	chassis_att.update (&values[sixDOFA], &values[sixDOFA + 3]);
+    if ((fresh_map & canopy_bits) == canopy_bits)
+	canopy_att.update (&values[sixDOFB], &values[sixDOFB + 3]);
+    uint16_t counts = TCNT1 - start;
+
+    att_cycles = (uint16_t)((uint32_t)counts * USEC_PER_COUNT * (F_CPU / 1000000L));
+    if (att_cycles > att_cycles_max)
+	att_cycles_max = att_cycles;
+    if (att_cycles > TS_ATT_BUDGET)
+	att_overruns++;
 }
 
-void task_sensors::printSixDOFA ()
+//-------------------------------------------------------------------------------------
+/** This function brings the air data up to date with the pitot and static readings
+ *  which are new in this scan, once they're in engineering units, and marks the 
+ *  derived slots which have changed as new so they're sent along with the scan. The 
+ *  pitot and static ports are read in different scans, each at 20 Hz.
+ */
+
+void task_sensors::update_air_data (void)
 {
-    for (int i = 0; i < 6; i++)
+    if (fresh_map & (1UL << pitotA))
     {
-   	 p_serial << timeArray[sixDOFA + i] " " << dataArray[sixDOFA + i] << "\r\n" <<endl;
+	air.put_pitot (values[pitotA]);
+	fresh_map |= 1UL << airspeedD;
     }
-    return;
-}
-
-void task_sensors::printSixDOFB ()
-{
-    for (int i = 0; i < 6; i++)
+    if (fresh_map & (1UL << staticA))
     {
-	p_serial << timeArray[sixDOFB + i] << " " << dataArray[sixDOFB + i] << "\r\n" <<endl;
+	air.put_static (values[staticA]);
+	fresh_map |= (1UL << altitudeD) | (1UL << climbD);
     }
-    return; 
 }
 
-void task_sensors::printPitot ()
-{	
-    p_serial << timeArray[pitotA + i] << " " << dataArray[pitotA + i] << "\r\n" <<endl;
-    return; 
-}
+//-------------------------------------------------------------------------------------
+/** This function offsets a derived value and limits it to the 12 bits of a sample.
+ *  @param value The value in the units of its derived slot
+ *  @param zero The sample which stands for a value of zero
+ *  @return The sample, 0 to 4095
+ */
 
-void task_sensors::printStatic ()
+static uint16_t derived_sample (int16_t value, int16_t zero)
 {
-    p_serial << timeArray[staticA + i] << " " << dataArray[staticA + i] << "\r\n" <<endl;
-    return; 
+    int32_t sample = (int32_t)value + zero;
+
+    if (sample < 0)
+	return (0);
+    if (sample > 4095)
+	return (4095);
+    return ((uint16_t)sample);
 }
 
-void task_sensors::printLoadA ()
+//-------------------------------------------------------------------------------------
+/** This function publishes the readings which are new in this scan, in engineering
+ *  units and each stamped with the instant it stands for, along with the air data, 
+ *  which are stamped with the start of the scan. Other tasks and interrupts read 
+ *  them through the sequence lock, so they never see a reading from one scan with 
+ *  the time stamp of another, or half of a reading which was being changed, and 
+ *  interrupts are never turned off for the copy.
+ *  Slots which weren't read in this scan keep their earlier readings and times.
+ */
+
+void task_sensors::publish (void)
 {
-    p_serial << timeArray[loadCellA + i] << " " << dataArray[loadCellA + i] << "\r\n" <<endl;
-    return; 
+    ts_snapshot& latest = snapshot.begin_write ();
+
+    latest.sequence = last_sequence;
+    latest.time = scan_time;
+    latest.fresh_map = fresh_map;
+    for (uint8_t index = 0; index < num_channels; index++)
+    {
+	if (fresh_map & (1UL << slots[index]))
+	{
+	    latest.values[slots[index]] = values[slots[index]];
+	    latest.times[slots[index]] = scan_time + offsets[slots[index]];
+	}
+    }
+    latest.values[airspeedD] = air.get_airspeed ();
+    latest.values[altitudeD] = air.get_altitude ();
+    latest.values[climbD] = air.get_climb ();
+    for (uint8_t slot = airspeedD; slot <= climbD; slot++)
+    {
+	if (fresh_map & (1UL << slot))
+	    latest.times[slot] = scan_time;
+    }
+
+    snapshot.end_write ();
 }
 
-void task_sensors::printLoadB ()
+//-------------------------------------------------------------------------------------
+/** This function returns the latest published reading from one slot, with the time 
+ *  at which it was read, without copying the whole snapshot. See the calibration 
+ *  table above for the units of each A/D slot and ts_snapshot for the derived ones.
+ *  Like get_snapshot(), it waits for the sensor task to finish publishing, so it 
+ *  mustn't be called from an interrupt.
+ *  @param slot The slot whose reading is wanted
+ *  @param p_time A place to put the instant the reading stands for, in timer counts:
+ *      when it was sampled or, for 6 DOF axes which were lined up, the instant they
+ *      were lined up to; or NULL if it isn't needed
+ *  @return The reading in engineering units
+ */
+
+int16_t task_sensors::get_value (uint8_t slot, uint32_t* p_time)
 {
-    p_serial << timeArray[loadCellB + i] << " " << dataArray[loadCellB + i] << "\r\n" <<endl;
-    return;
+    int16_t value;
+    uint32_t time;
+    uint8_t start;
+
+    do
+    {
+	start = snapshot.begin_read ();
+	value = snapshot.peek ().values[slot];
+	time = snapshot.peek ().times[slot];
+    }
+    while (!snapshot.end_read (start));
+
+    if (p_time != NULL)
+	*p_time = time;
+    return (value);
 }
 
+//-------------------------------------------------------------------------------------
+/** This function puts the new reading from every chosen slot which was read in this
+ *  scan into one binary telemetry frame (see tlm_frame.h) and queues it with the 
+ *  telemetry task, which sends it in the radio's next burst. The frame is stamped with
+ *  the time at which the scan started. Readings are shifted up to 12 bits so that 
+ *  every slot has the same full scale, whether or not it's oversampled. Every new 
+ *  reading is also written to the flight log, so nothing is lost when the radio 
+ *  drops out. The air data go in the derived
+ *  slots after the A/D ones, in the units given in task_sensors.h. If the link is
+ *  congested, the telemetry task may leave some channels out of this scan, or all of
+ *  them, in which case nothing is sent; each sample which is sent is then the mean 
+ *  of the readings since its slot was last sent, and the chosen slots send the 
+ *  lowest and highest of them too (see tlm_aggregate.h). 
+ *  @return True if the frame was queued, false if the queue was full, in which case
+ *      this scan is not sent
+ */
 
+bool task_sensors::send_telemetry (void)
+{
+    uint16_t scaled[TLM_MAX_CHANNELS];
+    for (uint8_t index = 0; index < num_channels; index++)
+	scaled[slots[index]] = dataArray[slots[index]] << (12 - p_scan->bits (index));
+    scaled[airspeedD] = derived_sample (air.get_airspeed () / 10, 0);
+    scaled[altitudeD] = derived_sample (air.get_altitude () / 10, 500);
+    scaled[climbD] = derived_sample (air.get_climb (), 2048);
+    if (p_logger != NULL)
+	p_logger->put (last_sequence, scan_time, fresh_map, scaled);
+
+    // When the link is congested, some channels are left out of some scans; every
+    // reading goes into its slot's window, which is summed up when the slot is sent
+    aggregate.add (channel_map & fresh_map, scaled);
+    uint32_t map = p_telemetry->downlink_map (channel_map & fresh_map);
+    if (map == 0)
+	return (true);
+
+    uint16_t extremes[2 * TLM_SPREAD_MAX];
+    uint32_t spread_map = aggregate.take (map, scaled, extremes);
+    size_t length = encoder.encode (tlm_buffer, scan_time, map, scaled, spread_map,
+				    extremes);
+
+    if (!p_telemetry->send (tlm_buffer, length))
+    {
+	// The ground can't count on the time chain if this frame never goes out
+	encoder.resync ();
+	return (false);
+    }
+    return (true);
+}
@@ -15,6 +15,23 @@
  *    \li  04-15-08 DSC Original (Relatively useless file... in progress/planning stages)
  *    \li  04-17-08 DSC Basic layout format written
  *    \li  04-18-08 DSC General variables defined for channels and task state diagram developed
+ *    \li  10-18-26 DSC ASCII print functions replaced by binary telemetry frames
+ *    \li  10-18-26 DSC Channels sent can be chosen from the ground
+ *    \li  10-18-26 DSC Sensors read by the interrupt driven A/D scan sequencer
+ *    \li  10-18-26 DSC Scans started by a hardware timer at TS_SCAN_PERIOD
+ *    \li  10-18-26 DSC Pitot and static pressures oversampled for 12 bits
+ *    \li  10-18-26 DSC Load cells and pressures converted in noise reduction sleep
+ *    \li  10-18-26 DSC Readings converted to engineering units for use onboard
+ *    \li  10-18-26 DSC Fixed point filters attached to the sensor channels
+ *    \li  10-18-26 DSC Channels described by a table; each has its own sample rate
+ *    \li  10-18-26 DSC Recent scans kept in a compact history buffer
+ *    \li  10-18-26 DSC Every scan written to the flight log on the SD card
+ *    \li  10-18-26 DSC Chassis and canopy attitudes estimated from the 6 DOF's
+ *    \li  10-18-26 DSC Airspeed, altitude and climb sent as derived slots
+ *    \li  10-18-26 DSC Thinned out slots send the mean and spread of what's skipped
+ *    \li  10-18-26 DSC Readings published to other tasks through a sequence lock
+ *    \li  10-18-26 DSC 6 DOF axes lined up to one instant to take out the scan's skew
+ *    \li  10-18-26 DSC History buffer dropped; the flight log keeps every scan instead
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -24,39 +41,242 @@
 #ifndef _TASK_SENSOR_H_                         // To prevent *.h file from being included
 #define _TASK_SENSOR_H_                         // in a source file more than once
 
+#include "tlm_frame.h"                          // Binary telemetry frame encoder
+#include "cal_channel.h"                        // Converts readings to real units
+#include "flt_filter.h"                         // Fixed point filters for channels
+#include "tlm_aggregate.h"                      // Summaries of readings not sent
+#include "att_estimator.h"                      // Attitude from a 6 DOF unit
+#include "air_data.h"                           // Airspeed, altitude and climb
+#include "stl_snapshot.h"                       // Sequence lock for published data
+
+/** The number of slots in the data arrays, one for each A/D channel which is read */
+#define TS_NUM_SLOTS    18
+
+/** The number of derived slots, which follow the A/D slots in the telemetry and hold
+ *  results worked out onboard rather than readings. Each is a 12-bit number: 
+ *	Slot 18:	Indicated airspeed in 0.1 m/s
+ *	Slot 19:	Pressure altitude in m, plus 500
+ *	Slot 20:	Rate of climb in cm/s, plus 2048 */
+#define TS_NUM_DERIVED  3
+
+/** The time between the starts of A/D scans in microseconds, which sets the fastest
+ *  sample rate, 200 Hz; slower channels are read on one scan out of several. The scan
+ *  timer keeps this exact; the task only has to run often enough to collect each scan
+ *  before the next one is finished */
+#define TS_SCAN_PERIOD  5000L
+
+/** The oversampling exponent for the pitot and static pressures; 4^2 = 16 samples 
+ *  make each 12-bit result, which is needed at low airspeed */
+#define TS_PRESSURE_OVERSAMPLE  2
+
+/** The pitot and static pressures are read on one scan out of this many, 20 Hz */
+#define TS_PRESSURE_DIVIDER     10
+
+/** The number of 6 DOF axes, three accelerations and three rates on each unit, whose
+ *  slots run on from sixDOFA */
+#define TS_IMU_AXES     12
+
+/** The processor cycles the two attitude estimators may take between them for each
+ *  scan, a fifth of the 40000 in a scan period at 8 MHz; updates which take longer
+ *  are counted, so a busy scheduler can be spotted */
+#define TS_ATT_BUDGET   8000
+
+//-------------------------------------------------------------------------------------
+/** This structure describes one sensor channel: where it's wired, which slot its 
+ *  readings go in, how often it's read and how its readings are cleaned up and 
+ *  converted. The task reads a table of these from program memory, so adding a sensor
+ *  only takes another entry in the table in task_sensors.cc. */
+
+typedef struct
+{
+    uint8_t channel;                        // A/D channel, made with AS_CHANNEL()
+    uint8_t slot;                           // Slot in the data arrays and telemetry
+    uint8_t divider;                        // Read on one scan out of this many
+    uint8_t phase;                          // Which scan of the divider's cycle
+    uint8_t oversample;                     // Oversampling exponent, 0 for none
+    bool quiet;                             // Converted with the processor asleep
+    flt_base* filter;                       // Filter for the readings, or NULL
+    cal_linear cal;                         // Nominal linear calibration
+    const int16_t* table;                   // Lookup table in program memory, or NULL
+    uint8_t table_points;                   // Number of points in the table
+    uint8_t table_bits;                     // Log base 2 of the table's point spacing
+} ts_channel;
+
 //-------------------------------------------------------------------------------------
-/** This task class should collect all the data from the devices on the Para-Ceres. Some of the
- *  functions may block the processor, and further testing is required to figure out how critical
- *  the timing requirements may be.
+/** This structure holds a consistent copy of the latest readings for other tasks and
+ *  interrupts, published by the sensor task through a sequence lock. Each slot has
+ *  the instant its reading stands for, so a slow channel's reading always comes with
+ *  its own time stamp rather than that of a later scan. The derived
+ *  slots hold the air data in their engineering units: airspeed in cm/s, altitude in
+ *  0.1 m and climb in cm/s. */
+
+typedef struct
+{
+    uint8_t sequence;                       // Sequence number of the latest scan
+    uint32_t time;                          // Time at which the latest scan started
+    uint32_t fresh_map;                     // Bitmap of slots new in the latest scan
+    int16_t values[TS_NUM_SLOTS + TS_NUM_DERIVED];  // Readings in engineering units
+    uint32_t times[TS_NUM_SLOTS + TS_NUM_DERIVED];  // When each reading was taken
+} ts_snapshot;
+
+//-------------------------------------------------------------------------------------
+/** This task class collects all the data from the devices on the Para-Ceres. The A/D scan
+ *  sequencer does the conversions in its interrupt, so nothing in this task blocks.
  */
 
-class task_sensors
+class task_sensors : public stl_task
 {
     protected:
         // The sensors task class needs a pointer to the serial port used to say hello 
 	// For testing purposes only... anything sent to the serial port will result in blocking
         avr_uart* p_serial;                 // Pointer to a serial port for messages
-	avr_adc* p_adc;			    // Pointer to the A/D converter object
+	avr_adc_scan* p_scan;		    // Pointer to the A/D scan sequencer
+	task_telemetry* p_telemetry;	    // Task which sends telemetry to the ground
+	task_logger* p_logger;		    // Task which keeps the flight log, or NULL
 
     private:
-	int dataArray;			// Have to check these two for type... may need 
-	long timeArray;			// a different variable type for these
+	uint8_t slots[TS_NUM_SLOTS];		// Slot for each channel in the scan list
+	uint8_t num_channels;			// Number of channels in the scan list
+	uint16_t dataArray[TS_NUM_SLOTS];	// Latest A/D reading for each slot
+	uint32_t fresh_map;			// Bitmap of slots new in the latest scan
+	uint32_t scan_time;			// Time at which the latest scan started
+	uint16_t offsets[TS_NUM_SLOTS];		// When each reading was sampled
+	uint8_t last_sequence;			// Sequence number of the latest scan
+	bool have_sequence;			// A scan has been taken, so there is one
+	uint16_t scans_missed;			// Scans overwritten before being sent
+	cal_channel calibration[TS_NUM_SLOTS];	// Turns readings into real units
+	int16_t values[TS_NUM_SLOTS];		// Latest readings in real units
+	flt_base* filters[TS_NUM_SLOTS];	// Filter for each slot, or NULL
+	uint32_t primed_map;			// Slots whose filters have been reset
+
+	// This function gives the channel table to the A/D scan sequencer
+	bool setup_scanner (void);
+
+	tlm_encoder encoder;			// Builds the binary telemetry frames
+	uint8_t tlm_buffer[TLM_FRAME_MAX];	// Holds a frame while it's being built
+	uint32_t channel_map;			// Bitmap of the slots which are sent
+	tlm_aggregate aggregate;		// Readings since each slot was sent
+
+	att_estimator chassis_att;		// Attitude of the chassis 6 DOF
+	att_estimator canopy_att;		// Attitude of the parachute 6 DOF
+	uint16_t att_cycles;			// Cycles the latest update took
+	uint16_t att_cycles_max;		// Most cycles any update has taken
+	uint16_t att_overruns;			// Updates which went over the budget
+
+	air_data air;				// Airspeed, altitude and climb
+
+	bool aligning;				// Line the 6 DOF axes up to one instant
+	bool imu_primed;			// The previous scan's axes are kept
+	int16_t imu_previous[TS_IMU_AXES];	// Each axis's reading in that scan
+	uint16_t imu_offsets[TS_IMU_AXES];	// And the instant it was sampled
+	uint32_t imu_time;			// Time at which that scan started
+	uint16_t skew;				// Spread of the axes as sampled
+	uint16_t skew_max;			// Widest spread as sampled
+	uint16_t skew_aligned;			// Modelled spread once lined up
+	uint16_t skew_aligned_max;		// Widest modelled spread
+	stl_snapshot<ts_snapshot> snapshot;	// Latest readings for other tasks
 
     public:
 	// This constructor creates a sensor controller to operate the various sensors
-        task_sensors (void);
+        task_sensors (time_stamp*, avr_uart*, avr_adc_scan*, task_telemetry*, 
+		      task_logger* = NULL);
 	// This function runs the sensor task
 	char run (char);
 
-	// These functions call the print to serial
-	void printLinActA ();
-	void printLinActB ();
-	void printSixDOFA ();
-	void printSixDOFB ();
-	void printPitot ();
-	void printStatic ();
-	void printLoadA ();
-	void printLoadB ();
+	// This function filters the new readings and converts them to real units
+	void filter_readings (void);
+
+	// This function lines up the 6 DOF axes to the instant of the first one
+	void align_axes (void);
+
+	// This function brings the attitudes up to date with the new 6 DOF readings
+	void update_attitude (void);
+
+	// This function brings the air data up to date with new pressure readings
+	void update_air_data (void);
+
+	// This function publishes the latest readings to other tasks and interrupts
+	void publish (void);
+
+	// This function queues the latest readings to be sent to the ground
+	bool send_telemetry (void);
+
+	/** This function chooses which slots are sent to the ground, one bit per slot. */
+	void set_channels (uint32_t a_map) 
+	    { channel_map = a_map & ((1UL << (TS_NUM_SLOTS + TS_NUM_DERIVED)) - 1); }
+
+	/** This function returns the bitmap of the slots which are sent to the ground. */
+	uint32_t get_channels (void) { return (channel_map); }
+
+	/** This function returns the number of scans which were never sent because the
+	 *  task didn't collect them in time. */
+	uint16_t get_scans_missed (void) { return (scans_missed); }
+
+	// This function returns the latest reading from a slot and when it was taken
+	int16_t get_value (uint8_t, uint32_t* = NULL);
+
+	/** This function copies the latest readings, all from the same scan. It waits
+	 *  for the sensor task to finish publishing, so it's for tasks, not interrupts. */
+	void get_snapshot (ts_snapshot& copy) { snapshot.read (copy); }
+
+	/** This function copies the latest readings if the sensor task isn't publishing
+	 *  them just then; it's for interrupts, which mustn't wait. It returns true if
+	 *  the copy was made and false if the previous one should be kept. */
+	bool try_snapshot (ts_snapshot& copy) { return (snapshot.try_read (copy)); }
+
+	/** This function returns a slot's calibration so it can be changed. */
+	cal_channel* get_calibration (uint8_t slot) { return (&calibration[slot]); }
+
+	/** This function attaches a filter to a slot, or takes it off if given NULL.
+	 *  The filter is reset to the next reading before it's used. */
+	void set_filter (uint8_t slot, flt_base* a_filter) 
+	    { filters[slot] = a_filter; primed_map &= ~(1UL << slot); }
+
+	// This function measures the processor time a slot's filter takes
+	uint16_t filter_cycles (uint8_t);
+
+	/** This function returns the attitude estimator of the chassis. */
+	const att_estimator* get_chassis_att (void) { return (&chassis_att); }
+
+	/** This function returns the attitude estimator of the parachute. */
+	const att_estimator* get_canopy_att (void) { return (&canopy_att); }
+
+	/** This function finds the attitude of the parachute relative to the chassis, as
+	 *  Euler angles, and returns the total angle between them, both in 0.1 degree. */
+	uint16_t get_relative_att (att_angles& angles)
+	    { return (canopy_att.relative_to (chassis_att, angles)); }
+
+	/** This function returns the processor cycles the latest attitude update took. */
+	uint16_t get_att_cycles (void) { return (att_cycles); }
+
+	/** This function returns the most processor cycles any attitude update took. */
+	uint16_t get_att_cycles_max (void) { return (att_cycles_max); }
+
+	/** This function returns the number of attitude updates which took more than
+	 *  TS_ATT_BUDGET cycles. */
+	uint16_t get_att_overruns (void) { return (att_overruns); }
+
+	/** This function turns on or off the lining up of the 6 DOF axes. */
+	void set_alignment (bool on) { aligning = on; imu_primed = false; }
+
+	/** This function returns true if the 6 DOF axes are being lined up. */
+	bool get_alignment (void) { return (aligning); }
+
+	// This function returns the 6 DOF skew before or after lining up
+	uint16_t get_skew_us (bool, bool);
+
+	/** This function returns the air data computer, which has the latest airspeed,
+	 *  pressure altitude and rate of climb. */
+	const air_data* get_air_data (void) { return (&air); }
+
+	/** This function returns a pointer to the aggregator which summarizes the 
+	 *  readings the downlink skips, so the slots which send a spread can be 
+	 *  chosen. */
+	tlm_aggregate* get_aggregate (void) { return (&aggregate); }
+
+	/** This function returns a pointer to the A/D scan sequencer, which measures the
+	 *  timing of the scans. */
+	avr_adc_scan* get_scanner (void) { return (p_scan); }
 };
 
 #endif // _TASK_SENSORS_H_
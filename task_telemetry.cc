@@ -0,0 +1,482 @@
+//======================================================================================
+/** \file  task_telemetry.cc
+ *  This file contains the task which sends telemetry frames to the ground through the
+ *  9XTend radio in bursts, keeping the radio in pin sleep between bursts. See 
+ *  task_telemetry.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Send through API frames; retransmit critical frames
+ *    \li  10-18-26 DSC Back off without blocking while the radio holds CTS high
+ *    \li  10-18-26 DSC Downlink rate adapted to congestion on the radio link
+ *    \li  10-18-26 DSC Nothing sent if the radio couldn't be put in API mode
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "avr_serial.h"
+#include "avr_9xtend.h"
+#include "stl_debug.h"
+#include "stl_us_timer.h"
+#include "stl_task.h"
+#include "tlm_frame.h"
+#include "tlm_queue.h"
+#include "xt_api.h"
+#include "xt_window.h"
+#include "tlm_rate.h"
+#include "task_telemetry.h"
+
+// State name definitions
+#define TT_SETUP            0               // Wait for the radio to be configured
+#define TT_ASLEEP           1               // Radio asleep while frames pile up
+#define TT_WAKING           2               // Wait for the radio to wake up
+#define TT_SENDING          3               // Send everything in the queue
+#define TT_HOLD             4               // Let the radio finish before sleeping
+#define TT_BACKOFF          5               // Wait for the radio to lower CTS
+#define TT_FAILED           6               // Radio setup failed; nothing is sent
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a telemetry task. 
+ *  @param t_stamp A timestamp which contains the time between runs of this task; it
+ *      should be short compared to the time a burst takes to send
+ *  @param a_radio A pointer to the radio modem which sends the frames
+ *  @param a_timer A pointer to the task timer
+ *  @param a_burst The number of queued bytes at which a burst is sent
+ *  @param a_latency The greatest time in microseconds a frame is left in the queue 
+ *      before a burst is sent, even if fewer than a_burst bytes have piled up
+ */
+
+task_telemetry::task_telemetry (time_stamp* t_stamp, avr_9xtend* a_radio, 
+    task_timer* a_timer, uint16_t a_burst, long a_latency)
+    : stl_task (*t_stamp), link (a_radio)
+{
+    p_radio = a_radio;
+    p_timer = a_timer;
+    burst_bytes = a_burst;
+    max_latency = a_latency / USEC_PER_COUNT;
+
+    in_flight = 0;
+    sent_time = 0;
+    tx_acked = 0;
+    tx_failed = 0;
+    backoff = TT_BACKOFF_MIN;
+    stall_start = 0;
+    stall_total = 0;
+    stalls = 0;
+    queue_peak = 0;
+    link.on_status (status_handler, this);
+
+    start_time = now ();
+    rate_time = start_time;
+    wake_time = start_time;
+    radio_awake = true;
+    awake_total = 0;
+    latency_max = 0;
+    latency_sum = 0;
+    latency_frames = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gets the current time from the task timer as a plain number. 
+ *  @return The current time in timer counts
+ */
+
+uint32_t task_telemetry::now (void)
+{
+    long time_now;
+
+    p_timer->get_time_now ().get_time (time_now);
+    return ((uint32_t)time_now);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets a deadline a given time from now. 
+ *  @param microsec The number of microseconds from now at which the deadline falls
+ */
+
+void task_telemetry::set_deadline (long microsec)
+{
+    deadline = p_timer->get_time_now ();
+    deadline += time_stamp (0, microsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method queues a frame to be sent to the ground in the next burst. The frame 
+ *  is copied, so the caller's buffer can be reused right away. A critical frame goes 
+ *  into the retransmission window instead, and is sent until it's acknowledged. 
+ *  @param frame A pointer to the encoded frame
+ *  @param length The number of bytes in the frame
+ *  @param critical True if the frame must get through, such as a command reply
+ *  @return True if the frame was taken, false if the queue or window was full or
+ *      the radio couldn't be set up
+ */
+
+bool task_telemetry::send (const uint8_t* frame, uint16_t length, bool critical)
+{
+    if (p_radio->setup_failed ())
+        return (false);
+
+    if (critical)
+        return (window.put (frame, length));
+
+    bool queued = queue.put (frame, length, now ());
+    if (queue.bytes () > queue_peak)
+        queue_peak = queue.bytes ();
+
+    return (queued);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function is called by the API link when the radio reports whether a packet
+ *  got through. Reports for critical frames go to the window, which sends failed
+ *  frames again; all reports are counted. 
+ *  @param context A pointer to the telemetry task, given when the function was set
+ *  @param frame_id The frame ID of the packet
+ *  @param status The status code, XT_TX_SUCCESS if the ground acknowledged it
+ */
+
+void task_telemetry::status_handler (void* context, uint8_t frame_id, uint8_t status)
+{
+    task_telemetry* p_task = (task_telemetry*)context;
+
+    p_task->window.status (frame_id, status);
+    if (status == XT_TX_SUCCESS)
+        p_task->tx_acked++;
+    else
+        p_task->tx_failed++;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method decides whether it's time to wake the radio and send a burst. That's
+ *  right away if a critical frame is waiting, when enough bytes have piled up, when 
+ *  the queue is close to full, or when the oldest frame has waited as long as it may.
+ *  If the radio has no sleep pin, there's nothing to be saved by waiting, so any 
+ *  queued frame is sent right away. 
+ *  @return True if a burst should be sent now
+ */
+
+bool task_telemetry::burst_due (void)
+{
+    if (p_radio->setup_failed ())
+        return (false);
+
+    if (!window.idle ())
+        return (true);
+
+    if (queue.frames () == 0)
+        return (false);
+
+    if (!p_radio->can_sleep ()
+        || queue.bytes () >= burst_bytes
+        || queue.bytes_free () < 2 * TLM_FRAME_MAX
+        || now () - queue.frame_time (0) >= max_latency)
+        return (true);
+
+    return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called when the serial port has finished sending a group of 
+ *  frames. It adds the time each frame waited to the latency statistics, then takes
+ *  the frames out of the queue. 
+ */
+
+void task_telemetry::finish_burst (void)
+{
+    for (uint8_t index = 0; index < in_flight; index++)
+    {
+        uint32_t waited = sent_time - queue.frame_time (index);
+
+        if (waited > latency_max)
+            latency_max = waited;
+        latency_sum += waited * USEC_PER_COUNT / 1000;
+        latency_frames++;
+    }
+    queue.release (in_flight);
+    in_flight = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends a critical frame from the window as its own packet, if one is 
+ *  due to be sent or sent again. The serial port must not be busy. 
+ *  @return True if a critical frame was handed to the serial port
+ */
+
+bool task_telemetry::send_critical (void)
+{
+    int8_t slot = window.due (now ());
+    if (slot < 0)
+        return (false);
+
+    uart_segment segment;
+    segment.data = window.data (slot);
+    segment.length = window.length (slot);
+
+    uint8_t frame_id = link.new_frame_id ();
+    if (!link.send (&segment, 1, frame_id))
+        return (false);
+
+    window.sent (slot, frame_id, now ());
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called when the radio has CTS high, meaning its serial buffer is 
+ *  nearly full. Rather than waiting on the CTS line, which would hold up every other 
+ *  task, it sets a deadline and leaves the task in its backoff state; the wait doubles
+ *  each time CTS is still high, so a congested radio isn't checked over and over. 
+ *  Frames keep going into the queue meanwhile, and are dropped only if it fills. 
+ *  @return The backoff state, to which the task should go
+ */
+
+char task_telemetry::back_off (void)
+{
+    stalls++;
+    stall_start = now ();
+    set_deadline (backoff);
+
+    backoff *= 2;
+    if (backoff > TT_BACKOFF_MAX)
+        backoff = TT_BACKOFF_MAX;
+
+    return (TT_BACKOFF);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gives the rate controller the link measurements for the period which 
+ *  has just ended. The queue normally fills to a burst's worth of bytes while the 
+ *  radio sleeps, so only bytes beyond that count as a backlog. 
+ */
+
+void task_telemetry::update_rate (void)
+{
+    uint32_t time_now = now ();
+    uint8_t backlog = 0;
+
+    if (burst_bytes < TQ_BUFFER_SIZE)
+    {
+        if (queue_peak > burst_bytes)
+            backlog = (uint8_t)((uint32_t)(queue_peak - burst_bytes) * 100 
+                                / (TQ_BUFFER_SIZE - burst_bytes));
+    }
+    else
+        backlog = (uint8_t)((uint32_t)queue_peak * 100 / TQ_BUFFER_SIZE);
+
+    rate.update (backlog, stall_total, time_now - rate_time, tx_acked, tx_failed,
+                 queue.frames_dropped ());
+
+    rate_time = time_now;
+    queue_peak = queue.bytes ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This is the function which runs when it is called by the task scheduler. It never
+ *  waits for anything; each state checks for its condition and returns right away if
+ *  it hasn't happened yet. 
+ *  @param state The state of the task when this run method begins running
+ *  @return The state to which the task will transition, or STL_NO_TRANSITION if no
+ *      transition is called for at this time
+ */
+
+char task_telemetry::run (char state)
+{
+    // Read transmit status reports from the radio, except while the setup task is
+    // talking to it in command mode or if it never got into API mode
+    if (p_radio->ready_for_data () && !p_radio->setup_failed ())
+        link.poll ();
+
+    // Every so often, let the rate controller see how the link has been doing
+    if (now () - rate_time >= TR_PERIOD / USEC_PER_COUNT)
+        update_rate ();
+
+    switch (state)
+    {
+        // In State 0, the radio is awake while the setup task configures it. Frames
+        // are queued but not sent until the radio is ready for data. If setup failed,
+        // the radio may still be in transparent mode and would send API frames over
+        // the air as raw bytes, so the queued frames are dropped and nothing is sent
+        case (TT_SETUP):
+            if (!p_radio->ready_for_data ())
+                break;
+            if (p_radio->setup_failed ())
+            {
+                STL_DEBUG_PUTS ("Radio setup failed; telemetry stopped\r\n");
+                queue.release (queue.frames ());
+                return (TT_FAILED);
+            }
+            return (TT_SENDING);
+
+        // In State 1, the radio sleeps until it's time for a burst
+        case (TT_ASLEEP):
+            if (!burst_due ())
+                break;
+            if (!p_radio->can_sleep ())
+                return (TT_SENDING);
+            p_radio->wake_up ();
+            radio_awake = true;
+            wake_time = now ();
+            set_deadline (A9XS_WAKE_TIME);
+            return (TT_WAKING);
+
+        // In State 2, we wait for the radio to be ready after waking up
+        case (TT_WAKING):
+            if (p_timer->get_time_now () >= deadline)
+                return (TT_SENDING);
+            break;
+
+        // In State 3, we send frames until the queue is empty. Each packet is handed
+        // to the serial port's interrupt driven sender, so this state only has to 
+        // start the next packet when the last one has gone out. Critical frames go
+        // first, each in its own packet so its transmit status can be told apart
+        // CTS is checked once per packet; a packet is never bigger than the room the
+        // radio has left when it raises CTS, so it can't overrun the radio
+        case (TT_SENDING):
+            if (p_radio->tx_busy ())
+                break;
+            finish_burst ();
+
+            if (queue.frames () == 0 && window.due (now ()) < 0)
+            {
+                set_deadline (TT_HOLD_TIME);
+                return (TT_HOLD);
+            }
+
+            if (!p_radio->clear_to_send ())
+                return (back_off ());
+
+            if (send_critical ())
+            {
+                backoff = TT_BACKOFF_MIN;
+                break;
+            }
+
+            unsigned char num_segments;
+            in_flight = queue.get_burst (segments, num_segments, XT_API_MAX_PAYLOAD);
+            if (link.send (segments, num_segments, link.new_frame_id ()))
+            {
+                sent_time = now ();
+                backoff = TT_BACKOFF_MIN;
+            }
+            else
+                in_flight = 0;              // CTS just went high; try again next time
+            break;
+
+        // In State 4, the radio is given a moment to take in the last bytes; then 
+        // it's put to sleep, unless more frames have arrived in the meantime. It's
+        // kept awake until every critical frame has been acknowledged or given up
+        case (TT_HOLD):
+            if (queue.frames () > 0 || window.due (now ()) >= 0)
+                return (TT_SENDING);
+            if (!(p_timer->get_time_now () >= deadline) || !window.idle ())
+                break;
+            if (p_radio->can_sleep ())
+            {
+                p_radio->sleep ();
+                radio_awake = false;
+                awake_total += now () - wake_time;
+            }
+            return (TT_ASLEEP);
+
+        // In State 5, the radio had CTS high, so we wait a while before trying again
+        case (TT_BACKOFF):
+            if (!(p_timer->get_time_now () >= deadline))
+                break;
+            stall_total += now () - stall_start;
+            return (TT_SENDING);
+
+        // In State 6, the radio couldn't be set up, so the task does nothing more
+        case (TT_FAILED):
+            break;
+
+        // If the state isn't a known state, call Houston; we have a problem
+        default:
+            STL_DEBUG_PUTS ("WARNING: Telemetry task in state ");
+            STL_DEBUG_WRITE (state);
+            STL_DEBUG_PUTS ("\r\n");
+            return (TT_SETUP);
+    };
+
+    // If we get here, no transition is called for
+    return (STL_NO_TRANSITION);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method computes the fraction of the time since the task was created during
+ *  which the radio has been awake. A radio without a sleep pin is always awake. 
+ *  @return The radio's awake time in parts per thousand
+ */
+
+uint16_t task_telemetry::awake_permille (void)
+{
+    if (!p_radio->can_sleep ())
+        return (1000);
+
+    uint32_t elapsed = (now () - start_time) / 1000;
+    if (elapsed == 0)
+        return (1000);
+
+    // If the radio is awake right now, count the time since it woke up too
+    uint32_t awake = awake_total;
+    if (radio_awake)
+        awake += now () - wake_time;
+
+    return ((uint16_t)(awake / elapsed));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes the radio's duty cycle, the latency which the bursts have added
+ *  to the telemetry, the number of frames dropped for lack of queue space, how packets
+ *  and critical frames fared on the air, how long the radio held CTS high, and the 
+ *  downlink rate level to a serial port. 
+ *  @param p_port A pointer to the serial port to which the statistics are written
+ */
+
+void task_telemetry::print_stats (avr_uart* p_port)
+{
+    if (p_radio->setup_failed ())
+        p_port->puts_P (PSTR ("Radio setup failed, telemetry stopped\r\n"));
+    p_port->puts_P (PSTR ("Radio awake "));
+    p_port->write ((unsigned int)awake_permille ());
+    p_port->puts_P (PSTR ("/1000, latency avg "));
+    p_port->write ((unsigned long)latency_avg_ms ());
+    p_port->puts_P (PSTR (" ms max "));
+    p_port->write ((unsigned long)(latency_max_us () / 1000));
+    p_port->puts_P (PSTR (" ms, dropped "));
+    p_port->write ((unsigned int)queue.frames_dropped ());
+    p_port->puts_P (PSTR ("\r\nPackets acked "));
+    p_port->write ((unsigned int)tx_acked);
+    p_port->puts_P (PSTR (" failed "));
+    p_port->write ((unsigned int)tx_failed);
+    p_port->puts_P (PSTR (", critical resent "));
+    p_port->write ((unsigned int)window.frames_resent ());
+    p_port->puts_P (PSTR (" lost "));
+    p_port->write ((unsigned int)window.frames_lost ());
+    p_port->puts_P (PSTR (", CTS stalls "));
+    p_port->write ((unsigned int)stalls);
+    p_port->puts_P (PSTR (" for "));
+    p_port->write ((unsigned long)cts_stall_ms ());
+    p_port->puts_P (PSTR (" ms, rate level "));
+    p_port->write ((unsigned int)rate.get_level ());
+    p_port->puts_P (PSTR ("\r\n"));
+}
@@ -0,0 +1,165 @@
+//======================================================================================
+/** \file  task_telemetry.h
+ *  This file contains the task which sends telemetry frames to the ground through the
+ *  9XTend radio. Frames from the sensor task are queued in RAM while the radio sleeps;
+ *  when enough bytes have piled up, or the oldest frame has waited as long as it's 
+ *  allowed to, the task wakes the radio, waits out its wake-up time, sends the whole
+ *  queue in one burst, and puts the radio back to sleep. Larger bursts and longer 
+ *  waits mean less time awake and less power, at the cost of older data on the 
+ *  ground; the burst size and the greatest wait are set in the constructor. 
+ *
+ *  The radio is run in API mode (see xt_api.h), so each group of frames goes out as
+ *  one addressed packet. Frames marked critical skip the queue and go into a window
+ *  (see xt_window.h) from which each is sent as its own packet until the radio 
+ *  reports that the ground acknowledged it. 
+ *
+ *  The task also measures how congested the link is and gives the measurements to a
+ *  rate controller (see tlm_rate.h), which the sensor task asks which channels to 
+ *  send in each scan. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Send through API frames; retransmit critical frames
+ *    \li  10-18-26 DSC Back off without blocking while the radio holds CTS high
+ *    \li  10-18-26 DSC Let the uplink task use the radio link
+ *    \li  10-18-26 DSC Downlink rate adapted to congestion on the radio link
+ *    \li  10-18-26 DSC Smaller bursts, as the queue was cut down to save RAM
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TASK_TELEMETRY_H_                      // To prevent *.h file from being included
+#define _TASK_TELEMETRY_H_                      // in a source file more than once
+
+#include "tlm_queue.h"                          // Queue of frames waiting to be sent
+#include "xt_api.h"                             // Radio API mode frames
+#include "xt_window.h"                          // Critical frames awaiting acknowledgement
+#include "tlm_rate.h"                           // Downlink rate controller
+
+/** The default number of queued bytes at which a burst is sent. It must leave room in
+ *  the TQ_BUFFER_SIZE byte queue for frames which come in while the radio wakes up */
+#define TT_BURST_BYTES      160
+
+/** The default greatest time, in microseconds, a frame may wait for a burst */
+#define TT_MAX_LATENCY      500000L
+
+/** How long the radio is kept awake after a burst, in microseconds, so that it has
+ *  taken in the last bytes from the serial line before it's put to sleep */
+#define TT_HOLD_TIME        20000L
+
+/** The first wait, in microseconds, after the radio has held CTS high. Each time CTS 
+ *  is still high at the end of a wait, the next wait is twice as long, up to 
+ *  TT_BACKOFF_MAX; the wait goes back to this length once a packet gets out */
+#define TT_BACKOFF_MIN      5000L
+
+/** The longest wait, in microseconds, for the radio's CTS line to come back */
+#define TT_BACKOFF_MAX      160000L
+
+
+//-------------------------------------------------------------------------------------
+/** This task sends queued telemetry frames in bursts, keeping the radio asleep in 
+ *  between. It also measures how much of the time the radio is awake and how long
+ *  frames wait in the queue, so the burst settings can be chosen sensibly. 
+ */
+
+class task_telemetry : public stl_task
+{
+    protected:
+        avr_9xtend* p_radio;                    // The radio which sends the frames
+        task_timer* p_timer;                    // Timer for deadlines and statistics
+        tlm_queue queue;                        // Frames waiting to be sent
+        uint16_t burst_bytes;                   // Queued bytes which start a burst
+        uint32_t max_latency;                   // Longest a frame may wait, in counts
+        time_stamp deadline;                    // When the current wait is over
+
+        uart_segment segments[2];               // Describe the frames being sent
+        uint8_t in_flight;                      // Number of frames being sent
+        uint32_t sent_time;                     // When those frames started out
+
+        xt_api_link link;                       // Sends and receives API frames
+        xt_window window;                       // Critical frames being delivered
+        uint16_t tx_acked;                      // Packets the ground acknowledged
+        uint16_t tx_failed;                     // Packets the radio couldn't deliver
+
+        long backoff;                           // Next wait for CTS, in microseconds
+        uint32_t stall_start;                   // When the current CTS wait began
+        uint32_t stall_total;                   // Time spent waiting for CTS, counts
+        uint16_t stalls;                        // Number of times CTS was found high
+
+        tlm_rate rate;                          // Thins the downlink when congested
+        uint32_t rate_time;                     // When the rate was last updated
+        uint16_t queue_peak;                    // Most bytes queued since then
+
+        uint32_t start_time;                    // When statistics began to be kept
+        uint32_t wake_time;                     // When the radio last woke up
+        bool radio_awake;                       // True while the radio is awake
+        uint32_t awake_total;                   // Time the radio has been awake
+        uint32_t latency_max;                   // Longest wait of any frame, counts
+        uint32_t latency_sum;                   // Total of all waits, in milliseconds
+        uint32_t latency_frames;                // Number of frames in latency_sum
+
+        uint32_t now (void);                    // Get the time as a number
+        void set_deadline (long);               // Set a deadline from now
+        bool burst_due (void);                  // Check if it's time to send a burst
+        void finish_burst (void);               // Release frames which have been sent
+        bool send_critical (void);              // Send a critical frame if one is due
+        char back_off (void);                   // Wait a while for CTS to come back
+        void update_rate (void);                // Give measurements to rate control
+
+        // This function passes transmit status reports from the link to the task
+        static void status_handler (void*, uint8_t, uint8_t);
+
+    public:
+        // The constructor creates the task and saves pointers to the radio and timer
+        task_telemetry (time_stamp*, avr_9xtend*, task_timer*, 
+                        uint16_t = TT_BURST_BYTES, long = TT_MAX_LATENCY);
+
+        // This method queues a frame to be sent, or puts a critical one in the window
+        bool send (const uint8_t*, uint16_t, bool = false);
+
+        // This method runs the burst transmission state machine
+        char run (char);
+
+        // This method returns the fraction of time the radio has been awake
+        uint16_t awake_permille (void);
+
+        // This method writes the radio duty cycle and latency to a serial port
+        void print_stats (avr_uart*);
+
+        /** This method returns the longest time any frame has waited in the queue,
+         *  in microseconds. */
+        uint32_t latency_max_us (void) { return (latency_max * USEC_PER_COUNT); }
+
+        /** This method returns the average time frames have waited in the queue, in
+         *  milliseconds. */
+        uint32_t latency_avg_ms (void) 
+            { return (latency_frames ? latency_sum / latency_frames : 0); }
+
+        /** This method picks which of the given channels are sent in the next scan,
+         *  thinning them out if the link is congested. */
+        uint32_t downlink_map (uint32_t map) { return (rate.select (map)); }
+
+        /** This method returns the rate controller, so channel priorities can be set. */
+        tlm_rate* get_rate (void) { return (&rate); }
+
+        /** This method returns the radio link, which also receives commands. */
+        xt_api_link* get_link (void) { return (&link); }
+
+        /** This method returns the number of frames dropped for lack of space. */
+        uint16_t frames_dropped (void) { return (queue.frames_dropped ()); }
+
+        /** This method returns the number of packets the radio couldn't deliver. */
+        uint16_t packets_failed (void) { return (tx_failed); }
+
+        /** This method returns the number of times the radio has held CTS high. */
+        uint16_t cts_stalls (void) { return (stalls); }
+
+        /** This method returns the total time spent waiting for CTS, in ms. */
+        uint32_t cts_stall_ms (void) 
+            { return (stall_total / (1000 / USEC_PER_COUNT)); }
+};
+
+#endif // _TASK_TELEMETRY_H_
@@ -0,0 +1,470 @@
+//======================================================================================
+/** \file  task_uplink.cc
+ *  This file contains the task which carries out commands sent up from the ground. 
+ *  See task_uplink.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Dump includes the A/D scan jitter and overruns
+ *    \li  10-18-26 DSC Spread channels can be chosen from the ground
+ *    \li  10-18-26 DSC Added the sensor task statistics command
+ *    \li  10-18-26 DSC Added the command which reports the A/D channels' noise
+ *    \li  10-18-26 DSC Added the command which sets up the noise comparison
+ *    \li  10-18-26 DSC Added the command which measures the filters
+ *    \li  10-18-26 DSC Added the flight log statistics command
+ *    \li  10-18-26 DSC Added the command which reports the relative attitude
+ *    \li  10-18-26 DSC Sensor task statistics include the 6 DOF skew
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "avr_serial.h"
+#include "avr_9xtend.h"
+#include "avr_adc_scan.h"
+#include "stl_debug.h"
+#include "stl_us_timer.h"
+#include "stl_task.h"
+#include "tlm_crc16.h"
+#include "tlm_frame.h"
+#include "task_telemetry.h"
+#include "tlm_aggregate.h"
+#include "task_logger.h"
+#include "task_sensors.h"
+#include "task_uplink.h"
+
+// State name definitions
+#define TU_LISTEN           0               // Take in and carry out commands
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an uplink task and sets it up to be given the packets 
+ *  which the telemetry task's radio link receives. 
+ *  @param t_stamp A timestamp which contains the time between runs of this task; it
+ *      should be no longer than the telemetry task's, so commands are seen quickly
+ *  @param a_radio A pointer to the radio modem
+ *  @param a_telemetry A pointer to the task which sends telemetry and replies
+ *  @param a_sensors A pointer to the task whose channels can be chosen from the ground
+ *  @param a_logger A pointer to the task which keeps the flight log
+ */
+
+task_uplink::task_uplink (time_stamp* t_stamp, avr_9xtend* a_radio, 
+    task_telemetry* a_telemetry, task_sensors* a_sensors, task_logger* a_logger)
+    : stl_task (*t_stamp)
+{
+    p_radio = a_radio;
+    p_telemetry = a_telemetry;
+    p_sensors = a_sensors;
+    p_logger = a_logger;
+
+    for (uint8_t index = 0; index < TU_MAX_TASKS; index++)
+        tasks[index] = NULL;
+
+    fill = 0;
+    overflow = false;
+    commands = 0;
+    rejected = 0;
+
+    p_telemetry->get_link ()->on_receive (receive_handler, this);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method lets the ground station change how often a task runs. 
+ *  @param number The number by which commands will refer to the task
+ *  @param a_task A pointer to the task
+ *  @return True if the task was added, false if the number is too big
+ */
+
+bool task_uplink::add_task (uint8_t number, stl_task* a_task)
+{
+    if (number >= TU_MAX_TASKS)
+        return (false);
+
+    tasks[number] = a_task;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function is called by the radio link when a packet arrives. The bytes in the
+ *  packet are handed to the frame receiver one at a time, as a frame can be split 
+ *  across packets or a packet can hold more than one frame. 
+ *  @param context A pointer to the uplink task, given when the function was set
+ *  @param source The address of the radio which sent the packet
+ *  @param data A pointer to the data in the packet
+ *  @param length The number of bytes of data
+ */
+
+void task_uplink::receive_handler (void* context, uint16_t source, 
+                                   const uint8_t* data, uint8_t length)
+{
+    task_uplink* p_task = (task_uplink*)context;
+
+    while (length-- > 0)
+        p_task->take (*data++);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes one byte of a command frame. Bytes are saved until a zero marks
+ *  the end of the frame; then the frame is decoded, checked and carried out. 
+ *  @param byte The byte which was received
+ */
+
+void task_uplink::take (uint8_t byte)
+{
+    if (byte != 0)
+    {
+        if (fill < sizeof (buffer))
+            buffer[fill++] = byte;
+        else
+            overflow = true;
+        return;
+    }
+
+    // A zero ends the frame. Empty frames are just extra delimiters
+    uint8_t length = fill;
+    bool was_overflow = overflow;
+    fill = 0;
+    overflow = false;
+
+    if (length == 0)
+        return;
+
+    if (!was_overflow)
+        length = (uint8_t)tlm_cobs_decode (buffer, length);
+
+    // A command has a type, sequence number, command code and a CRC at least
+    if (was_overflow || length < 5)
+    {
+        rejected++;
+        return;
+    }
+
+    length -= 2;
+    uint16_t crc = buffer[length] | ((uint16_t)buffer[length + 1] << 8);
+    if (tlm_crc16 (buffer, length) != crc || buffer[0] != TLM_TYPE_COMMAND)
+    {
+        rejected++;
+        return;
+    }
+
+    execute (length);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function puts 16-bit numbers into the data of a reply, least significant 
+ *  byte first. Only as many as fit in a reply are put in. 
+ *  @param data The reply's data, TLM_BODY_MAX - 1 bytes long
+ *  @param words The numbers
+ *  @param count How many numbers there are
+ *  @return The number of bytes put in
+ */
+
+static uint8_t tu_put_words (uint8_t* data, const uint16_t* words, uint8_t count)
+{
+    uint8_t length = 0;
+
+    for (uint8_t index = 0; index < count && length + 2 <= TLM_BODY_MAX - 1; index++)
+    {
+        data[length++] = (uint8_t)words[index];
+        data[length++] = (uint8_t)(words[index] >> 8);
+    }
+    return (length);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method carries out a command which has been checked, then sends a reply. 
+ *  @param length The number of bytes in the command, not counting the CRC
+ */
+
+void task_uplink::execute (uint8_t length)
+{
+    uint8_t sequence = buffer[1];
+    uint8_t code = buffer[2];
+    const uint8_t* args = buffer + 3;
+    uint8_t num_args = length - 3;
+    uint8_t data[TLM_BODY_MAX - 1];         // Data returned with the reply
+    uint8_t num_data = 0;
+    uint8_t result = TLM_OK;
+
+    switch (code)
+    {
+        case (TLM_CMD_PING):
+            break;
+
+        // Task number, then the interval in microseconds
+        case (TLM_CMD_INTERVAL):
+        {
+            if (num_args != 5 || args[0] >= TU_MAX_TASKS || tasks[args[0]] == NULL)
+            {
+                result = TLM_ERR_ARGUMENT;
+                break;
+            }
+            long interval = (long)args[1] | ((long)args[2] << 8) 
+                          | ((long)args[3] << 16) | ((long)args[4] << 24);
+            if (interval < TU_MIN_INTERVAL)
+            {
+                result = TLM_ERR_ARGUMENT;
+                break;
+            }
+            tasks[args[0]]->set_interval (time_stamp (0, interval));
+            break;
+        }
+
+        // Bitmap of the slots which are to be sent
+        case (TLM_CMD_CHANNELS):
+            if (num_args != 3)
+            {
+                result = TLM_ERR_ARGUMENT;
+                break;
+            }
+            p_sensors->set_channels ((uint32_t)args[0] | ((uint32_t)args[1] << 8)
+                                     | ((uint32_t)args[2] << 16));
+            break;
+
+        // Bitmap of the slots which send their lowest and highest readings
+        case (TLM_CMD_SPREAD):
+            if (num_args != 3)
+            {
+                result = TLM_ERR_ARGUMENT;
+                break;
+            }
+            p_sensors->get_aggregate ()->set_channels ((uint32_t)args[0] 
+                | ((uint32_t)args[1] << 8) | ((uint32_t)args[2] << 16));
+            break;
+
+        // Send back the link statistics, each as a 16-bit number
+        case (TLM_CMD_DUMP):
+        {
+            uint16_t stats[] = 
+            {
+                p_telemetry->awake_permille (),
+                (uint16_t)p_telemetry->latency_avg_ms (),
+                (uint16_t)(p_telemetry->latency_max_us () / 1000),
+                p_telemetry->frames_dropped (),
+                p_telemetry->packets_failed (),
+                p_telemetry->cts_stalls (),
+                p_telemetry->get_rate ()->get_level (),
+                commands,
+                rejected,
+                p_sensors->get_scanner ()->jitter_us (),
+                p_sensors->get_scanner ()->overruns ()
+            };
+            num_data = tu_put_words (data, stats, sizeof (stats) / sizeof (stats[0]));
+            break;
+        }
+
+        // Send back the sensor task's statistics: the scans it missed, then the 6 DOF
+        // skew in microseconds as sampled, latest and widest, and modelled once lined
+        // up, latest and widest, and whether the axes are being lined up (1) or not
+        case (TLM_CMD_SENSORS):
+        {
+            uint16_t stats[] = 
+            {
+                p_sensors->get_scans_missed (),
+                p_sensors->get_skew_us (false, false),
+                p_sensors->get_skew_us (false, true),
+                p_sensors->get_skew_us (true, false),
+                p_sensors->get_skew_us (true, true),
+                p_sensors->get_alignment ()
+            };
+            num_data = tu_put_words (data, stats, sizeof (stats) / sizeof (stats[0]));
+            break;
+        }
+
+        // Send back the number of A/D channels, then for as many channels from the 
+        // first one asked for as fit, the bits in its results and its noise awake and
+        // asleep in hundredths of an LSB; the ground asks again for the rest
+        case (TLM_CMD_NOISE):
+        {
+            avr_adc_scan* p_scan = p_sensors->get_scanner ();
+            uint8_t count = p_scan->channels ();
+            if (num_args != 1 || args[0] >= count)
+            {
+                result = TLM_ERR_ARGUMENT;
+                break;
+            }
+            data[num_data++] = count;
+            for (uint8_t index = args[0]; index < count 
+                 && num_data + 5 <= (uint8_t)sizeof (data); index++)
+            {
+                uint16_t noise[] = { p_scan->noise (index, false), 
+                                     p_scan->noise (index, true) };
+                data[num_data++] = p_scan->bits (index);
+                num_data += tu_put_words (data + num_data, noise, 2);
+            }
+            break;
+        }
+
+        // Turn the comparison of sleeping and waking conversions off (0) or on (1),
+        // which converts quiet channels awake in every other scan, then send back 
+        // the scan timing: worst trigger latency and jitter in microseconds and the
+        // number of overruns. The comparison should be off for flight
+        case (TLM_CMD_SCAN):
+        {
+            if (num_args != 1 || args[0] > 1)
+            {
+                result = TLM_ERR_ARGUMENT;
+                break;
+            }
+            avr_adc_scan* p_scan = p_sensors->get_scanner ();
+            p_scan->compare_noise (args[0] != 0);
+            uint16_t stats[] = 
+            {
+                p_scan->latency_us (),
+                p_scan->jitter_us (),
+                p_scan->overruns ()
+            };
+            num_data = tu_put_words (data, stats, sizeof (stats) / sizeof (stats[0]));
+            break;
+        }
+
+        // Measure the filters of as many slots from the first one asked for as fit, 
+        // and send back the processor cycles each takes per sample, 0 for a slot with
+        // no filter; the ground asks again for the rest
+        case (TLM_CMD_FILTERS):
+        {
+            if (num_args != 1 || args[0] >= TS_NUM_SLOTS)
+            {
+                result = TLM_ERR_ARGUMENT;
+                break;
+            }
+            uint16_t cycles[(TLM_BODY_MAX - 1) / 2];
+            uint8_t count = 0;
+            for (uint8_t slot = args[0]; slot < TS_NUM_SLOTS 
+                 && count < sizeof (cycles) / sizeof (cycles[0]); slot++)
+            {
+                cycles[count++] = p_sensors->filter_cycles (slot);
+            }
+            num_data = tu_put_words (data, cycles, count);
+            break;
+        }
+
+        // Send back the flight log's state, 0 for closed, 1 for logging or 2 for a 
+        // card which stopped working, then its flight number, the blocks written and
+        // rejected and the scans dropped, which are split into two 16-bit halves
+        case (TLM_CMD_LOG):
+        {
+            log_writer* p_writer = p_logger->get_writer ();
+            uint32_t written = p_writer->blocks_written ();
+            uint32_t dropped = p_writer->scans_dropped ();
+            uint16_t stats[] = 
+            {
+                p_writer->flight_number (),
+                (uint16_t)written,
+                (uint16_t)(written >> 16),
+                p_writer->blocks_rejected (),
+                (uint16_t)dropped,
+                (uint16_t)(dropped >> 16)
+            };
+            if (p_writer->has_failed ())
+                data[num_data++] = 2;
+            else
+                data[num_data++] = p_writer->is_open () ? 1 : 0;
+            num_data += tu_put_words (data + num_data, stats, 
+                                      sizeof (stats) / sizeof (stats[0]));
+            break;
+        }
+
+        // Send back the parachute's roll, pitch and yaw relative to the chassis and
+        // the total angle between them, in 0.1 degree, then the processor cycles the
+        // latest attitude update took, the most any took and how many went over the
+        // budget
+        case (TLM_CMD_ATTITUDE):
+        {
+            att_angles angles;
+            uint16_t total = p_sensors->get_relative_att (angles);
+            uint16_t stats[] = 
+            {
+                (uint16_t)angles.roll,
+                (uint16_t)angles.pitch,
+                (uint16_t)angles.yaw,
+                total,
+                p_sensors->get_att_cycles (),
+                p_sensors->get_att_cycles_max (),
+                p_sensors->get_att_overruns ()
+            };
+            num_data = tu_put_words (data, stats, sizeof (stats) / sizeof (stats[0]));
+            break;
+        }
+
+        default:
+            result = TLM_ERR_COMMAND;
+            break;
+    };
+
+    if (result == TLM_OK)
+        commands++;
+    else
+        rejected++;
+
+    reply (sequence, code, result, data, num_data);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends a reply to a command as a critical frame, which goes out ahead 
+ *  of queued telemetry. 
+ *  @param sequence The sequence number of the command
+ *  @param code The command code
+ *  @param result The result code, such as TLM_OK
+ *  @param data Data returned by the command
+ *  @param length The number of bytes of data
+ */
+
+void task_uplink::reply (uint8_t sequence, uint8_t code, uint8_t result, 
+                         const uint8_t* data, uint8_t length)
+{
+    uint8_t body[TLM_BODY_MAX];
+    uint8_t frame[TLM_MESSAGE_MAX];
+
+    body[0] = result;
+    for (uint8_t index = 0; index < length && index < TLM_BODY_MAX - 1; index++)
+        body[index + 1] = data[index];
+
+    size_t frame_length = tlm_message (frame, TLM_TYPE_REPLY, sequence, code, body, 
+                                       length + 1);
+    p_telemetry->send (frame, frame_length, true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This is the function which runs when it is called by the task scheduler. It reads
+ *  whatever the radio has sent; complete command frames are carried out as they come
+ *  in, through receive_handler(). Nothing is read while the setup task has the radio
+ *  in command mode. 
+ *  @param state The state of the task when this run method begins running
+ *  @return The state to which the task will transition, or STL_NO_TRANSITION if no
+ *      transition is called for at this time
+ */
+
+char task_uplink::run (char state)
+{
+    switch (state)
+    {
+        case (TU_LISTEN):
+            if (p_radio->ready_for_data ())
+                p_telemetry->get_link ()->poll ();
+            break;
+
+        // If the state isn't a known state, call Houston; we have a problem
+        default:
+            STL_DEBUG_PUTS ("WARNING: Uplink task in state ");
+            STL_DEBUG_WRITE (state);
+            STL_DEBUG_PUTS ("\r\n");
+            return (TU_LISTEN);
+    };
+
+    // If we get here, no transition is called for
+    return (STL_NO_TRANSITION);
+}
@@ -0,0 +1,88 @@
+//======================================================================================
+/** \file  task_uplink.h
+ *  This file contains the task which carries out commands sent up from the ground. 
+ *  Commands arrive as COBS framed packets from the 9XTend radio (see tlm_frame.h for
+ *  the layout); they can change how often tasks run, choose which sensor channels are
+ *  sent down and which of them send their spread when thinned out, and turn the A/D
+ *  noise comparison on and off. Others ask for reports: the link, sensor task and 
+ *  flight log statistics, the A/D channels' noise and timing, the processor time the
+ *  filters and attitude updates take, and the parachute's attitude relative to the 
+ *  chassis. Every command is answered with a reply frame which is sent as a critical
+ *  frame, so it goes ahead of queued telemetry and is sent again until the ground 
+ *  radio acknowledges it. 
+ *
+ *  The radio can't hear anything while it's asleep between telemetry bursts, so a
+ *  command may wait up to the telemetry task's greatest latency to get through; the 
+ *  ground station should send a command again if no reply comes back. Commands can
+ *  safely be carried out more than once. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Added the command which chooses the spread channels
+ *    \li  10-18-26 DSC Added the command which dumps the sensor task's statistics
+ *    \li  10-18-26 DSC Added the command which dumps the flight log's statistics
+ *    \li  10-18-26 DSC Added the A/D scan, filter and attitude report commands
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TASK_UPLINK_H_                         // To prevent *.h file from being included
+#define _TASK_UPLINK_H_                         // in a source file more than once
+
+/** The greatest number of tasks whose intervals can be changed from the ground */
+#define TU_MAX_TASKS        8
+
+/** The shortest task interval, in microseconds, which a command may set */
+#define TU_MIN_INTERVAL     1000L
+
+
+//-------------------------------------------------------------------------------------
+/** This task reads command frames from the radio and carries them out. It takes in 
+ *  whatever bytes the radio has each time it runs, without waiting for more, and 
+ *  keeps no more than one frame's worth of them. 
+ */
+
+class task_uplink : public stl_task
+{
+    protected:
+        avr_9xtend* p_radio;                    // The radio the commands come from
+        task_telemetry* p_telemetry;            // Sends replies and has the link
+        task_sensors* p_sensors;                // Task whose channels can be chosen
+        task_logger* p_logger;                  // Task which keeps the flight log
+        stl_task* tasks[TU_MAX_TASKS];          // Tasks whose intervals can be set
+
+        uint8_t buffer[TLM_MESSAGE_MAX];        // Holds the frame being received
+        uint8_t fill;                           // Number of bytes in the buffer
+        bool overflow;                          // The frame was too long for buffer
+        uint16_t commands;                      // Commands carried out
+        uint16_t rejected;                      // Frames which weren't good commands
+
+        // This function passes received packets from the radio link to the task
+        static void receive_handler (void*, uint16_t, const uint8_t*, uint8_t);
+
+        void take (uint8_t);                    // Take in one byte of a frame
+        void execute (uint8_t);                 // Carry out a complete command
+        void reply (uint8_t, uint8_t, uint8_t, const uint8_t*, uint8_t);
+
+    public:
+        // The constructor saves pointers to the radio and the tasks it controls
+        task_uplink (time_stamp*, avr_9xtend*, task_telemetry*, task_sensors*, 
+                     task_logger*);
+
+        // This method lets a task's interval be set from the ground
+        bool add_task (uint8_t, stl_task*);
+
+        // This method reads and carries out commands
+        char run (char);
+
+        /** This method returns the number of commands which were carried out. */
+        uint16_t commands_done (void) { return (commands); }
+
+        /** This method returns the number of bad command frames received. */
+        uint16_t commands_rejected (void) { return (rejected); }
+};
+
+#endif // _TASK_UPLINK_H_
@@ -0,0 +1,53 @@
+//======================================================================================
+/** \file  avr/io.h
+ *  This file stands in for the AVR's register definitions when A/D driver code is 
+ *  tested on the PC. ADMUX and ADCSRA are objects which count the writes made to them,
+ *  and ADCW is a plain variable which the test's model of the converter fills in. 
+ *  Only the registers and bits which the drivers under test use are defined. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TEST_AVR_IO_H_                     // To prevent *.h file from being included
+#define _TEST_AVR_IO_H_                     // in a source file more than once
+
+#include <stdint.h>
+
+/** The bits of ADCSRA which the drivers use */
+#define ADEN                7
+#define ADSC                6
+#define ADIE                3
+
+
+//-------------------------------------------------------------------------------------
+/** This class stands in for an 8-bit I/O register. It reads and writes like one, and
+ *  counts the writes so a test can check that a register isn't written needlessly.
+ */
+
+class test_register
+{
+    public:
+        uint8_t value;                      // The register's contents
+        unsigned long writes;               // Number of times it's been written
+
+        test_register (void) { value = 0; writes = 0; }
+        operator uint8_t (void) const { return (value); }
+        test_register& operator = (uint8_t a_value) 
+            { value = a_value; writes++; return (*this); }
+        test_register& operator |= (uint8_t bits) 
+            { value |= bits; writes++; return (*this); }
+        test_register& operator &= (uint8_t bits) 
+            { value &= bits; writes++; return (*this); }
+};
+
+extern test_register ADMUX;                 // A/D multiplexer selection
+extern test_register ADCSRA;                // A/D control and status
+extern volatile uint16_t ADCW;              // A/D result, both bytes
+
+#endif // _TEST_AVR_IO_H_
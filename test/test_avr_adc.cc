@@ -0,0 +1,240 @@
+//======================================================================================
+/** \file  test_avr_adc.cc
+ *  This file tests the simple A/D converter driver in avr_adc.cc on the PC. The AVR's
+ *  registers are replaced by the ones in test/avr/io.h, and the task timer by a model
+ *  in which each reading of the time moves it ahead by one count and lets a model of
+ *  the converter run; a conversion finishes a set number of counts after ADSC is set,
+ *  putting the code chosen for the selected channel in ADCW, unless the converter is
+ *  made to hang. The test checks that:
+ *    \li  Every code from 0 to 1023 is read back on each of channels 0 - 7
+ *    \li  ADMUX is written once when the channel changes, never when it's the same,
+ *         and its reference bits are left alone
+ *    \li  A conversion which never finishes gives 0xFFFF after the timeout, and no
+ *         new conversion can be started until it does finish
+ *    \li  A read of another channel after a timeout waits for the hung conversion,
+ *         then gives that channel's code, not the hung one's
+ *  Run it with 'make test'; it prints each failure and exits with 1 if there were any.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "stl_us_timer.h"
+#include "avr_adc.h"
+
+/** The timer counts a conversion takes in the model of the converter */
+#define TEST_CONVERT_COUNTS 26
+
+test_register ADMUX;
+test_register ADCSRA;
+volatile uint16_t ADCW;
+
+/** The code the model converter gives for each channel */
+static uint16_t test_codes[8];
+
+/** When true, the model converter never finishes a conversion */
+static bool test_hang = false;
+
+/** Counts since the conversion which is running was started */
+static uint16_t test_elapsed = 0;
+
+/** The model's time, in timer counts */
+static long test_now = 0;
+
+/** The number of checks which failed */
+static unsigned int test_failures = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function moves the model converter along by one timer count.
+ */
+
+static void test_step_converter (void)
+{
+    if (!(ADCSRA.value & (1 << ADSC)))
+        return;
+    if (test_hang || ++test_elapsed < TEST_CONVERT_COUNTS)
+        return;
+
+    ADCW = test_codes[ADMUX.value & 0x07];
+    ADCSRA.value &= ~(1 << ADSC);
+    test_elapsed = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+// These are the parts of the time stamp and task timer which avr_adc.cc uses, kept in
+// the model's timer counts
+
+time_stamp::time_stamp (void) { data.whole = 0; }
+
+void time_stamp::set_time (int seconds, long microseconds)
+{
+    data.whole = ((long)seconds * 1000000L + microseconds) / USEC_PER_COUNT;
+}
+
+void time_stamp::operator += (const time_stamp& other)
+{
+    data.whole += other.data.whole;
+}
+
+bool time_stamp::operator >= (const time_stamp& other)
+{
+    return (data.whole >= other.data.whole);
+}
+
+task_timer::task_timer (void) { }
+
+time_stamp& task_timer::get_time_now (void)
+{
+    test_now++;
+    test_step_converter ();
+    now_time.data.whole = test_now;
+    return (now_time);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function notes a failed check.
+ *  @param what A description of what was checked
+ *  @param channel The channel being read
+ *  @param got The number which was found
+ *  @param wanted The number which should have been found
+ */
+
+static void test_fail (const char* what, unsigned int channel, long got, long wanted)
+{
+    printf ("FAIL: %s on channel %u: got %ld, wanted %ld\n", what, channel, got,
+            wanted);
+    test_failures++;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads every code on every channel, checking the result and the
+ *  writes to ADMUX. The reference bits are set in ADMUX first; they must survive.
+ *  @param p_adc A pointer to the driver under test
+ */
+
+static void test_codes_and_channels (avr_adc* p_adc)
+{
+    ADMUX.value = 0x40;
+
+    for (unsigned int channel = 0; channel < 8; channel++)
+    {
+        for (uint16_t code = 0; code < 1024; code++)
+        {
+            test_codes[channel] = code;
+            test_codes[channel ^ 1] = 1023 - code;
+            unsigned long writes = ADMUX.writes;
+
+            unsigned int result = p_adc->read_once ((unsigned char)channel);
+            if (result != code)
+                test_fail ("result", channel, result, code);
+
+            // The channel changes on the first code only; channel 0 is already set
+            unsigned long wanted = (code == 0 && channel != 0) ? 1 : 0;
+            if (ADMUX.writes - writes != wanted)
+                test_fail ("ADMUX writes", channel, ADMUX.writes - writes, wanted);
+            if (ADMUX.value != (0x40 | channel))
+                test_fail ("ADMUX", channel, ADMUX.value, 0x40 | channel);
+        }
+    }
+
+    // Going back and forth writes ADMUX every time, and reads the right channel
+    for (unsigned int channel = 0; channel < 8; channel++)
+        test_codes[channel] = 100 * channel + 7;
+    for (unsigned int pass = 0; pass < 16; pass++)
+    {
+        unsigned int channel = pass & 0x07;
+        unsigned long writes = ADMUX.writes;
+        unsigned int result = p_adc->read_once ((unsigned char)channel);
+        if (result != 100 * channel + 7)
+            test_fail ("alternating result", channel, result, 100 * channel + 7);
+        if (ADMUX.writes - writes != 1)
+            test_fail ("alternating ADMUX writes", channel, ADMUX.writes - writes, 1);
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function makes a conversion hang and checks that the driver gives up after
+ *  its timeout, that it won't start another conversion over the hung one, and that
+ *  it reads the right channel, the hung one or another, once the converter recovers.
+ *  @param p_adc A pointer to the driver under test
+ */
+
+static void test_timeout (avr_adc* p_adc)
+{
+    const long timeout = ADC_TIMEOUT / USEC_PER_COUNT;
+
+    test_codes[3] = 555;
+    test_hang = true;
+    long start = test_now;
+    unsigned int result = p_adc->read_once (3);
+    long waited = test_now - start;
+    if (result != 0xFFFF)
+        test_fail ("timeout result", 3, result, 0xFFFF);
+    if (waited < timeout || waited > timeout + 3)
+        test_fail ("timeout length", 3, waited, timeout);
+    if (p_adc->startConversion (3))
+        test_fail ("start while busy", 3, 1, 0);
+
+    // A read of another channel waits out the hung conversion rather than giving
+    // back its result, or gives up if it never finishes
+    test_codes[5] = 777;
+    result = p_adc->read_once (5);
+    if (result != 0xFFFF)
+        test_fail ("other channel while hung", 5, result, 0xFFFF);
+
+    test_hang = false;
+    result = p_adc->read_once (5);
+    if (result != 777)
+        test_fail ("other channel after timeout", 5, result, 777);
+    if (ADMUX.value != (0x40 | 5))
+        test_fail ("ADMUX after timeout", 5, ADMUX.value, 0x40 | 5);
+
+    test_hang = true;
+    p_adc->read_once (3);
+    test_hang = false;
+    result = p_adc->read_once (3);
+    if (result != 555)
+        test_fail ("result after timeout", 3, result, 555);
+    if (!p_adc->startConversion (3))
+        test_fail ("start when idle", 3, 0, 1);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs the tests.
+ *  @return 0 if every check passed, 1 if any failed
+ */
+
+int main (void)
+{
+    task_timer timer;
+    avr_adc adc (&timer);
+
+    if (!(ADCSRA.value & (1 << ADEN)))
+        test_fail ("ADEN after construction", 0, ADCSRA.value, 1 << ADEN);
+
+    test_codes_and_channels (&adc);
+    test_timeout (&adc);
+
+    if (test_failures != 0)
+    {
+        printf ("avr_adc: %u checks failed\n", test_failures);
+        return (1);
+    }
+    printf ("avr_adc: all checks passed\n");
+    return (0);
+}
@@ -0,0 +1,113 @@
+//======================================================================================
+/** \file  tlm_aggregate.cc
+ *  This file contains the aggregator which summarizes the readings the downlink
+ *  skips. See tlm_aggregate.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tlm_frame.h"
+#include "tlm_aggregate.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an aggregator whose windows are all empty.
+ */
+
+tlm_aggregate::tlm_aggregate (void)
+{
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+        count[slot] = 0;
+    spread_map = 0;
+    coarse_map = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds new readings to the windows of their channels. A window which is
+ *  full is halved first, keeping its mean, lowest and highest readings; that only
+ *  happens if a channel goes unsent for longer than the rate controller allows.
+ *  @param channel_map A bitmap of the slots which have new readings
+ *  @param samples An array of 12-bit readings indexed by slot
+ */
+
+void tlm_aggregate::add (uint32_t channel_map, const uint16_t* samples)
+{
+    for (uint8_t slot = 0; channel_map != 0; slot++, channel_map >>= 1)
+    {
+        if (!(channel_map & 1))
+            continue;
+
+        uint16_t sample = samples[slot];
+        if (count[slot] == 0)
+        {
+            low[slot] = high[slot] = sum[slot] = sample;
+            count[slot] = 1;
+            continue;
+        }
+        if (count[slot] >= TA_WINDOW_MAX)
+        {
+            sum[slot] >>= 1;
+            count[slot] >>= 1;
+        }
+        if (sample < low[slot])
+            low[slot] = sample;
+        if (sample > high[slot])
+            high[slot] = sample;
+        sum[slot] += sample;
+        count[slot]++;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method turns the windows of the channels which are being sent into samples,
+ *  replacing each channel's latest reading with the mean of its window, and starts
+ *  the windows afresh. The lowest and highest readings of the chosen channels whose
+ *  windows have more than one reading are written out as the frame's spread.
+ *  @param channel_map A bitmap of the slots which are being sent
+ *  @param samples An array of readings indexed by slot, whose sent readings are
+ *      replaced by the means of their windows
+ *  @param extremes An array of 2 * TLM_SPREAD_MAX numbers into which the lowest and
+ *      highest readings are put, a pair for each slot in the spread, in slot order
+ *  @return A bitmap of the slots whose spreads were written
+ */
+
+uint32_t tlm_aggregate::take (uint32_t channel_map, uint16_t* samples, 
+                             uint16_t* extremes)
+{
+    uint32_t spread = 0;
+    uint8_t spreads = 0;
+
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        uint32_t bit = 1UL << slot;
+        if (!(channel_map & bit) || count[slot] == 0)
+            continue;
+
+        if (count[slot] > 1)
+        {
+            uint8_t unit = (coarse_map & bit) ? 2 : 0;
+            samples[slot] = (((sum[slot] >> unit) + (count[slot] >> 1)) / count[slot])
+                            << unit;
+            if ((spread_map & bit) && spreads < TLM_SPREAD_MAX)
+            {
+                *extremes++ = low[slot];
+                *extremes++ = high[slot];
+                spread |= bit;
+                spreads++;
+            }
+        }
+        count[slot] = 0;
+    }
+
+    return (spread);
+}
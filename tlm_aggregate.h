@@ -0,0 +1,78 @@
+//======================================================================================
+/** \file  tlm_aggregate.h
+ *  This file contains the aggregator which summarizes the readings on each channel
+ *  which the downlink skips. When the link is congested, the rate controller (see
+ *  tlm_rate.h) sends only one of every few readings on a channel; sent as it stands,
+ *  that reading would hide whatever happened in between, such as the shock on the
+ *  load cells as the canopy opens. So every reading is added to its channel's window
+ *  as it arrives, keeping the lowest, the highest and a running sum, and when the
+ *  channel is next sent its sample is the mean of the window. Chosen channels send
+ *  the lowest and highest readings too, as the spread of the frame (see tlm_frame.h),
+ *  so the ground sees the peaks without the full rate stream. Only a few channels
+ *  are chosen, as the spread takes three times the bytes of the samples it covers,
+ *  which a congested link can least afford.
+ *
+ *  Adding a reading takes a compare or two and an add; working out a mean takes a
+ *  division, but only once per sent sample. Windows on a channel at full rate have
+ *  one reading, which is sent as it is.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _TLM_AGGREGATE_H_                   // To prevent *.h file from being included
+#define _TLM_AGGREGATE_H_                   // in a source file more than once
+
+#include <stdint.h>
+
+/** The most readings summed in a window; a window which grows longer is halved, so
+ *  the sum of 12-bit readings fits in 16 bits */
+#define TA_WINDOW_MAX       16
+
+
+//-------------------------------------------------------------------------------------
+/** This class keeps a window of readings for each channel, from the last time the
+ *  channel was sent. The sensor task calls add() with every scan and take() with the
+ *  channels which are to be sent in it.
+ */
+
+class tlm_aggregate
+{
+    protected:
+        uint16_t low[TLM_MAX_CHANNELS];     // Lowest reading in each window
+        uint16_t high[TLM_MAX_CHANNELS];    // Highest reading in each window
+        uint16_t sum[TLM_MAX_CHANNELS];     // Sum of the readings in each window
+        uint8_t count[TLM_MAX_CHANNELS];    // Number of readings in each window
+        uint32_t spread_map;                // Channels which send their spread
+        uint32_t coarse_map;                // Channels which have only 10 bits
+
+    public:
+        // The constructor creates empty windows, with no channels sending spreads
+        tlm_aggregate (void);
+
+        // This method adds readings to the windows of their channels
+        void add (uint32_t, const uint16_t*);
+
+        // This method turns the windows of channels being sent into samples
+        uint32_t take (uint32_t, uint16_t*, uint16_t*);
+
+        /** This method chooses the channels which send their lowest and highest
+         *  readings, one bit per slot; no more than TLM_SPREAD_MAX are sent in a
+         *  frame, lowest slots first. */
+        void set_channels (uint32_t a_map) { spread_map = a_map; }
+
+        /** This method returns the channels which send their spread. */
+        uint32_t get_channels (void) { return (spread_map); }
+
+        /** This method tells which channels have only 10 bits of resolution, shifted
+         *  up to 12; their means are kept in 10-bit units, as the compressed frames
+         *  code those channels' samples in them. */
+        void set_coarse (uint32_t a_map) { coarse_map = a_map; }
+};
+
+#endif // _TLM_AGGREGATE_H_
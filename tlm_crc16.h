@@ -0,0 +1,30 @@
+//======================================================================================
+/** \file  tlm_crc16.h
+ *  This file contains a table driven CRC-16 checksum which is used to check telemetry
+ *  frames. The polynomial is the CCITT one, 0x1021, with an initial value of 0xFFFF
+ *  (the variant often called CRC-16/CCITT-FALSE), so the check value for the ASCII
+ *  string "123456789" is 0x29B1. The same code builds for the AVR, where the table is
+ *  kept in flash, and for a PC running the ground station software. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TLM_CRC16_H_                       // To prevent *.h file from being included
+#define _TLM_CRC16_H_                       // in a source file more than once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** This is the value with which a new CRC computation must be started */
+#define TLM_CRC16_INIT      0xFFFF
+
+// This function computes the CRC of a block of bytes, continuing from a previous CRC
+uint16_t tlm_crc16 (const void*, size_t, uint16_t = TLM_CRC16_INIT);
+
+#endif // _TLM_CRC16_H_
@@ -0,0 +1,317 @@
+//======================================================================================
+/** \file  tlm_delta.cc
+ *  This file contains the lossless sample coder used by TLM_TYPE_DELTA12 telemetry
+ *  frames. See tlm_delta.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tlm_frame.h"
+#include "tlm_delta.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a bit writer which fills a buffer from its first byte.
+ *  @param a_buffer A pointer to the buffer
+ */
+
+tlm_bit_writer::tlm_bit_writer (uint8_t* a_buffer)
+{
+    p_byte = a_buffer;
+    used = 8;
+    bytes = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes the low bits of a number, most significant bit first. It takes
+ *  at most three passes through its loop, whatever the number of bits.
+ *  @param value The number to be written
+ *  @param count The number of bits to write, from 0 to 16
+ */
+
+void tlm_bit_writer::put (uint16_t value, uint8_t count)
+{
+    while (count > 0)
+    {
+        if (used == 8)
+        {
+            if (bytes > 0)
+                p_byte++;
+            *p_byte = 0;
+            used = 0;
+            bytes++;
+        }
+        uint8_t room = 8 - used;
+        uint8_t take = (count < room) ? count : room;
+        count -= take;
+        *p_byte |= (uint8_t)(((value >> count) & ((1 << take) - 1)) << (room - take));
+        used += take;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a bit reader for some data.
+ *  @param a_data A pointer to the first byte of the data
+ *  @param a_length The number of bytes of data
+ */
+
+tlm_bit_reader::tlm_bit_reader (const uint8_t* a_data, size_t a_length)
+{
+    p_byte = a_data;
+    p_end = a_data + a_length;
+    used = 0;
+    overrun = false;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads a number which was written with tlm_bit_writer::put(). If there
+ *  aren't enough bits left, zero bits are read and failed() will return true.
+ *  @param count The number of bits to read, from 0 to 16
+ *  @return The number which was read
+ */
+
+uint16_t tlm_bit_reader::get (uint8_t count)
+{
+    uint16_t value = 0;
+
+    while (count > 0)
+    {
+        if (p_byte >= p_end)
+        {
+            overrun = true;
+            return (value << count);
+        }
+        uint8_t room = 8 - used;
+        uint8_t take = (count < room) ? count : room;
+        value = (value << take) | ((*p_byte >> (room - take)) & ((1 << take) - 1));
+        count -= take;
+        used += take;
+        if (used == 8)
+        {
+            p_byte++;
+            used = 0;
+        }
+    }
+    return (value);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a predictor in which no slot has a previous sample, so
+ *  the first sample on every slot is sent whole.
+ */
+
+tlm_predictor::tlm_predictor (void)
+{
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        previous[slot] = 0;
+        sum[slot] = TD_START_SIZE;
+        runs[slot] = 1;
+    }
+    coarse_map = 0;
+    valid_map = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method picks the Rice parameter for a slot, the smallest k for which 2^k
+ *  times the number of recent differences is at least their sum. That's about the
+ *  size of an average difference in bits.
+ *  @param slot The slot number
+ *  @return The Rice parameter, from 0 to TD_MAX_K
+ */
+
+uint8_t tlm_predictor::rice_k (uint8_t slot)
+{
+    uint8_t k = 0;
+    while (k < TD_MAX_K && ((uint16_t)runs[slot] << k) < sum[slot])
+        k++;
+    return (k);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the difference between a sample and the previous one on its
+ *  slot, zig-zag mapped so that small differences of either sign are small numbers.
+ *  Slots with only 10 bits have their differences taken in 10-bit units.
+ *  @param slot The slot number
+ *  @param sample The 12-bit sample
+ *  @return The zig-zag coded difference
+ */
+
+uint16_t tlm_predictor::difference (uint8_t slot, uint16_t sample)
+{
+    uint8_t shift = (coarse_map & (1UL << slot)) ? 2 : 0;
+    int16_t diff = (int16_t)(sample >> shift) - (int16_t)(previous[slot] >> shift);
+    return ((uint16_t)((uint16_t)diff << 1) ^ (uint16_t)(diff >> 15));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes note of a sample which was coded as a difference, adding the
+ *  difference into the running sum which picks the slot's Rice parameter. Big 
+ *  differences are cut down to TD_SUM_LIMIT so that the sum can't overflow.
+ *  @param slot The slot number
+ *  @param sample The 12-bit sample
+ *  @param code The zig-zag coded difference
+ */
+
+void tlm_predictor::learn (uint8_t slot, uint16_t sample, uint16_t code)
+{
+    previous[slot] = sample;
+    sum[slot] += (code < TD_SUM_LIMIT) ? code : TD_SUM_LIMIT;
+    if (++runs[slot] >= TD_HALVE_EVERY)
+    {
+        sum[slot] >>= 1;
+        runs[slot] >>= 1;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts a slot afresh from a sample which was sent whole.
+ *  @param slot The slot number
+ *  @param sample The 12-bit sample
+ *  @param coarse True if the slot has only 10 bits of resolution
+ */
+
+void tlm_predictor::restart (uint8_t slot, uint16_t sample, bool coarse)
+{
+    uint32_t bit = 1UL << slot;
+
+    previous[slot] = sample;
+    sum[slot] = TD_START_SIZE;
+    runs[slot] = 1;
+    valid_map |= bit;
+    if (coarse)
+        coarse_map |= bit;
+    else
+        coarse_map &= ~bit;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts a slot afresh from a sample which was sent in an ordinary
+ *  12-bit frame, which doesn't say whether the slot has only 10 bits, so the slot 
+ *  keeps the resolution it had. Both ends call this for every sample in such frames.
+ *  @param slot The slot number
+ *  @param sample The 12-bit sample
+ */
+
+void tlm_predictor::take (uint8_t slot, uint16_t sample)
+{
+    restart (slot, sample, (coarse_map & (1UL << slot)) != 0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds how many bits code() would write for a sample, without changing
+ *  anything, so the sender can tell whether coding a frame is worth it.
+ *  @param slot The slot number
+ *  @param sample The 12-bit sample
+ *  @param whole True to send the sample whole, starting the slot afresh
+ *  @param coarse True if the slot has only 10 bits of resolution
+ *  @return The number of bits
+ */
+
+uint8_t tlm_predictor::code_bits (uint8_t slot, uint16_t sample, bool whole,
+                                  bool coarse)
+{
+    if (!whole && is_valid (slot))
+    {
+        uint8_t k = rice_k (slot);
+        uint16_t quotient = difference (slot, sample) >> k;
+        if (quotient < TD_ESCAPE)
+            return ((uint8_t)quotient + 1 + k);
+    }
+    return (TD_ESCAPE + 1 + (coarse ? 10 : 12));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes the code for a sample and takes note of the sample, just as
+ *  decode() will at the other end.
+ *  @param slot The slot number
+ *  @param sample The 12-bit sample
+ *  @param whole True to send the sample whole, starting the slot afresh
+ *  @param coarse True if the slot has only 10 bits of resolution
+ *  @param writer The bit writer into which the code goes
+ */
+
+void tlm_predictor::code (uint8_t slot, uint16_t sample, bool whole, bool coarse,
+                          tlm_bit_writer& writer)
+{
+    if (!whole && is_valid (slot))
+    {
+        uint8_t k = rice_k (slot);
+        uint16_t diff = difference (slot, sample);
+        uint16_t quotient = diff >> k;
+        if (quotient < TD_ESCAPE)
+        {
+            writer.put (((1 << quotient) - 1) << 1, quotient + 1);
+            writer.put (diff, k);
+            learn (slot, sample, diff);
+            return;
+        }
+    }
+
+    writer.put ((1 << TD_ESCAPE) - 1, TD_ESCAPE);
+    writer.put (coarse ? 1 : 0, 1);
+    if (coarse)
+        writer.put (sample >> 2, 10);
+    else
+        writer.put (sample, 12);
+    restart (slot, sample, coarse);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads the code for one sample. A difference can only be decoded if
+ *  the slot has a previous sample; if it doesn't, the slot's Rice parameter isn't
+ *  known either, so nothing after it in the frame can be read.
+ *  @param slot The slot number
+ *  @param reader The bit reader from which the code comes
+ *  @param sample A variable into which the 12-bit sample is put
+ *  @return True if the sample was decoded, false if it couldn't be
+ */
+
+bool tlm_predictor::decode (uint8_t slot, tlm_bit_reader& reader, uint16_t& sample)
+{
+    uint8_t quotient = 0;
+    while (quotient < TD_ESCAPE && reader.get (1))
+        quotient++;
+
+    if (quotient == TD_ESCAPE)
+    {
+        bool coarse = reader.get (1);
+        sample = coarse ? reader.get (10) << 2 : reader.get (12);
+        restart (slot, sample, coarse);
+        return (!reader.failed ());
+    }
+
+    if (!is_valid (slot))
+        return (false);
+
+    uint8_t k = rice_k (slot);
+    uint16_t diff = ((uint16_t)quotient << k) | reader.get (k);
+    int16_t change = (int16_t)(diff >> 1) ^ -(int16_t)(diff & 1);
+    if (coarse_map & (1UL << slot))
+        sample = (uint16_t)((uint16_t)((previous[slot] >> 2) + change) << 2) & 0x0FFF;
+    else
+        sample = (uint16_t)(previous[slot] + change) & 0x0FFF;
+    learn (slot, sample, diff);
+    return (!reader.failed ());
+}
@@ -0,0 +1,169 @@
+//======================================================================================
+/** \file  tlm_delta.h
+ *  This file contains the lossless sample coder used by TLM_TYPE_DELTA12 telemetry
+ *  frames. Each sample is sent as the difference from the previous sample sent on
+ *  the same slot; the difference is zig-zag mapped to a positive number (0, -1, 1,
+ *  -2, 2 become 0, 1, 2, 3, 4) and written with a Rice code, which is the number
+ *  divided by 2^k written in unary (that many one bits and a zero) followed by the
+ *  low k bits. The parameter k is picked for each slot from the average size of its
+ *  recent differences, which the sender and the receiver both keep track of, so it
+ *  doesn't have to be sent. Slowly changing channels such as static pressure cost
+ *  two or three bits a sample instead of twelve.
+ *
+ *  If a code's unary part would be TD_ESCAPE bits or more, TD_ESCAPE one bits are
+ *  sent instead, followed by a bit which is set for a slot which only has 10 bits of
+ *  resolution and then the sample itself, 10 or 12 bits, rather than a difference.
+ *  The same escape is used to start a slot afresh, a few slots in each frame, after
+ *  every frame which has an absolute time, so that a receiver which lost a frame 
+ *  gets back in step. Samples in ordinary 12-bit frames also start their slots 
+ *  afresh at both ends, but don't say which slots have only 10 bits. No sample takes
+ *  more than TD_ESCAPE + 13 bits, so the time to code a frame is bounded.
+ *
+ *  This file and tlm_delta.cc build both for the AVR and for the ground station PC.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _TLM_DELTA_H_                       // To prevent *.h file from being included
+#define _TLM_DELTA_H_                       // in a source file more than once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** The length of the unary part which means that a whole sample follows */
+#define TD_ESCAPE           12
+
+/** The largest Rice parameter; differences of 12-bit samples need up to 13 bits */
+#define TD_MAX_K            12
+
+/** The size of the differences a slot is assumed to have when it starts afresh */
+#define TD_START_SIZE       4
+
+/** The number of differences after which the running sums are halved, so that the
+ *  Rice parameter follows changes in how noisy a channel is */
+#define TD_HALVE_EVERY      16
+
+/** The most one difference adds to the running sum; TD_HALVE_EVERY of them must fit
+ *  in 16 bits */
+#define TD_SUM_LIMIT        4095
+
+/** The most slots which are started afresh with an escape in one frame, so that the
+ *  frame stays shorter than an ordinary one */
+#define TD_RESTARTS         2
+
+
+//-------------------------------------------------------------------------------------
+/** This class writes numbers of up to 16 bits into a byte buffer, most significant
+ *  bit first. The buffer must be big enough; the coder works out the length first.
+ */
+
+class tlm_bit_writer
+{
+    protected:
+        uint8_t* p_byte;                    // The byte being filled
+        uint8_t used;                       // Bits of it already filled
+        size_t bytes;                       // Bytes begun so far
+
+    public:
+        // The constructor starts writing at the beginning of a buffer
+        tlm_bit_writer (uint8_t*);
+
+        // This method writes the low bits of a number
+        void put (uint16_t, uint8_t);
+
+        /** This method returns the number of bytes written, counting a partly
+         *  filled last byte, whose unused bits are zero. */
+        size_t length (void) { return (bytes); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class reads numbers written by a tlm_bit_writer, making sure it doesn't read
+ *  past the end of the data.
+ */
+
+class tlm_bit_reader
+{
+    protected:
+        const uint8_t* p_byte;              // The byte being read
+        const uint8_t* p_end;               // Just past the last byte of data
+        uint8_t used;                       // Bits of it already read
+        bool overrun;                       // Tried to read past the end
+
+    public:
+        // The constructor starts reading at the beginning of some data
+        tlm_bit_reader (const uint8_t*, size_t);
+
+        // This method reads a number of the given number of bits
+        uint16_t get (uint8_t);
+
+        /** This method returns the number of bytes read, counting a partly read one. */
+        size_t length (const uint8_t* p_start)
+            { return ((p_byte - p_start) + (used ? 1 : 0)); }
+
+        /** This method returns true if a read ran past the end of the data. */
+        bool failed (void) { return (overrun); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class keeps what the sender and the receiver both know about each slot: the
+ *  previous sample, the running size of its differences, and whether it has only 10
+ *  bits. The sender's and the receiver's copies change in the same way as samples
+ *  are coded and decoded, so they stay alike as long as no frame is lost.
+ */
+
+class tlm_predictor
+{
+    protected:
+        uint16_t previous[TLM_MAX_CHANNELS];    // Last sample coded on each slot
+        uint16_t sum[TLM_MAX_CHANNELS];         // Sum of recent coded differences
+        uint8_t runs[TLM_MAX_CHANNELS];         // Number of differences in the sum
+        uint32_t coarse_map;                    // Slots which have only 10 bits
+        uint32_t valid_map;                     // Slots which have a previous sample
+
+        // This method picks the Rice parameter for a slot
+        uint8_t rice_k (uint8_t);
+
+        // This method finds the zig-zag coded difference from the previous sample
+        uint16_t difference (uint8_t, uint16_t);
+
+        // This method takes note of a sample which was coded as a difference
+        void learn (uint8_t, uint16_t, uint16_t);
+
+        // This method starts a slot afresh from a sample sent with an escape
+        void restart (uint8_t, uint16_t, bool);
+
+    public:
+        // The constructor creates a predictor in which no slot has a sample yet
+        tlm_predictor (void);
+
+        // This method finds how many bits a sample will take, changing nothing
+        uint8_t code_bits (uint8_t, uint16_t, bool, bool);
+
+        // This method writes a sample's code and takes note of the sample
+        void code (uint8_t, uint16_t, bool, bool, tlm_bit_writer&);
+
+        // This method reads a sample's code, returning false if it can't be decoded
+        bool decode (uint8_t, tlm_bit_reader&, uint16_t&);
+
+        // This method starts a slot afresh from a sample sent in an ordinary frame
+        void take (uint8_t, uint16_t);
+
+        /** This method makes every slot start afresh, as when a frame was lost. */
+        void forget (void) { valid_map = 0; }
+
+        /** This method makes one slot start afresh. */
+        void forget (uint8_t slot) { valid_map &= ~(1UL << slot); }
+
+        /** This method returns true if a slot has a previous sample to go from. */
+        bool is_valid (uint8_t slot) { return ((valid_map & (1UL << slot)) != 0); }
+};
+
+#endif // _TLM_DELTA_H_
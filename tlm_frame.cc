@@ -0,0 +1,455 @@
+//======================================================================================
+/** \file  tlm_frame.cc
+ *  This file contains the code which builds binary telemetry frames. See tlm_frame.h
+ *  for a description of the frame format. The COBS and bit packing functions are 
+ *  used by the ground station decoder as well, so this file builds for the PC too. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Added command and reply frames
+ *    \li  10-18-26 DSC Added 12-bit sample frames for oversampled channels
+ *    \li  10-18-26 DSC Added compressed frames of Rice coded differences
+ *    \li  10-18-26 DSC Added the spread of decimated samples
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "tlm_crc16.h"
+#include "tlm_frame.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This function packs 10-bit numbers tightly into bytes, least significant bits 
+ *  first, so that four numbers fill exactly five bytes. The top six bits of each
+ *  number are ignored. 
+ *  @param samples A pointer to the numbers to be packed
+ *  @param count The number of numbers to pack
+ *  @param p_out A pointer to the buffer where the packed bytes go
+ *  @return The number of bytes written into the buffer
+ */
+
+size_t tlm_pack10 (const uint16_t* samples, uint8_t count, uint8_t* p_out)
+{
+    uint8_t* p_start = p_out;               // Remember where we started
+    uint16_t leftover = 0;                  // Bits which didn't fit in the last byte
+    uint8_t bits = 0;                       // How many bits are in the leftover
+
+    while (count--)
+    {
+        uint16_t sample = *samples++ & 0x03FF;
+
+        // Fill up the partly full byte, then save the bits which didn't fit. Each 
+        // sample leaves two more bits behind than the one before it did
+        *p_out++ = (uint8_t)(leftover | (sample << bits));
+        leftover = sample >> (8 - bits);
+        bits += 2;
+        if (bits == 8)
+        {
+            *p_out++ = (uint8_t)leftover;
+            leftover = 0;
+            bits = 0;
+        }
+    }
+    if (bits)
+        *p_out++ = (uint8_t)leftover;
+
+    return (p_out - p_start);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function unpacks 10-bit numbers which have been packed by tlm_pack10(). 
+ *  @param p_in A pointer to the packed bytes
+ *  @param count The number of numbers to unpack
+ *  @param samples A pointer to an array where the unpacked numbers are to be put
+ */
+
+void tlm_unpack10 (const uint8_t* p_in, uint8_t count, uint16_t* samples)
+{
+    uint32_t bit_buffer = 0;                // Bits read but not yet used
+    uint8_t bits = 0;                       // How many bits are in the bit buffer
+
+    while (count--)
+    {
+        while (bits < 10)
+        {
+            bit_buffer |= (uint32_t)(*p_in++) << bits;
+            bits += 8;
+        }
+        *samples++ = (uint16_t)(bit_buffer & 0x03FF);
+        bit_buffer >>= 10;
+        bits -= 10;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function packs 12-bit numbers into bytes, least significant bits first, so 
+ *  that two numbers fill exactly three bytes. The top four bits of each number are 
+ *  ignored. 
+ *  @param samples A pointer to the numbers to be packed
+ *  @param count The number of numbers to pack
+ *  @param p_out A pointer to the buffer where the packed bytes go
+ *  @return The number of bytes written into the buffer
+ */
+
+size_t tlm_pack12 (const uint16_t* samples, uint8_t count, uint8_t* p_out)
+{
+    uint8_t* p_start = p_out;               // Remember where we started
+
+    for ( ; count >= 2; count -= 2, samples += 2)
+    {
+        uint16_t first = samples[0] & 0x0FFF;
+        uint16_t second = samples[1] & 0x0FFF;
+        *p_out++ = (uint8_t)first;
+        *p_out++ = (uint8_t)((first >> 8) | (second << 4));
+        *p_out++ = (uint8_t)(second >> 4);
+    }
+    if (count)
+    {
+        *p_out++ = (uint8_t)*samples;
+        *p_out++ = (uint8_t)((*samples >> 8) & 0x0F);
+    }
+
+    return (p_out - p_start);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function unpacks 12-bit numbers which have been packed by tlm_pack12(). 
+ *  @param p_in A pointer to the packed bytes
+ *  @param count The number of numbers to unpack
+ *  @param samples A pointer to an array where the unpacked numbers are to be put
+ */
+
+void tlm_unpack12 (const uint8_t* p_in, uint8_t count, uint16_t* samples)
+{
+    for ( ; count >= 2; count -= 2, p_in += 3)
+    {
+        *samples++ = p_in[0] | ((uint16_t)(p_in[1] & 0x0F) << 8);
+        *samples++ = (p_in[1] >> 4) | ((uint16_t)p_in[2] << 4);
+    }
+    if (count)
+        *samples = p_in[0] | ((uint16_t)(p_in[1] & 0x0F) << 8);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function encodes a frame in place using Consistent Overhead Byte Stuffing,
+ *  then puts a zero after it to mark the end of the frame. The frame must start at
+ *  buffer[1]; buffer[0] is used for the first COBS code byte. The frame can be at 
+ *  most 253 bytes long, since longer frames would need extra code bytes inserted. 
+ *  @param buffer The buffer holding the frame, which must have room for two more 
+ *      bytes than the frame's length
+ *  @param length The number of bytes in the frame, starting at buffer[1]
+ *  @return The number of bytes to be sent, including the code byte and the zero
+ */
+
+size_t tlm_cobs_encode (uint8_t* buffer, size_t length)
+{
+    uint8_t* p_code = buffer;               // Where the current code byte goes
+    uint8_t code = 1;                       // Distance from there to the next zero
+
+    for (uint8_t* p_byte = buffer + 1; p_byte <= buffer + length; p_byte++)
+    {
+        if (*p_byte == 0)
+        {
+            *p_code = code;
+            p_code = p_byte;
+            code = 1;
+        }
+        else
+        {
+            code++;
+        }
+    }
+    *p_code = code;
+    buffer[length + 1] = 0;
+
+    return (length + 2);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function decodes a COBS encoded frame in place. The decoded frame begins at
+ *  the start of the buffer. 
+ *  @param buffer The buffer holding the encoded frame, without the ending zero
+ *  @param length The number of encoded bytes in the buffer
+ *  @return The number of bytes in the decoded frame, or 0 if the data wasn't valid
+ */
+
+size_t tlm_cobs_decode (uint8_t* buffer, size_t length)
+{
+    size_t in = 0;                          // Index of the next byte to be read
+    size_t out = 0;                         // Index where the next byte is written
+
+    while (in < length)
+    {
+        uint8_t code = buffer[in++];
+        if (code == 0)
+            return (0);
+
+        for (uint8_t count = 1; count < code; count++)
+        {
+            if (in >= length)
+                return (0);
+            buffer[out++] = buffer[in++];
+        }
+
+        // Each code except the last stands for a zero, unless it's the 0xFF code
+        if (code != 0xFF && in < length)
+            buffer[out++] = 0;
+    }
+
+    return (out);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function puts the CRC of a frame at its end, then COBS encodes the whole 
+ *  thing so it's ready to be sent. 
+ *  @param buffer A buffer holding the frame starting at buffer[1], with room for the
+ *      CRC, the COBS code byte and the ending zero
+ *  @param length The number of bytes in the frame, not counting buffer[0]
+ *  @return The number of bytes in the encoded frame, including the ending zero
+ */
+
+size_t tlm_seal (uint8_t* buffer, size_t length)
+{
+    uint16_t crc = tlm_crc16 (buffer + 1, length);
+    buffer[length + 1] = (uint8_t)crc;
+    buffer[length + 2] = (uint8_t)(crc >> 8);
+
+    return (tlm_cobs_encode (buffer, length + 2));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function builds an encoded command or reply frame. The ground station uses it
+ *  to send commands, and the aircraft uses it to answer them. 
+ *  @param buffer A buffer with room for at least TLM_MESSAGE_MAX bytes
+ *  @param type TLM_TYPE_COMMAND or TLM_TYPE_REPLY
+ *  @param sequence The sequence number of the command
+ *  @param code The command code
+ *  @param body The command's arguments, or the reply's result code and data
+ *  @param length The number of bytes in the body, at most TLM_BODY_MAX
+ *  @return The number of bytes in the encoded frame, or 0 if the body is too long
+ */
+
+size_t tlm_message (uint8_t* buffer, uint8_t type, uint8_t sequence, uint8_t code,
+                    const uint8_t* body, uint8_t length)
+{
+    if (length > TLM_BODY_MAX)
+        return (0);
+
+    buffer[1] = type;
+    buffer[2] = sequence;
+    buffer[3] = code;
+    memcpy (buffer + 4, body, length);
+
+    return (tlm_seal (buffer, 3 + length));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a telemetry frame encoder. The first frame it builds will
+ *  carry an absolute time stamp. 
+ */
+
+tlm_encoder::tlm_encoder (void)
+{
+    sequence = 0;
+    last_time = 0;
+    abs_countdown = 0;
+    sample_bits = 10;
+    compress = false;
+    coarse_map = 0;
+    restart_map = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method builds a COBS encoded sample frame which is ready to be sent. The time
+ *  is sent as the difference from the previous frame's time unless that difference
+ *  won't fit in 16 bits or it's time for a periodic absolute time stamp. 
+ *  @param buffer A buffer with room for at least TLM_FRAME_MAX bytes
+ *  @param time The time at which the samples were taken, in timer counts
+ *  @param channel_map A bitmap of the slots whose samples are to be sent
+ *  @param samples An array of samples, indexed by slot number, with at least as many
+ *      elements as the highest slot whose bit is set in the channel map
+ *  @param spread_map A bitmap of the slots whose lowest and highest readings are
+ *      sent, which must be in the channel map; only the first TLM_SPREAD_MAX go
+ *  @param extremes The lowest and highest readings, a pair for each slot in the 
+ *      spread map, lowest slot first; may be NULL if the spread map is empty
+ *  @return The number of bytes in the encoded frame, including the ending zero
+ */
+
+size_t tlm_encoder::encode (uint8_t* buffer, uint32_t time, uint32_t channel_map,
+                            const uint16_t* samples, uint32_t spread_map, 
+                            const uint16_t* extremes)
+{
+    uint8_t* p_byte = buffer + 1;           // Leave room for the COBS code byte
+    uint16_t selected[TLM_MAX_CHANNELS];    // Samples whose slots are in the map
+    uint8_t count = 0;                      // How many samples were selected
+    uint32_t delta = time - last_time;      // Time since the last frame
+    uint8_t type = (sample_bits == 12) ? TLM_TYPE_SAMPLES12 : TLM_TYPE_SAMPLES;
+
+    channel_map &= (1UL << TLM_MAX_CHANNELS) - 1;
+    spread_map &= channel_map;
+    if (spread_map != 0)
+        type |= TLM_SPREAD;
+
+    // Write the frame type and sequence number, then the time stamp. A frame with an
+    // absolute time starts every slot afresh so the ground can get back in step
+    uint8_t* p_type = p_byte;
+    if (abs_countdown == 0 || delta > 0xFFFF)
+    {
+        restart_map = (1UL << TLM_MAX_CHANNELS) - 1;
+        *p_byte++ = type | TLM_ABS_TIME;
+        *p_byte++ = sequence;
+        *p_byte++ = (uint8_t)time;
+        *p_byte++ = (uint8_t)(time >> 8);
+        *p_byte++ = (uint8_t)(time >> 16);
+        *p_byte++ = (uint8_t)(time >> 24);
+        abs_countdown = TLM_ABS_TIME_EVERY;
+    }
+    else
+    {
+        *p_byte++ = type;
+        *p_byte++ = sequence;
+        *p_byte++ = (uint8_t)delta;
+        *p_byte++ = (uint8_t)(delta >> 8);
+    }
+    abs_countdown--;
+    sequence++;
+    last_time = time;
+
+    // Write the channel bitmap, and the spread if there is one. The frame buffer only
+    // has room for TLM_SPREAD_MAX slots' spreads, so any beyond them are left out
+    *p_byte++ = (uint8_t)channel_map;
+    *p_byte++ = (uint8_t)(channel_map >> 8);
+    *p_byte++ = (uint8_t)(channel_map >> 16);
+    if (spread_map != 0)
+    {
+        uint8_t spreads = 0;
+        for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+        {
+            if (spread_map & (1UL << slot))
+            {
+                if (spreads < TLM_SPREAD_MAX)
+                    spreads++;
+                else
+                    spread_map &= ~(1UL << slot);
+            }
+        }
+        *p_byte++ = (uint8_t)spread_map;
+        *p_byte++ = (uint8_t)(spread_map >> 8);
+        *p_byte++ = (uint8_t)(spread_map >> 16);
+        p_byte += tlm_pack12 (extremes, 2 * spreads, p_byte);
+    }
+
+    // Pick out the samples which the channel bitmap says to send
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        if (channel_map & (1UL << slot))
+            selected[count++] = samples[slot];
+    }
+
+    size_t coded = 0;
+    if (compress && sample_bits == 12)
+        coded = code_samples (p_byte, channel_map, samples, count);
+    if (coded > 0)
+    {
+        *p_type = TLM_TYPE_DELTA12 | (*p_type & (TLM_ABS_TIME | TLM_SPREAD));
+        p_byte += coded;
+    }
+    else if (sample_bits == 12)
+        p_byte += tlm_pack12 (selected, count, p_byte);
+    else
+        p_byte += tlm_pack10 (selected, count, p_byte);
+
+    return (tlm_seal (buffer, p_byte - (buffer + 1)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method codes a frame's samples as differences (see tlm_delta.h), but only if
+ *  that takes fewer bytes than packing them as 12-bit numbers. Up to TD_RESTARTS of 
+ *  the slots waiting to be started afresh are sent with escapes, lowest slot first. 
+ *  The length is worked out first without changing anything; if the samples aren't
+ *  coded, they start their slots afresh just as they will on the ground. Each sample
+ *  takes at most TD_ESCAPE + 13 bits, so the time this takes is bounded by the 
+ *  number of samples. 
+ *  @param buffer The place in the frame where the coded samples go
+ *  @param channel_map A bitmap of the slots whose samples are sent
+ *  @param samples An array of 12-bit samples indexed by slot number
+ *  @param count The number of slots in the bitmap
+ *  @return The number of bytes of coded samples, or 0 if they weren't coded
+ */
+
+size_t tlm_encoder::code_samples (uint8_t* buffer, uint32_t channel_map, 
+                                  const uint16_t* samples, uint8_t count)
+{
+    uint32_t whole_map = 0;                 // Slots started afresh in this frame
+    uint8_t restarts = 0;
+    uint16_t bits = 0;
+
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        uint32_t bit = 1UL << slot;
+        if (!(channel_map & bit))
+            continue;
+        if ((restart_map & bit) && restarts < TD_RESTARTS)
+        {
+            whole_map |= bit;
+            restarts++;
+        }
+        bits += predictor.code_bits (slot, samples[slot], (whole_map & bit) != 0,
+                                     (coarse_map & bit) != 0);
+    }
+
+    if ((bits + 7) / 8 >= ((uint16_t)count * 12 + 7) / 8)
+    {
+        for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+        {
+            if (channel_map & (1UL << slot))
+                predictor.take (slot, samples[slot]);
+        }
+        return (0);
+    }
+
+    tlm_bit_writer writer (buffer);
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        uint32_t bit = 1UL << slot;
+        if (channel_map & bit)
+            predictor.code (slot, samples[slot], (whole_map & bit) != 0, 
+                            (coarse_map & bit) != 0, writer);
+    }
+    restart_map &= ~whole_map;
+
+    return (writer.length ());
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method turns compression on or off. Compressed frames are only sent when 
+ *  samples are 12 bits. The slots whose samples have only 10 bits of resolution, 
+ *  shifted up to 12, are coded in 10-bit units; their low two bits must be zero, or
+ *  they'll be lost. Every slot is started afresh with its next sample. 
+ *  @param on True to send compressed frames
+ *  @param a_coarse_map A bitmap of the slots which have only 10 bits of resolution
+ */
+
+void tlm_encoder::set_compress (bool on, uint32_t a_coarse_map)
+{
+    compress = on;
+    coarse_map = a_coarse_map;
+    restart_map = (1UL << TLM_MAX_CHANNELS) - 1;
+}
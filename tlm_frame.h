@@ -0,0 +1,217 @@
+//======================================================================================
+/** \file  tlm_frame.h
+ *  This file contains the binary telemetry frame format which is used to send sensor
+ *  data to the ground through the radio modem. A frame is laid out as follows before
+ *  it is COBS encoded: 
+ *
+ *      \li  1 byte   Frame type in the low bits, TLM_SPREAD flag in bit 6 and
+ *                    TLM_ABS_TIME flag in bit 7
+ *      \li  1 byte   Sequence number, which counts up by one for every frame sent
+ *      \li  2 bytes  Time since the previous frame in timer counts, or 4 bytes of
+ *                    absolute time if the TLM_ABS_TIME flag is set
+ *      \li  3 bytes  Channel bitmap; bit n is set if slot n has a sample in the frame
+ *      \li  3 bytes  Spread bitmap, only if the TLM_SPREAD flag is set; bit n is set
+ *                    if slot n has its lowest and highest readings in the frame
+ *      \li  N bytes  The lowest and highest readings for the set bits of the spread
+ *                    bitmap, a pair for each slot, packed as 12-bit numbers
+ *      \li  N bytes  The samples for the set bits, lowest slot first, packed as 10-bit
+ *                    numbers so that four samples take five bytes; in a frame of type
+ *                    TLM_TYPE_SAMPLES12 they're 12-bit numbers, two in three bytes
+ *      \li  2 bytes  CRC-16 (see tlm_crc16.h) of all the bytes above
+ *
+ *  All multi-byte numbers are little-endian. The frame is then encoded with Consistent
+ *  Overhead Byte Stuffing, which removes every zero byte at a cost of one extra byte
+ *  for frames this short, and a single zero byte is sent to mark the end of the 
+ *  frame. A receiver which starts listening in the middle of a frame, or which loses 
+ *  a byte, is back in step at the next zero without any special sync pattern. A full
+ *  18 channel frame is 34 bytes on the radio, where the old ASCII printouts took 
+ *  about 15 bytes for each sample. When some channels are oversampled to get more 
+ *  than 10 bits, every sample in the frame is sent as a 12-bit number, scaled so that
+ *  4096 is full scale on every channel, and the frame type says so. 
+ *
+ *  When compression is turned on, the samples in a 12-bit frame are sent as Rice 
+ *  coded differences from the previous samples on the same slots (see tlm_delta.h) 
+ *  in a frame of type TLM_TYPE_DELTA12, whose layout is otherwise the same. The 
+ *  codes are packed most significant bit first and the last byte is padded with 
+ *  zeros. If coding a frame's samples wouldn't make it shorter, it's sent as an 
+ *  ordinary TLM_TYPE_SAMPLES12 frame, whose samples become the previous ones for 
+ *  the coder at both ends. After every frame with an absolute time, the slots are 
+ *  started afresh a few at a time, so a receiver which lost a frame can decode every
+ *  slot again soon after the next one. 
+ *
+ *  When the downlink is thinned out, a sample may stand for several readings which
+ *  weren't sent; it's then the mean of them, and for a few chosen slots the frame's
+ *  spread gives the lowest and highest of them too (see tlm_aggregate.h). The
+ *  spread is in the same units as the samples but never compressed. 
+ *
+ *  Commands from the ground and the aircraft's replies to them use the same CRC and 
+ *  COBS framing, with a shorter layout before encoding: 
+ *
+ *      \li  1 byte   Frame type, TLM_TYPE_COMMAND or TLM_TYPE_REPLY
+ *      \li  1 byte   Sequence number chosen by the ground; a reply has the sequence
+ *                    number of the command it answers
+ *      \li  1 byte   Command code, such as TLM_CMD_CHANNELS
+ *      \li  N bytes  For a command, its arguments; for a reply, a result code such as
+ *                    TLM_OK followed by any data the command returns
+ *      \li  2 bytes  CRC-16 of all the bytes above
+ *
+ *  This file and tlm_frame.cc build both for the AVR and for the ground station PC. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Added command and reply frames
+ *    \li  10-18-26 DSC Added 12-bit sample frames for oversampled channels
+ *    \li  10-18-26 DSC Added compressed frames of Rice coded differences
+ *    \li  10-18-26 DSC Added the spread of decimated samples
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TLM_FRAME_H_                       // To prevent *.h file from being included
+#define _TLM_FRAME_H_                       // in a source file more than once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Frame type code for a frame holding raw samples from the A/D channels */
+#define TLM_TYPE_SAMPLES    0x01
+
+/** Frame type code for a reply from the aircraft to a command */
+#define TLM_TYPE_REPLY      0x02
+
+/** Frame type code for a command sent up from the ground */
+#define TLM_TYPE_COMMAND    0x03
+
+/** Frame type code for a frame holding 12-bit samples from oversampled channels */
+#define TLM_TYPE_SAMPLES12  0x04
+
+/** Frame type code for a frame holding 12-bit samples coded as differences */
+#define TLM_TYPE_DELTA12    0x05
+
+/** Mask which extracts the frame type from the first byte of a frame */
+#define TLM_TYPE_MASK       0x3F
+
+/** Flag in the type byte which means the frame holds a spread bitmap and readings */
+#define TLM_SPREAD          0x40
+
+/** Flag in the type byte which means the frame holds a 4-byte absolute time stamp */
+#define TLM_ABS_TIME        0x80
+
+/** The greatest number of channels which the channel bitmap can describe */
+#define TLM_MAX_CHANNELS    24
+
+/** The greatest number of slots which can have a spread in one frame */
+#define TLM_SPREAD_MAX      8
+
+/** An absolute time stamp is sent at least this often so that the ground station can
+ *  recover the time after losing a frame */
+#define TLM_ABS_TIME_EVERY  16
+
+/** The greatest number of bytes in a frame before COBS encoding */
+#define TLM_RAW_MAX         (1 + 1 + 4 + 3 + 3 + TLM_SPREAD_MAX * 3 \
+                             + (TLM_MAX_CHANNELS * 12 + 7) / 8 + 2)
+
+/** The greatest number of bytes in an encoded frame, including the COBS code byte 
+ *  and the zero byte which ends the frame */
+#define TLM_FRAME_MAX       (TLM_RAW_MAX + 2)
+
+// Command codes, with the arguments each one takes
+#define TLM_CMD_PING        0x01            // None; just replies, to check the link
+#define TLM_CMD_INTERVAL    0x02            // Task number (1 byte), interval in us (4)
+#define TLM_CMD_CHANNELS    0x03            // Bitmap of the slots to send (3 bytes)
+#define TLM_CMD_DUMP        0x04            // None; replies with link statistics
+#define TLM_CMD_SPREAD      0x05            // Bitmap of the slots to spread (3 bytes)
+#define TLM_CMD_SENSORS     0x06            // None; replies with sensor task statistics
+#define TLM_CMD_NOISE       0x07            // First channel (1 byte); replies with the
+                                            // bits and noise of the channels from there
+#define TLM_CMD_SCAN        0x08            // Noise comparison off or on (1 byte);
+                                            // replies with the A/D scan timing
+#define TLM_CMD_FILTERS     0x09            // First slot (1 byte); replies with the
+                                            // cycles each slot's filter takes
+#define TLM_CMD_LOG         0x0A            // None; replies with flight log statistics
+#define TLM_CMD_ATTITUDE    0x0B            // None; replies with the relative attitude
+                                            // and the attitude updates' processor time
+
+// Result codes which begin the data in a reply
+#define TLM_OK              0x00            // The command was carried out
+#define TLM_ERR_COMMAND     0x01            // The command code isn't known
+#define TLM_ERR_ARGUMENT    0x02            // An argument is missing or out of range
+
+/** The greatest number of bytes following the command code in a command or reply */
+#define TLM_BODY_MAX        24
+
+/** The greatest number of bytes in an encoded command or reply */
+#define TLM_MESSAGE_MAX     (1 + 1 + 1 + TLM_BODY_MAX + 2 + 2)
+
+
+// This function packs 10-bit numbers into bytes, four numbers in five bytes
+size_t tlm_pack10 (const uint16_t*, uint8_t, uint8_t*);
+
+// This function unpacks 10-bit numbers which were packed by tlm_pack10()
+void tlm_unpack10 (const uint8_t*, uint8_t, uint16_t*);
+
+// This function packs 12-bit numbers into bytes, two numbers in three bytes
+size_t tlm_pack12 (const uint16_t*, uint8_t, uint8_t*);
+
+// This function unpacks 12-bit numbers which were packed by tlm_pack12()
+void tlm_unpack12 (const uint8_t*, uint8_t, uint16_t*);
+
+// This function COBS encodes a frame in place and adds the zero which ends it
+size_t tlm_cobs_encode (uint8_t*, size_t);
+
+// This function decodes a COBS encoded frame in place
+size_t tlm_cobs_decode (uint8_t*, size_t);
+
+// This function adds the CRC to a frame and COBS encodes it
+size_t tlm_seal (uint8_t*, size_t);
+
+// This function builds an encoded command or reply frame
+size_t tlm_message (uint8_t*, uint8_t, uint8_t, uint8_t, const uint8_t*, uint8_t);
+
+#include "tlm_delta.h"                      // Coder for compressed frames, which needs
+                                            // TLM_MAX_CHANNELS from above
+
+//-------------------------------------------------------------------------------------
+/** This class builds telemetry frames. It keeps the sequence number and the time of 
+ *  the previous frame, which are needed to fill in each new frame's header. 
+ */
+
+class tlm_encoder
+{
+    protected:
+        uint8_t sequence;                   // Sequence number of the next frame
+        uint32_t last_time;                 // Time stamp of the previous frame
+        uint8_t abs_countdown;              // Frames left until an absolute time
+        uint8_t sample_bits;                // Bits in each sample, 10 or 12
+        bool compress;                      // 12-bit samples are sent as differences
+        uint32_t coarse_map;                // Slots whose samples have only 10 bits
+        uint32_t restart_map;               // Slots to be started afresh
+        tlm_predictor predictor;            // What the ground knows of each slot
+
+        // This method codes the samples as differences, if that makes them shorter
+        size_t code_samples (uint8_t*, uint32_t, const uint16_t*, uint8_t);
+
+    public:
+        // The constructor sets up an encoder whose first frame has absolute time
+        tlm_encoder (void);
+
+        // This method builds an encoded sample frame in the given buffer
+        size_t encode (uint8_t*, uint32_t, uint32_t, const uint16_t*, uint32_t = 0,
+                       const uint16_t* = NULL);
+
+        /** This method makes the next frame carry an absolute time stamp. It should 
+         *  be called if frames may have been lost on the way to the ground. */
+        void resync (void) { abs_countdown = 0; }
+
+        /** This method sets whether samples are sent as 10-bit or 12-bit numbers. 
+         *  Samples sent with 12 bits must be scaled to 4096 full scale. */
+        void set_bits (uint8_t bits) { sample_bits = (bits > 10) ? 12 : 10; }
+
+        // This method turns compression of 12-bit samples on or off
+        void set_compress (bool, uint32_t = 0);
+};
+
+#endif // _TLM_FRAME_H_
@@ -0,0 +1,325 @@
+//======================================================================================
+/** \file  tlm_ground.cc
+ *  This file contains a telemetry decoder for the ground station. It builds on a PC,
+ *  not on the AVR. See tlm_frame.h for the frame format. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Decode replies to ground commands
+ *    \li  10-18-26 DSC Decode 12-bit sample frames
+ *    \li  10-18-26 DSC Decode compressed frames of Rice coded differences
+ *    \li  10-18-26 DSC Decode the spread of decimated samples
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "tlm_crc16.h"
+#include "tlm_frame.h"
+#include "tlm_delta.h"
+#include "tlm_ground.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a telemetry decoder. If the decoder starts listening in
+ *  the middle of a frame, that partial frame will fail its CRC check and be counted 
+ *  as a bad frame; decoding is in step from the first zero byte on. 
+ */
+
+tlm_decoder::tlm_decoder (void)
+{
+    fill = 0;
+    overflow = false;
+    have_previous = false;
+    last_sequence = 0;
+    memset (&frame, 0, sizeof (frame));
+    memset (&reply, 0, sizeof (reply));
+
+    good_count = 0;
+    crc_errors = 0;
+    format_errors = 0;
+    lost_count = 0;
+    undecoded_count = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes one byte received from the radio. Bytes are saved until a zero
+ *  marks the end of a frame; the frame is then decoded and checked. 
+ *  @param byte The byte which was received
+ *  @return True if the byte completed a valid frame, which can be read with 
+ *      get_frame(), and false otherwise
+ */
+
+bool tlm_decoder::feed (uint8_t byte)
+{
+    if (byte != 0)
+    {
+        if (fill < sizeof (buffer))
+            buffer[fill++] = byte;
+        else
+            overflow = true;
+        return (false);
+    }
+
+    // A zero ends the frame. Empty frames are just extra delimiters, not errors
+    size_t length = fill;
+    bool was_overflow = overflow;
+    fill = 0;
+    overflow = false;
+
+    if (length == 0)
+        return (false);
+    if (was_overflow)
+    {
+        format_errors++;
+        return (false);
+    }
+
+    length = tlm_cobs_decode (buffer, length);
+    if (length == 0)
+    {
+        format_errors++;
+        return (false);
+    }
+    return (parse (length));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks the CRC of a decoded frame, then takes apart its contents and
+ *  puts them in the frame structure. 
+ *  @param length The number of decoded bytes in the buffer
+ *  @return True if the frame was valid and false if not
+ */
+
+bool tlm_decoder::parse (size_t length)
+{
+    // Check the CRC, which is sent low byte first after the rest of the frame
+    if (length < 3)
+    {
+        format_errors++;
+        return (false);
+    }
+    length -= 2;
+    uint16_t crc = buffer[length] | ((uint16_t)buffer[length + 1] << 8);
+    if (tlm_crc16 (buffer, length) != crc)
+    {
+        crc_errors++;
+        return (false);
+    }
+
+    // Find out what kind of frame it is and how long its header must be
+    uint8_t type = buffer[0] & TLM_TYPE_MASK;
+    if (type == TLM_TYPE_REPLY)
+        return (parse_reply (length));
+
+    bool absolute = (buffer[0] & TLM_ABS_TIME) != 0;
+    size_t header = absolute ? 9 : 7;
+    if ((type != TLM_TYPE_SAMPLES && type != TLM_TYPE_SAMPLES12 
+         && type != TLM_TYPE_DELTA12) || length < header)
+    {
+        format_errors++;
+        return (false);
+    }
+
+    // Keep track of lost frames; if any were lost, the time isn't known until the
+    // next frame which has an absolute time stamp in it, and compressed samples
+    // can't be decoded until their slots are started afresh
+    uint8_t sequence = buffer[1];
+    if (have_previous && sequence != (uint8_t)(last_sequence + 1))
+    {
+        lost_count += (uint8_t)(sequence - last_sequence - 1);
+        frame.time_known = false;
+        predictor.forget ();
+    }
+    have_previous = true;
+    last_sequence = sequence;
+
+    const uint8_t* p_byte = buffer + 2;
+    if (absolute)
+    {
+        frame.time = (uint32_t)p_byte[0] | ((uint32_t)p_byte[1] << 8)
+                   | ((uint32_t)p_byte[2] << 16) | ((uint32_t)p_byte[3] << 24);
+        frame.time_known = true;
+        p_byte += 4;
+    }
+    else
+    {
+        frame.time += (uint32_t)p_byte[0] | ((uint32_t)p_byte[1] << 8);
+        p_byte += 2;
+    }
+
+    // Read the channel bitmap, then the spread if there is one; every slot in the
+    // spread must have a sample in the frame
+    uint32_t channel_map = (uint32_t)p_byte[0] | ((uint32_t)p_byte[1] << 8)
+                         | ((uint32_t)p_byte[2] << 16);
+    p_byte += 3;
+    frame.spread_map = 0;
+    if (buffer[0] & TLM_SPREAD)
+    {
+        if (length < header + 3)
+        {
+            format_errors++;
+            return (false);
+        }
+        uint32_t spread_map = (uint32_t)p_byte[0] | ((uint32_t)p_byte[1] << 8)
+                            | ((uint32_t)p_byte[2] << 16);
+        p_byte += 3;
+        uint8_t spreads = 0;
+        for (uint32_t bits = spread_map; bits != 0; bits >>= 1)
+            spreads += bits & 1;
+        header += 3 + ((size_t)spreads * 24 + 7) / 8;
+        if ((spread_map & ~channel_map) != 0 || spreads > TLM_SPREAD_MAX 
+            || length < header)
+        {
+            format_errors++;
+            return (false);
+        }
+
+        uint16_t extremes[2 * TLM_SPREAD_MAX];
+        tlm_unpack12 (p_byte, 2 * spreads, extremes);
+        p_byte += ((size_t)spreads * 24 + 7) / 8;
+        spreads = 0;
+        for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+        {
+            if (spread_map & (1UL << slot))
+            {
+                frame.lows[slot] = extremes[spreads++];
+                frame.highs[slot] = extremes[spreads++];
+            }
+        }
+        frame.spread_map = spread_map;
+    }
+
+    // Make sure the packed samples are all there
+    if (type == TLM_TYPE_DELTA12)
+        return (parse_delta (p_byte, length - header, sequence, channel_map));
+
+    uint8_t count = 0;
+    for (uint32_t bits = channel_map; bits != 0; bits >>= 1)
+        count += bits & 1;
+    uint8_t bits = (type == TLM_TYPE_SAMPLES12) ? 12 : 10;
+    if (length != header + ((size_t)count * bits + 7) / 8)
+    {
+        format_errors++;
+        return (false);
+    }
+
+    // Unpack the samples and spread them out into their slots
+    uint16_t packed[TLM_MAX_CHANNELS];
+    if (bits == 12)
+        tlm_unpack12 (p_byte, count, packed);
+    else
+        tlm_unpack10 (p_byte, count, packed);
+    memset (frame.samples, 0, sizeof (frame.samples));
+    count = 0;
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        if (channel_map & (1UL << slot))
+        {
+            frame.samples[slot] = packed[count++];
+            if (bits == 12)
+                predictor.take (slot, frame.samples[slot]);
+        }
+    }
+
+    frame.type = type;
+    frame.sequence = sequence;
+    frame.channel_map = channel_map;
+    good_count++;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method decodes the samples of a compressed frame (see tlm_delta.h), whose 
+ *  header has already been read. The samples are decoded in slot order. If one of 
+ *  them is a difference on a slot which has no previous sample, because a frame was
+ *  lost, nothing after it can be read; those slots are left out of the frame's 
+ *  channel map, counted as undecoded and started afresh, since the aircraft's coder 
+ *  went on without them. 
+ *  @param p_data A pointer to the first byte of coded samples
+ *  @param length The number of bytes of coded samples
+ *  @param sequence The frame's sequence number
+ *  @param channel_map The bitmap of slots which the frame has samples for
+ *  @return True if the frame was valid and false if not
+ */
+
+bool tlm_decoder::parse_delta (const uint8_t* p_data, size_t length, uint8_t sequence,
+                               uint32_t channel_map)
+{
+    tlm_bit_reader reader (p_data, length);
+    uint32_t decoded_map = 0;
+    bool stuck = false;
+
+    memset (frame.samples, 0, sizeof (frame.samples));
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        uint32_t bit = 1UL << slot;
+        if (!(channel_map & bit))
+            continue;
+        if (!stuck && predictor.decode (slot, reader, frame.samples[slot]))
+        {
+            decoded_map |= bit;
+            continue;
+        }
+        if (reader.failed ())
+        {
+            format_errors++;
+            predictor.forget ();
+            return (false);
+        }
+        stuck = true;
+        frame.samples[slot] = 0;
+        predictor.forget (slot);
+        undecoded_count++;
+    }
+
+    // Every byte must have been used, unless the rest couldn't be read
+    if (!stuck && reader.length (p_data) != length)
+    {
+        format_errors++;
+        predictor.forget ();
+        return (false);
+    }
+
+    frame.type = TLM_TYPE_DELTA12;
+    frame.sequence = sequence;
+    frame.channel_map = decoded_map;
+    good_count++;
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes apart a reply to a command, whose CRC has already been checked.
+ *  Replies have their own sequence numbers, those of the commands they answer, so 
+ *  they don't count toward lost sample frames. 
+ *  @param length The number of decoded bytes in the buffer, not counting the CRC
+ *  @return True if the reply was valid and false if not
+ */
+
+bool tlm_decoder::parse_reply (size_t length)
+{
+    if (length < 4 || length > 3 + TLM_BODY_MAX)
+    {
+        format_errors++;
+        return (false);
+    }
+
+    reply.sequence = buffer[1];
+    reply.command = buffer[2];
+    reply.result = buffer[3];
+    reply.length = (uint8_t)(length - 4);
+    memcpy (reply.data, buffer + 4, reply.length);
+
+    frame.type = TLM_TYPE_REPLY;
+    good_count++;
+    return (true);
+}
@@ -0,0 +1,117 @@
+//======================================================================================
+/** \file  tlm_ground.h
+ *  This file contains a telemetry decoder for the ground station. It builds on a PC,
+ *  not on the AVR; the ground station program feeds it the bytes which come out of 
+ *  the radio modem and gets back complete, checked sample frames. See tlm_frame.h for
+ *  the frame format. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Decode replies to ground commands
+ *    \li  10-18-26 DSC Decode 12-bit sample frames
+ *    \li  10-18-26 DSC Decode compressed frames of Rice coded differences
+ *    \li  10-18-26 DSC Decode the spread of decimated samples
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TLM_GROUND_H_                      // To prevent *.h file from being included
+#define _TLM_GROUND_H_                      // in a source file more than once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tlm_frame.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the contents of one decoded sample frame. */
+
+typedef struct
+{
+    uint8_t type;                           // Frame type, such as TLM_TYPE_SAMPLES
+    uint8_t sequence;                       // Sequence number of the frame
+    bool time_known;                        // False if a lost frame broke the timing
+    uint32_t time;                          // Time of the samples in timer counts
+    uint32_t channel_map;                   // Bitmap of slots which have samples
+    uint16_t samples[TLM_MAX_CHANNELS];     // Samples, indexed by slot number; 12
+                                            // bits if type is TLM_TYPE_SAMPLES12
+                                            // or TLM_TYPE_DELTA12
+    uint32_t spread_map;                    // Bitmap of slots which have a spread
+    uint16_t lows[TLM_MAX_CHANNELS];        // Lowest and highest readings since the
+    uint16_t highs[TLM_MAX_CHANNELS];       // slot was last sent, indexed by slot
+} tlm_sample_frame;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds a decoded reply to a command sent from the ground. */
+
+typedef struct
+{
+    uint8_t sequence;                       // Sequence number of the command
+    uint8_t command;                        // Command code, such as TLM_CMD_DUMP
+    uint8_t result;                         // Result code, such as TLM_OK
+    uint8_t length;                         // Number of bytes of data
+    uint8_t data[TLM_BODY_MAX];             // Data returned by the command
+} tlm_reply_frame;
+
+
+//-------------------------------------------------------------------------------------
+/** This class decodes a stream of bytes from the radio into telemetry frames. Bytes
+ *  are given to it one at a time; whenever one of them completes a valid frame, the 
+ *  frame can be read with get_frame(), or with get_reply() if get_frame().type is
+ *  TLM_TYPE_REPLY. Frames with bad CRC's are thrown away and counted, and gaps in the
+ *  sequence numbers of sample frames are counted as lost frames. 
+ */
+
+class tlm_decoder
+{
+    protected:
+        uint8_t buffer[TLM_FRAME_MAX];      // Holds the frame being received
+        size_t fill;                        // Number of bytes in the buffer
+        bool overflow;                      // The frame was too long for the buffer
+        bool have_previous;                 // A frame has been received before
+        uint8_t last_sequence;              // Sequence number of the previous frame
+        tlm_sample_frame frame;             // The most recently decoded frame
+        tlm_reply_frame reply;              // The most recently decoded reply
+        tlm_predictor predictor;            // Previous samples for compressed frames
+
+        unsigned long good_count;           // Number of good frames received
+        unsigned long crc_errors;           // Number of frames with a bad CRC
+        unsigned long format_errors;        // Number of badly formed frames
+        unsigned long lost_count;           // Frames skipped in the sequence numbers
+        unsigned long undecoded_count;      // Compressed samples which couldn't be
+                                            // decoded because a frame was lost
+
+        bool parse (size_t);                // Check and parse a decoded frame
+        bool parse_reply (size_t);          // Parse a reply to a command
+                                            // Decode a compressed frame's samples
+        bool parse_delta (const uint8_t*, size_t, uint8_t, uint32_t);
+
+    public:
+        // The constructor creates a decoder which has not yet seen any data
+        tlm_decoder (void);
+
+        // This method takes one byte from the radio, returning true on a new frame
+        bool feed (uint8_t);
+
+        /** This method returns the most recently decoded frame. */
+        const tlm_sample_frame& get_frame (void) const { return (frame); }
+
+        /** This method returns the most recently decoded reply to a command. */
+        const tlm_reply_frame& get_reply (void) const { return (reply); }
+
+        /** These methods return counts of good, corrupted, and lost frames. */
+        unsigned long frames_good (void) const { return (good_count); }
+        unsigned long frames_bad_crc (void) const { return (crc_errors); }
+        unsigned long frames_bad_format (void) const { return (format_errors); }
+        unsigned long frames_lost (void) const { return (lost_count); }
+
+        /** This method returns the number of compressed samples which couldn't be
+         *  decoded because an earlier frame was lost. */
+        unsigned long samples_undecoded (void) const { return (undecoded_count); }
+};
+
+#endif // _TLM_GROUND_H_
@@ -0,0 +1,223 @@
+//======================================================================================
+/** \file  tlm_history.cc
+ *  This file contains a history buffer which keeps the most recent sensor scans in a
+ *  compact form in RAM. See tlm_history.h for details.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Records built and read by functions the flight log shares
+ *    \li  10-18-26 DSC Record functions moved to tlm_record.cc
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tlm_frame.h"
+#include "tlm_record.h"
+#include "tlm_history.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an empty history which is recording.
+ */
+
+tlm_history::tlm_history (void)
+{
+    head = 0;
+    tail = 0;
+    used = 0;
+    count = 0;
+    base_time = 0;
+    last_time = 0;
+    stop_countdown = 0;
+    stopped = false;
+    forgotten = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the length of a record from its time field and channel bitmap.
+ *  @param place The place in the buffer where the record begins
+ *  @return The number of bytes in the record
+ */
+
+uint16_t tlm_history::record_length (uint16_t place)
+{
+    uint16_t header = 1 + 2 + 3;
+    if (at (place + 1) == (TR_ABS_TIME & 0xFF) && at (place + 2) == (TR_ABS_TIME >> 8))
+        header += 4;
+
+    uint8_t samples = 0;
+    for (uint8_t index = header - 3; index < header; index++)
+    {
+        for (uint8_t bits = at (place + index); bits != 0; bits >>= 1)
+            samples += bits & 1;
+    }
+
+    return (header + ((uint16_t)samples * 12 + 7) / 8);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the time of a record, which is either the time of the record
+ *  before it plus a difference or an absolute time.
+ *  @param place The place in the buffer where the record begins
+ *  @param previous The time of the record before it
+ *  @return The time of the record
+ */
+
+uint32_t tlm_history::record_time (uint16_t place, uint32_t previous)
+{
+    uint16_t delta = at (place + 1) | ((uint16_t)at (place + 2) << 8);
+    if (delta != TR_ABS_TIME)
+        return (previous + delta);
+
+    return ((uint32_t)at (place + 3) | ((uint32_t)at (place + 4) << 8)
+            | ((uint32_t)at (place + 5) << 16) | ((uint32_t)at (place + 6) << 24));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method forgets the oldest record. The next record becomes the oldest, so its
+ *  time is worked out and kept as the base time.
+ */
+
+void tlm_history::drop_oldest (void)
+{
+    uint16_t length = record_length (tail);
+    tail = (tail + length) % TH_BUFFER_SIZE;
+    used -= length;
+    count--;
+    forgotten++;
+
+    if (count > 0)
+        base_time = record_time (tail, base_time);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds a scan to the history. Samples should be 12-bit numbers, scaled
+ *  as they are for TLM_TYPE_SAMPLES12 frames. If there isn't room, the oldest records
+ *  are forgotten. If recording has been stopped, the scan isn't added.
+ *  @param sequence The scan's sequence number
+ *  @param time The time at which the scan started, in timer counts
+ *  @param channel_map A bitmap of the slots which have samples in the scan
+ *  @param samples An array of samples indexed by slot number; only the slots in the
+ *      bitmap are read
+ *  @return True if the scan was added, false if recording is stopped
+ */
+
+bool tlm_history::put (uint8_t sequence, uint32_t time, uint32_t channel_map,
+                       const uint16_t* samples)
+{
+    if (stopped)
+        return (false);
+
+    // Build the record; the first record's time difference isn't used
+    uint8_t record[TR_RECORD_MAX];
+    uint16_t length = tlm_record_build (record, sequence, 
+                                        (count == 0) ? 0 : time - last_time, time, 
+                                        channel_map, samples);
+
+    // Make room, then copy the record in, in two pieces if it wraps around the end
+    while (TH_BUFFER_SIZE - used < length)
+        drop_oldest ();
+
+    uint16_t to_end = TH_BUFFER_SIZE - head;
+    if (length <= to_end)
+    {
+        memcpy (buffer + head, record, length);
+    }
+    else
+    {
+        memcpy (buffer + head, record, to_end);
+        memcpy (buffer, record + to_end, length - to_end);
+    }
+    head = (head + length) % TH_BUFFER_SIZE;
+    used += length;
+
+    if (count == 0)
+        base_time = time;
+    last_time = time;
+    count++;
+
+    if (stop_countdown != 0 && --stop_countdown == 0)
+        stopped = true;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads a scan back from the history. The records before it are walked
+ *  through to find its place and add up its time, so reading the newest scans takes
+ *  the longest.
+ *  @param n Which scan to read, 0 being the oldest in the history
+ *  @param sequence A variable into which the scan's sequence number is put
+ *  @param time A variable into which the time of the scan is put
+ *  @param channel_map A variable into which the scan's channel bitmap is put
+ *  @param samples An array of TLM_MAX_CHANNELS samples indexed by slot number, into
+ *      which the scan's samples are put; slots not in the bitmap are set to zero
+ *  @return True if the scan was read, false if there aren't that many in the history
+ */
+
+bool tlm_history::get (uint16_t n, uint8_t& sequence, uint32_t& time,
+                       uint32_t& channel_map, uint16_t* samples)
+{
+    if (n >= count)
+        return (false);
+
+    uint16_t place = tail;
+    uint32_t when = base_time;
+    while (n--)
+    {
+        place = (place + record_length (place)) % TH_BUFFER_SIZE;
+        when = record_time (place, when);
+    }
+
+    // Copy the record out so the samples can be unpacked even if it wraps around
+    uint8_t record[TR_RECORD_MAX];
+    uint16_t length = record_length (place);
+    for (uint16_t index = 0; index < length; index++)
+        record[index] = at (place + index);
+
+    // The record's time was found on the way here, so what's read is not needed
+    uint32_t read_time = 0;
+    tlm_record_read (record, sequence, read_time, channel_map, samples);
+    time = when;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method marks an event. Recording goes on for the given number of scans and
+ *  then stops, so the history holds the scans from just before the event and those
+ *  after it until resume() is called.
+ *  @param after The number of scans to record after the event; if 0, recording stops
+ *      right away
+ */
+
+void tlm_history::trigger (uint16_t after)
+{
+    stop_countdown = after;
+    if (after == 0)
+        stopped = true;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts recording again after trigger() stopped it. The scans already
+ *  in the history are kept until newer ones push them out.
+ */
+
+void tlm_history::resume (void)
+{
+    stop_countdown = 0;
+    stopped = false;
+}
@@ -0,0 +1,101 @@
+//======================================================================================
+/** \file  tlm_history.h
+ *  This file contains a history buffer which keeps the most recent sensor scans in a
+ *  compact form in RAM, so that they can be sent again if the ground misses them or
+ *  saved around an event of interest. Scans are stored back to back in a circular
+ *  byte buffer as the records described in tlm_record.h, about 27 bytes for a scan
+ *  of the channels read at full rate, so TH_BUFFER_SIZE bytes hold the last 
+ *  TH_BUFFER_SIZE / 27 scans or so. Only the time of the oldest record is kept in 
+ *  full. When the buffer is full, the oldest records are forgotten to make room for
+ *  new ones, unless recording has been stopped by trigger().
+ *
+ *  The history is part of the ground station library only. On the aircraft, what the
+ *  ATmega128's 4 KB of RAM can spare would hold well under a second of scans, too 
+ *  little for a retransmission or an event capture to be of use; the flight software
+ *  writes every scan to the flight log on the SD card instead (see log_writer.h).
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Records built and read by functions the flight log shares
+ *    \li  10-18-26 DSC No longer kept onboard, where it held too few scans to be useful
+ *    \li  10-18-26 DSC Record functions moved to tlm_record.h
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _TLM_HISTORY_H_                     // To prevent *.h file from being included
+#define _TLM_HISTORY_H_                     // in a source file more than once
+
+#include <stdint.h>
+
+/** The number of bytes of records which the history can hold */
+#define TH_BUFFER_SIZE      512
+
+//-------------------------------------------------------------------------------------
+/** This class keeps a history of recent sensor scans. Scans are added with put() and
+ *  read back, oldest first, with get(). Recording can be stopped a given number of
+ *  scans after an event with trigger(), which keeps the scans from before and after
+ *  the event until resume() is called.
+ */
+
+class tlm_history
+{
+    protected:
+        uint8_t buffer[TH_BUFFER_SIZE];     // Holds the records
+        uint16_t head;                      // Where the next byte will be put
+        uint16_t tail;                      // Where the oldest record begins
+        uint16_t used;                      // Number of bytes in the buffer
+        uint16_t count;                     // Number of records in the buffer
+        uint32_t base_time;                 // Time of the oldest record
+        uint32_t last_time;                 // Time of the newest record
+        uint16_t stop_countdown;            // Records until recording stops, or 0
+        bool stopped;                       // Recording has been stopped
+        uint16_t forgotten;                 // Records overwritten by newer ones
+
+        /** This method returns the byte at a place in the buffer, which may be past
+         *  the end, in which case it wraps around. */
+        uint8_t at (uint16_t place) { return (buffer[place % TH_BUFFER_SIZE]); }
+
+        // This method finds the length of the record at a place in the buffer
+        uint16_t record_length (uint16_t);
+
+        // This method finds the time of a record from the time of the one before it
+        uint32_t record_time (uint16_t, uint32_t);
+
+        // This method forgets the oldest record to make room for a new one
+        void drop_oldest (void);
+
+    public:
+        // The constructor creates an empty history
+        tlm_history (void);
+
+        // This method adds a scan to the history
+        bool put (uint8_t, uint32_t, uint32_t, const uint16_t*);
+
+        // This method reads a scan back from the history, counting from the oldest
+        bool get (uint16_t, uint8_t&, uint32_t&, uint32_t&, uint16_t*);
+
+        // This method stops recording after some more scans have been added
+        void trigger (uint16_t);
+
+        // This method starts recording again after it was stopped
+        void resume (void);
+
+        /** This method returns the number of scans in the history. */
+        uint16_t frames (void) { return (count); }
+
+        /** This method returns the number of bytes the scans in the history take. */
+        uint16_t bytes (void) { return (used); }
+
+        /** This method returns true if recording has been stopped by trigger(). */
+        bool is_stopped (void) { return (stopped); }
+
+        /** This method returns the number of scans which were overwritten by newer
+         *  ones. */
+        uint16_t frames_forgotten (void) { return (forgotten); }
+};
+
+#endif // _TLM_HISTORY_H_
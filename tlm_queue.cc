@@ -0,0 +1,148 @@
+//======================================================================================
+/** \file  tlm_queue.cc
+ *  This file contains a queue which holds encoded telemetry frames in RAM until the
+ *  radio is ready to send them. See tlm_queue.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+#include "avr_serial.h"
+#include "tlm_queue.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an empty telemetry frame queue. 
+ */
+
+tlm_queue::tlm_queue (void)
+{
+    head = 0;
+    tail = 0;
+    used = 0;
+    first = 0;
+    count = 0;
+    dropped = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method copies a frame into the queue. If there isn't room for it, the frame 
+ *  is dropped; the frames already in the queue are older and are sent first anyway, 
+ *  and they may be in the middle of being sent, so they can't be thrown out. 
+ *  @param frame A pointer to the encoded frame
+ *  @param length The number of bytes in the frame
+ *  @param time The time at which the frame is queued, in timer counts
+ *  @return True if the frame was queued, false if it was dropped
+ */
+
+bool tlm_queue::put (const uint8_t* frame, uint16_t length, uint32_t time)
+{
+    if (count >= TQ_MAX_FRAMES || length > TQ_BUFFER_SIZE - used || length == 0)
+    {
+        dropped++;
+        return (false);
+    }
+
+    // Copy the frame in, in two pieces if it wraps around the end of the buffer
+    uint16_t to_end = TQ_BUFFER_SIZE - head;
+    if (length <= to_end)
+    {
+        memcpy (buffer + head, frame, length);
+    }
+    else
+    {
+        memcpy (buffer + head, frame, to_end);
+        memcpy (buffer, frame + to_end, length - to_end);
+    }
+    head = (head + length) % TQ_BUFFER_SIZE;
+    used += length;
+
+    uint8_t index = (first + count) % TQ_MAX_FRAMES;
+    lengths[index] = length;
+    times[index] = time;
+    count++;
+
+    return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method describes a group of the oldest frames in the queue, as many whole 
+ *  frames as fit in the given number of bytes, as one or two segments which can be
+ *  given to avr_uart::send_gather(). The oldest frame is always included even if 
+ *  it's longer than the limit. The frames stay in the queue; release() must be 
+ *  called to remove them once they've been sent. 
+ *  @param segments An array of at least two segments which will be filled in
+ *  @param num_segments Reference to a variable which gets the number of segments
+ *  @param max_bytes The greatest number of bytes to be described
+ *  @return The number of frames described, zero if the queue was empty
+ */
+
+uint8_t tlm_queue::get_burst (uart_segment* segments, unsigned char& num_segments,
+                              uint16_t max_bytes)
+{
+    uint16_t total = 0;                     // Bytes in the frames chosen so far
+    uint8_t frames = 0;                     // Number of frames chosen so far
+
+    num_segments = 0;
+    while (frames < count)
+    {
+        uint16_t length = lengths[(first + frames) % TQ_MAX_FRAMES];
+        if (frames > 0 && total + length > max_bytes)
+            break;
+        total += length;
+        frames++;
+    }
+    if (frames == 0)
+        return (0);
+
+    // Describe the bytes, in two pieces if they wrap around the end of the buffer
+    uint16_t to_end = TQ_BUFFER_SIZE - tail;
+    segments[0].data = buffer + tail;
+    if (total <= to_end)
+    {
+        segments[0].length = total;
+        num_segments = 1;
+    }
+    else
+    {
+        segments[0].length = to_end;
+        segments[1].data = buffer;
+        segments[1].length = total - to_end;
+        num_segments = 2;
+    }
+
+    return (frames);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method removes frames from the front of the queue, making their space 
+ *  available for new frames. It should be called after the frames have been sent.
+ *  @param frames The number of frames to remove
+ */
+
+void tlm_queue::release (uint8_t frames)
+{
+    if (frames > count)
+        frames = count;
+
+    while (frames--)
+    {
+        uint16_t length = lengths[first];
+        tail = (tail + length) % TQ_BUFFER_SIZE;
+        used -= length;
+        first = (first + 1) % TQ_MAX_FRAMES;
+        count--;
+    }
+}
@@ -0,0 +1,84 @@
+//======================================================================================
+/** \file  tlm_queue.h
+ *  This file contains a queue which holds encoded telemetry frames in RAM until the
+ *  radio is ready to send them. Frames are stored back to back in a circular byte 
+ *  buffer, so a run of queued frames can be handed to the serial port's gathered 
+ *  sender as at most two segments (one if it doesn't wrap around the end of the 
+ *  buffer) and sent without copying. The time at which each frame was queued is kept
+ *  so that the latency added by waiting in the queue can be measured. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Smaller buffer, so the program fits in the ATmega128's RAM
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TLM_QUEUE_H_                       // To prevent *.h file from being included
+#define _TLM_QUEUE_H_                       // in a source file more than once
+
+#include <stdint.h>
+
+/** The number of bytes of encoded frames which the queue can hold. This is a burst of
+ *  TT_BURST_BYTES and room for the frames which come in while it's being sent */
+#define TQ_BUFFER_SIZE      320
+
+/** The number of frames which the queue can hold */
+#define TQ_MAX_FRAMES       16
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a first-in, first-out queue of encoded telemetry frames. Frames are
+ *  copied in with put(); a group of the oldest frames is described to the sender by
+ *  get_burst(), and the frames stay in the queue, untouched, until release() is
+ *  called after they have been sent. 
+ */
+
+class tlm_queue
+{
+    protected:
+        uint8_t buffer[TQ_BUFFER_SIZE];     // Holds the bytes of the queued frames
+        uint16_t head;                      // Where the next byte will be put
+        uint16_t tail;                      // Where the oldest frame begins
+        uint16_t used;                      // Number of bytes in the queue
+        uint16_t lengths[TQ_MAX_FRAMES];    // Length of each queued frame
+        uint32_t times[TQ_MAX_FRAMES];      // Time at which each frame was queued
+        uint8_t first;                      // Index of the oldest frame's entries
+        uint8_t count;                      // Number of frames in the queue
+        uint16_t dropped;                   // Frames thrown away for lack of room
+
+    public:
+        // The constructor creates an empty queue
+        tlm_queue (void);
+
+        // This method copies a frame into the queue
+        bool put (const uint8_t*, uint16_t, uint32_t);
+
+        // This method describes a group of the oldest frames for sending
+        uint8_t get_burst (uart_segment*, unsigned char&, uint16_t);
+
+        // This method removes frames from the front of the queue after sending
+        void release (uint8_t);
+
+        /** This method returns the time at which the n-th oldest frame was queued. */
+        uint32_t frame_time (uint8_t n) 
+            { return (times[(first + n) % TQ_MAX_FRAMES]); }
+
+        /** This method returns the number of frames in the queue. */
+        uint8_t frames (void) { return (count); }
+
+        /** This method returns the number of bytes in the queue. */
+        uint16_t bytes (void) { return (used); }
+
+        /** This method returns the number of bytes for which there's no room. */
+        uint16_t bytes_free (void) { return (TQ_BUFFER_SIZE - used); }
+
+        /** This method returns the number of frames dropped because the queue was 
+         *  full. */
+        uint16_t frames_dropped (void) { return (dropped); }
+};
+
+#endif // _TLM_QUEUE_H_
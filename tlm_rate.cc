@@ -0,0 +1,145 @@
+//======================================================================================
+/** \file  tlm_rate.cc
+ *  This file contains the rate controller which thins out the telemetry downlink when
+ *  the radio link is congested. See tlm_rate.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Readings counted per channel for channels at slower rates
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+
+#include "tlm_frame.h"
+#include "tlm_rate.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a rate controller which begins at full rate. 
+ */
+
+tlm_rate::tlm_rate (void)
+{
+    level = 0;
+    clear_periods = 0;
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        priority[slot] = 0;
+        offered[slot] = 0;
+    }
+
+    last_stall = 0;
+    last_acked = 0;
+    last_failed = 0;
+    last_dropped = 0;
+    slowdowns = 0;
+    speedups = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets a channel's priority, which is the number of decimation levels 
+ *  the channel is spared. A priority of TR_MAX_LEVEL or more keeps a channel at full
+ *  rate no matter how congested the link is. 
+ *  @param slot The channel's slot number
+ *  @param a_priority The channel's priority
+ */
+
+void tlm_rate::set_priority (uint8_t slot, uint8_t a_priority)
+{
+    if (slot < TLM_MAX_CHANNELS)
+        priority[slot] = a_priority;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called once a period with the telemetry task's measurements. The 
+ *  totals are counted from when the task started; this method finds how much each 
+ *  one changed during the period. If the link was congested, the level goes up by one
+ *  right away; if it was clear for TR_RECOVER periods in a row, the level goes down. 
+ *  @param backlog The greatest queue backlog during the period, in percent
+ *  @param stall_total Total time CTS has been held high, in timer counts
+ *  @param period The length of the period, in timer counts
+ *  @param acked Total packets the ground radio has acknowledged
+ *  @param failed Total packets which weren't acknowledged
+ *  @param dropped Total frames dropped because the queue was full
+ */
+
+void tlm_rate::update (uint8_t backlog, uint32_t stall_total, uint32_t period, 
+                       uint16_t acked, uint16_t failed, uint16_t dropped)
+{
+    // Find the stall time and packet counts for just this period
+    uint32_t stall = stall_total - last_stall;
+    uint16_t num_acked = acked - last_acked;
+    uint16_t num_failed = failed - last_failed;
+    bool dropped_any = (dropped != last_dropped);
+    last_stall = stall_total;
+    last_acked = acked;
+    last_failed = failed;
+    last_dropped = dropped;
+
+    uint8_t stall_percent = (period > 0 && stall < period) 
+                          ? (uint8_t)(stall * 100 / period) : 100;
+    uint16_t num_packets = num_acked + num_failed;
+    uint8_t fail_percent = num_packets ? (uint8_t)(num_failed * 100UL / num_packets) : 0;
+
+    // Congestion: cut the rate now
+    if (dropped_any || backlog >= TR_QUEUE_HIGH || stall_percent >= TR_STALL_HIGH
+        || fail_percent >= TR_FAIL_HIGH)
+    {
+        clear_periods = 0;
+        if (level < TR_MAX_LEVEL)
+        {
+            level++;
+            slowdowns++;
+        }
+        return;
+    }
+
+    // A clear period has a short queue, no stalls and few failures; after enough of
+    // them, try the next higher rate
+    if (backlog <= TR_QUEUE_LOW && stall == 0 && fail_percent < TR_FAIL_HIGH / 4)
+    {
+        if (++clear_periods >= TR_RECOVER && level > 0)
+        {
+            level--;
+            speedups++;
+            clear_periods = 0;
+        }
+    }
+    else
+        clear_periods = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method is called once for each sensor scan to pick which channels go into its
+ *  telemetry frame. A channel whose decimation is d = level - priority sends every 
+ *  (2^d)th reading offered on it, so a channel which only has a new reading in some
+ *  scans is thinned from its own rate rather than starved by the scan count. 
+ *  @param channel_map A bitmap of the channels which have new readings to send
+ *  @return A bitmap of the channels to be sent in this scan, which may be empty
+ */
+
+uint32_t tlm_rate::select (uint32_t channel_map)
+{
+    uint32_t selected = 0;
+
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        if (!(channel_map & (1UL << slot)))
+            continue;
+
+        uint8_t decimation = (level > priority[slot]) ? level - priority[slot] : 0;
+        if ((offered[slot]++ & ((1 << decimation) - 1)) == 0)
+            selected |= 1UL << slot;
+    }
+
+    return (selected);
+}
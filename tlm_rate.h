@@ -0,0 +1,104 @@
+//======================================================================================
+/** \file  tlm_rate.h
+ *  This file contains a rate controller which decides how many of the sensor scans
+ *  are sent to the ground on each channel. Every scan is still taken and used on 
+ *  board; only the downlink is thinned out. The controller looks at three signs that
+ *  the radio link is carrying less than is being given to it: the telemetry queue 
+ *  backing up, the radio holding CTS high, and packets which the ground radio didn't
+ *  acknowledge. If any of them shows up during a decision period, the downlink rate
+ *  is halved (the decimation level goes up by one); when the link has been clear for
+ *  several periods in a row, the rate is doubled again. Cutting fast and recovering 
+ *  slowly keeps the link from swinging between flooded and idle, and it settles at 
+ *  about the highest rate the link can actually carry. 
+ *
+ *  Each channel has a priority. A channel with priority p isn't decimated until the
+ *  level is above p, so channels needed on the ground in real time (such as the 
+ *  actuator positions) keep their full rate longer than the others. Each channel's 
+ *  readings are counted separately, so channels which don't have a new reading in 
+ *  every scan are thinned out evenly too. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Readings counted per channel for channels at slower rates
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _TLM_RATE_H_                        // To prevent *.h file from being included
+#define _TLM_RATE_H_                        // in a source file more than once
+
+#include <stdint.h>
+
+/** The time between rate decisions, in microseconds */
+#define TR_PERIOD           500000L
+
+/** The highest decimation level; at level n, every (2^n)th reading is sent */
+#define TR_MAX_LEVEL        4
+
+/** The number of clear periods in a row after which the rate is raised */
+#define TR_RECOVER          4
+
+/** Queue backlog, in percent of the space beyond one burst, which means congestion */
+#define TR_QUEUE_HIGH       50
+
+/** Queue backlog, in percent, below which the link counts as clear */
+#define TR_QUEUE_LOW        10
+
+/** Time with CTS held high, in percent of a period, which means congestion */
+#define TR_STALL_HIGH       10
+
+/** Packets which weren't acknowledged, in percent, which means congestion */
+#define TR_FAIL_HIGH        25
+
+
+//-------------------------------------------------------------------------------------
+/** This class holds the decimation level and picks the channels to be sent in each
+ *  scan. The telemetry task calls update() once a period with its measurements; the
+ *  sensor task calls select() for each scan. 
+ */
+
+class tlm_rate
+{
+    protected:
+        uint8_t level;                      // Current decimation level
+        uint8_t clear_periods;              // Clear periods in a row so far
+        uint8_t offered[TLM_MAX_CHANNELS];  // Counts each channel's readings, to
+                                            // pick which are sent
+        uint8_t priority[TLM_MAX_CHANNELS]; // Levels before each channel is thinned
+
+        uint32_t last_stall;                // Totals at the previous update, so the
+        uint16_t last_acked;                // amounts during each period can be
+        uint16_t last_failed;               // found
+        uint16_t last_dropped;
+
+        uint16_t slowdowns;                 // Times the rate has been lowered
+        uint16_t speedups;                  // Times the rate has been raised
+
+    public:
+        // The constructor starts at full rate with every channel at priority 0
+        tlm_rate (void);
+
+        // This method sets how many levels a channel is spared from decimation
+        void set_priority (uint8_t, uint8_t);
+
+        // This method takes a period's measurements and adjusts the level
+        void update (uint8_t, uint32_t, uint32_t, uint16_t, uint16_t, uint16_t);
+
+        // This method picks which of the given channels are sent in this scan
+        uint32_t select (uint32_t);
+
+        /** This method returns the decimation level; the slowest channels send one
+         *  of every 2^level readings. */
+        uint8_t get_level (void) { return (level); }
+
+        /** This method returns the number of times the rate has been lowered. */
+        uint16_t rate_cuts (void) { return (slowdowns); }
+
+        /** This method returns the number of times the rate has been raised. */
+        uint16_t rate_raises (void) { return (speedups); }
+};
+
+#endif // _TLM_RATE_H_
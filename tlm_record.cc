@@ -0,0 +1,116 @@
+//======================================================================================
+/** \file  tlm_record.cc
+ *  This file contains the functions which build and take apart the compact records
+ *  in which sensor scans are stored. See tlm_record.h for the layout.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file, from the record functions in tlm_history.cc
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdint.h>
+
+#include "tlm_frame.h"
+#include "tlm_record.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This function builds one scan record in the format described in tlm_record.h.
+ *  @param record The buffer into which the record goes, TR_RECORD_MAX bytes long
+ *  @param sequence The scan's sequence number
+ *  @param delta The time since the previous record in timer counts; if it's 
+ *      TR_ABS_TIME or more, the absolute time is written instead
+ *  @param time The time at which the scan started, in timer counts
+ *  @param channel_map A bitmap of the slots which have samples in the scan
+ *  @param samples An array of 12-bit samples indexed by slot number; only the slots
+ *      in the bitmap are read
+ *  @return The number of bytes in the record
+ */
+
+uint8_t tlm_record_build (uint8_t* record, uint8_t sequence, uint32_t delta, 
+                          uint32_t time, uint32_t channel_map, const uint16_t* samples)
+{
+    uint8_t* p_byte = record;
+
+    *p_byte++ = sequence;
+    if (delta < TR_ABS_TIME)
+    {
+        *p_byte++ = (uint8_t)delta;
+        *p_byte++ = (uint8_t)(delta >> 8);
+    }
+    else
+    {
+        *p_byte++ = (uint8_t)TR_ABS_TIME;
+        *p_byte++ = (uint8_t)(TR_ABS_TIME >> 8);
+        *p_byte++ = (uint8_t)time;
+        *p_byte++ = (uint8_t)(time >> 8);
+        *p_byte++ = (uint8_t)(time >> 16);
+        *p_byte++ = (uint8_t)(time >> 24);
+    }
+    *p_byte++ = (uint8_t)channel_map;
+    *p_byte++ = (uint8_t)(channel_map >> 8);
+    *p_byte++ = (uint8_t)(channel_map >> 16);
+
+    uint16_t packed[TLM_MAX_CHANNELS];
+    uint8_t num_samples = 0;
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+    {
+        if (channel_map & (1UL << slot))
+            packed[num_samples++] = samples[slot];
+    }
+    p_byte += tlm_pack12 (packed, num_samples, p_byte);
+
+    return (p_byte - record);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function takes apart one scan record which was built by tlm_record_build().
+ *  @param record A pointer to the record
+ *  @param sequence A variable into which the scan's sequence number is put
+ *  @param time A variable which holds the time of the previous record, and into 
+ *      which the time of this one is put
+ *  @param channel_map A variable into which the scan's channel bitmap is put
+ *  @param samples An array of TLM_MAX_CHANNELS samples indexed by slot number, into
+ *      which the scan's samples are put; slots not in the bitmap are set to zero
+ *  @return The number of bytes in the record
+ */
+
+uint8_t tlm_record_read (const uint8_t* record, uint8_t& sequence, uint32_t& time,
+                         uint32_t& channel_map, uint16_t* samples)
+{
+    const uint8_t* p_byte = record + 1;
+    uint16_t delta = p_byte[0] | ((uint16_t)p_byte[1] << 8);
+
+    sequence = record[0];
+    p_byte += 2;
+    if (delta == TR_ABS_TIME)
+    {
+        time = (uint32_t)p_byte[0] | ((uint32_t)p_byte[1] << 8)
+             | ((uint32_t)p_byte[2] << 16) | ((uint32_t)p_byte[3] << 24);
+        p_byte += 4;
+    }
+    else
+        time += delta;
+
+    channel_map = (uint32_t)p_byte[0] | ((uint32_t)p_byte[1] << 8)
+                | ((uint32_t)p_byte[2] << 16);
+    p_byte += 3;
+
+    uint16_t packed[TLM_MAX_CHANNELS];
+    uint8_t num_samples = 0;
+    for (uint32_t bits = channel_map; bits != 0; bits >>= 1)
+        num_samples += bits & 1;
+    tlm_unpack12 (p_byte, num_samples, packed);
+    p_byte += ((uint16_t)num_samples * 12 + 7) / 8;
+
+    num_samples = 0;
+    for (uint8_t slot = 0; slot < TLM_MAX_CHANNELS; slot++)
+        samples[slot] = (channel_map & (1UL << slot)) ? packed[num_samples++] : 0;
+
+    return (p_byte - record);
+}
@@ -0,0 +1,48 @@
+//======================================================================================
+/** \file  tlm_record.h
+ *  This file contains the functions which build and take apart the compact records
+ *  in which sensor scans are stored, both in the flight log on the SD card (see 
+ *  log_format.h) and in the ground station's history buffer (see tlm_history.h). A
+ *  record is laid out much like the body of a telemetry frame:
+ *
+ *      \li  1 byte   Sequence number of the scan
+ *      \li  2 bytes  Time since the previous record in timer counts, or TR_ABS_TIME
+ *                    followed by 4 bytes of absolute time if the gap is too long
+ *      \li  3 bytes  Channel bitmap; bit n is set if slot n has a sample
+ *      \li  N bytes  The samples for the set bits, lowest slot first, packed as
+ *                    12-bit numbers, two in three bytes (see tlm_pack12())
+ *
+ *  Only the time of the first record in a run is kept in full, so each scan costs two
+ *  bytes of time rather than four bytes for every sample, and slots which weren't read
+ *  in a scan cost nothing. A scan of the 14 channels read at full rate takes 27 bytes.
+ *
+ *  This file and tlm_record.cc build both for the AVR and for the ground station PC.
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file, from the record functions in tlm_history.cc
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#ifndef _TLM_RECORD_H_                      // To prevent *.h file from being included
+#define _TLM_RECORD_H_                      // in a source file more than once
+
+#include <stdint.h>
+
+/** The time difference which means that a 4-byte absolute time follows */
+#define TR_ABS_TIME         0xFFFF
+
+/** The greatest number of bytes in one record */
+#define TR_RECORD_MAX       (1 + 2 + 4 + 3 + (TLM_MAX_CHANNELS * 12 + 7) / 8)
+
+// This function builds one scan record
+uint8_t tlm_record_build (uint8_t*, uint8_t, uint32_t, uint32_t, uint32_t, 
+                          const uint16_t*);
+
+// This function takes apart one scan record
+uint8_t tlm_record_read (const uint8_t*, uint8_t&, uint32_t&, uint32_t&, uint16_t*);
+
+#endif // _TLM_RECORD_H_
@@ -0,0 +1,234 @@
+//======================================================================================
+/** \file  xt_api.cc
+ *  This file contains the code which talks to the 9XTend radio in its API mode. See
+ *  xt_api.h for a description of the frames. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "avr_serial.h"
+#include "avr_9xtend.h"
+#include "xt_api.h"
+
+// States of the frame receiver
+#define XR_START            0               // Looking for the start delimiter
+#define XR_LENGTH_HI        1               // Expecting the high byte of the length
+#define XR_LENGTH_LO        2               // Expecting the low byte of the length
+#define XR_DATA             3               // Receiving the frame data
+#define XR_CHECKSUM         4               // Expecting the checksum
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an API link object. The radio must be put into API mode
+ *  (with ATAP1) before the link is used; task_radio_setup does that. 
+ *  @param a_radio A pointer to the radio modem
+ *  @param a_destination The address of the radio to which packets are sent
+ */
+
+xt_api_link::xt_api_link (avr_9xtend* a_radio, uint16_t a_destination)
+{
+    p_radio = a_radio;
+    destination = a_destination;
+    next_id = 1;
+
+    rx_state = XR_START;
+    rx_length = 0;
+    rx_count = 0;
+    rx_sum = 0;
+    rx_errors = 0;
+
+    status_callback = NULL;
+    status_context = NULL;
+    receive_callback = NULL;
+    receive_context = NULL;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gets a frame ID for a packet whose transmit status is wanted. IDs go 
+ *  from 1 to 255 and then start over, skipping zero, which means "no status". 
+ *  @return A frame ID which hasn't been used for the last 254 packets
+ */
+
+uint8_t xt_api_link::new_frame_id (void)
+{
+    uint8_t id = next_id++;
+
+    if (next_id == XT_NO_STATUS)
+        next_id = 1;
+
+    return (id);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method starts sending a packet of data to the destination radio. The data can
+ *  be in one or two pieces (two if it wraps around the end of a circular buffer); the
+ *  header and checksum are sent as separate segments around it, so the data isn't 
+ *  copied and must not be changed until the serial port is no longer busy. 
+ *  @param data An array of one or two segments describing the data
+ *  @param num_data The number of segments in that array
+ *  @param frame_id The frame ID, or XT_NO_STATUS if no transmit status is wanted
+ *  @return True if the packet was started, false if the serial port was busy or the
+ *      radio wasn't clear to send
+ */
+
+bool xt_api_link::send (const uart_segment* data, unsigned char num_data, 
+                        uint8_t frame_id)
+{
+    if (p_radio->tx_busy ())
+        return (false);
+
+    // Add up the data's length and its part of the checksum
+    uint16_t length = 0;
+    uint8_t sum = 0;
+    for (unsigned char index = 0; index < num_data && index < 2; index++)
+    {
+        const uint8_t* p_byte = (const uint8_t*)data[index].data;
+        for (size_t count = data[index].length; count > 0; count--)
+            sum += *p_byte++;
+        length += data[index].length;
+        tx_segments[index + 1] = data[index];
+    }
+
+    // Build the header; the frame data begins at the API identifier
+    tx_header[0] = XT_API_START;
+    tx_header[1] = (uint8_t)((length + 5) >> 8);
+    tx_header[2] = (uint8_t)(length + 5);
+    tx_header[3] = XT_API_TX16;
+    tx_header[4] = frame_id;
+    tx_header[5] = (uint8_t)(destination >> 8);
+    tx_header[6] = (uint8_t)destination;
+    tx_header[7] = 0x00;                    // Options: ask for acknowledgement
+    for (uint8_t index = 3; index < 8; index++)
+        sum += tx_header[index];
+    tx_checksum = 0xFF - sum;
+
+    tx_segments[0].data = tx_header;
+    tx_segments[0].length = sizeof (tx_header);
+    num_data = (num_data < 2) ? num_data : 2;
+    tx_segments[num_data + 1].data = &tx_checksum;
+    tx_segments[num_data + 1].length = 1;
+
+    return (p_radio->send_gather (tx_segments, num_data + 2));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads whatever bytes the radio has sent and runs them through the 
+ *  frame receiver. It doesn't wait for bytes which haven't arrived. When a frame is
+ *  complete and its checksum is good, the frame is handed to the callback function 
+ *  for its type. 
+ */
+
+void xt_api_link::poll (void)
+{
+    while (p_radio->check_for_char ())
+    {
+        uint8_t ch = (uint8_t)p_radio->getchar ();
+
+        switch (rx_state)
+        {
+            case (XR_START):
+                if (ch == XT_API_START)
+                    rx_state = XR_LENGTH_HI;
+                break;
+
+            case (XR_LENGTH_HI):
+                rx_length = (uint16_t)ch << 8;
+                rx_state = XR_LENGTH_LO;
+                break;
+
+            case (XR_LENGTH_LO):
+                rx_length |= ch;
+                rx_count = 0;
+                rx_sum = 0;
+                rx_state = (rx_length > 0) ? XR_DATA : XR_START;
+                break;
+
+            // Frames too long for the buffer are read through and then thrown away
+            case (XR_DATA):
+                if (rx_count < XT_RX_MAX)
+                    rx_buffer[rx_count] = ch;
+                rx_sum += ch;
+                if (++rx_count >= rx_length)
+                    rx_state = XR_CHECKSUM;
+                break;
+
+            case (XR_CHECKSUM):
+                if ((uint8_t)(rx_sum + ch) == 0xFF && rx_length <= XT_RX_MAX)
+                    dispatch ();
+                else
+                    rx_errors++;
+                rx_state = XR_START;
+                break;
+        };
+    }
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method acts on a complete, checked frame from the radio by calling the 
+ *  callback function for its type. Frames of other types are ignored. 
+ */
+
+void xt_api_link::dispatch (void)
+{
+    switch (rx_buffer[0])
+    {
+        // Transmit status: frame ID, status
+        case (XT_API_TX_STATUS):
+            if (rx_length >= 3 && status_callback)
+                status_callback (status_context, rx_buffer[1], rx_buffer[2]);
+            break;
+
+        // Received packet: source address (2 bytes), signal strength, options, data
+        case (XT_API_RX16):
+            if (rx_length >= 5 && receive_callback)
+                receive_callback (receive_context, 
+                                  ((uint16_t)rx_buffer[1] << 8) | rx_buffer[2],
+                                  rx_buffer + 5, (uint8_t)(rx_length - 5));
+            break;
+
+        default:
+            break;
+    };
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the function which is called when a transmit status frame comes
+ *  from the radio. 
+ *  @param callback The function to be called, or NULL for none
+ *  @param context A pointer which is given to the function, usually an object
+ */
+
+void xt_api_link::on_status (xt_status_callback callback, void* context)
+{
+    status_callback = callback;
+    status_context = context;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the function which is called when a packet from another radio
+ *  comes in. 
+ *  @param callback The function to be called, or NULL for none
+ *  @param context A pointer which is given to the function, usually an object
+ */
+
+void xt_api_link::on_receive (xt_receive_callback callback, void* context)
+{
+    receive_callback = callback;
+    receive_context = context;
+}
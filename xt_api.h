@@ -0,0 +1,133 @@
+//======================================================================================
+/** \file  xt_api.h
+ *  This file contains the code which talks to the 9XTend radio in its API mode. In the
+ *  radio's ordinary transparent mode, bytes go in one end and (usually) come out the 
+ *  other, and the sender never finds out which ones were lost. In API mode, data is
+ *  given to the radio in addressed packets, each wrapped in a small frame:
+ *
+ *      \li  0x7E start delimiter
+ *      \li  2 bytes  Length of the frame data, most significant byte first
+ *      \li  N bytes  Frame data: an API identifier byte and then its contents
+ *      \li  1 byte   Checksum, 0xFF minus the low byte of the sum of the frame data
+ *
+ *  A transmit request (API ID 0x01) holds a frame ID, a 16-bit destination address, an
+ *  options byte and the data to be sent. If the frame ID isn't zero, the radio answers
+ *  with a transmit status frame (API ID 0x89) giving the frame ID and whether the 
+ *  packet was acknowledged by the other radio. Packets received over the air arrive 
+ *  as receive frames (API ID 0x81) holding the sender's address, the signal strength,
+ *  an options byte and the data. The radio must be put in API mode with ATAP1. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Packet size matched to the radio's RF packet size
+ *    \li  10-18-26 DSC Receive buffer sized for commands, to save RAM
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _XT_API_H_                          // To prevent *.h file from being included
+#define _XT_API_H_                          // in a source file more than once
+
+#include <stdint.h>
+
+// Codes used in API frames
+#define XT_API_START        0x7E            // Start delimiter which begins each frame
+#define XT_API_TX16         0x01            // Transmit request, 16-bit address
+#define XT_API_TX_STATUS    0x89            // Transmit status
+#define XT_API_RX16         0x81            // Received packet, 16-bit address
+
+// Transmit status codes
+#define XT_TX_SUCCESS       0               // The other radio acknowledged the packet
+#define XT_TX_NO_ACK        1               // No acknowledgement after all retries
+#define XT_TX_CCA_FAIL      2               // The channel was never clear to send
+#define XT_TX_PURGED        3               // The packet was thrown away
+
+/** A frame ID of zero asks the radio not to send a transmit status frame */
+#define XT_NO_STATUS        0
+
+/** The address of the ground station's radio, to which telemetry is sent */
+#define XT_GROUND_ADDRESS   0x0000
+
+/** The largest amount of data which is put in one transmit request. This matches the
+ *  radio's maximum RF packet size, which task_radio_setup sets with ATPK (in hex), so
+ *  each request goes out as one RF packet instead of being split. The radio's own
+ *  flow control threshold would de-assert CTS only 17 bytes short of its 2 KB serial
+ *  input buffer being full, so task_radio_setup lowers it with ATFT to leave 512 
+ *  bytes, room for a whole API frame of 265 bytes with this payload. A packet which 
+ *  starts while CTS is asserted can then be sent in full without checking CTS again
+ *  partway through it */
+#define XT_API_MAX_PAYLOAD  256
+
+/** The largest received frame which is kept; longer ones are thrown away. The ground
+ *  only sends commands, which with the 5 bytes of a received packet's header take up
+ *  to 34 bytes */
+#define XT_RX_MAX           48
+
+
+/** This type of function is called when a transmit status frame arrives. Its 
+ *  parameters are the context pointer given with it, the frame ID, and the status. */
+typedef void (*xt_status_callback) (void*, uint8_t, uint8_t);
+
+/** This type of function is called when a packet arrives over the air. Its parameters
+ *  are the context pointer given with it, the sender's address, a pointer to the 
+ *  data, and the number of bytes of data. */
+typedef void (*xt_receive_callback) (void*, uint16_t, const uint8_t*, uint8_t);
+
+
+//-------------------------------------------------------------------------------------
+/** This class sends and receives API frames through a 9XTend radio. Outgoing data is
+ *  sent by the serial port's gathered sender with the frame header and checksum as
+ *  separate segments, so the data itself is never copied. Incoming frames are parsed
+ *  a byte at a time by poll(), which never waits, and handed to callback functions. 
+ */
+
+class xt_api_link
+{
+    protected:
+        avr_9xtend* p_radio;                // The radio, which must be in API mode
+        uint16_t destination;               // Address to which packets are sent
+        uint8_t next_id;                    // Frame ID which will be used next
+
+        uint8_t tx_header[8];               // Start of the frame being sent
+        uint8_t tx_checksum;                // Checksum of the frame being sent
+        uart_segment tx_segments[4];        // Header, data (in 2 pieces), checksum
+
+        uint8_t rx_state;                   // Which part of a frame is expected next
+        uint16_t rx_length;                 // Length of the frame being received
+        uint16_t rx_count;                  // Bytes of frame data received so far
+        uint8_t rx_sum;                     // Sum of the frame data received so far
+        uint8_t rx_buffer[XT_RX_MAX];       // Holds the frame data being received
+        uint16_t rx_errors;                 // Frames with bad checksums or lengths
+
+        xt_status_callback status_callback; // Called when a transmit status arrives
+        void* status_context;               // Pointer given to that function
+        xt_receive_callback receive_callback;   // Called when a packet arrives
+        void* receive_context;              // Pointer given to that function
+
+        void dispatch (void);               // Act on a complete received frame
+
+    public:
+        // The constructor saves a pointer to the radio and the destination address
+        xt_api_link (avr_9xtend*, uint16_t = XT_GROUND_ADDRESS);
+
+        // This method gets a new frame ID for a packet whose status is wanted
+        uint8_t new_frame_id (void);
+
+        // This method starts sending a packet of data made of one or two pieces
+        bool send (const uart_segment*, unsigned char, uint8_t = XT_NO_STATUS);
+
+        // This method reads and acts on whatever the radio has sent, without waiting
+        void poll (void);
+
+        // These methods set the functions called when frames arrive from the radio
+        void on_status (xt_status_callback, void*);
+        void on_receive (xt_receive_callback, void*);
+
+        /** This method returns the number of bad frames received from the radio. */
+        uint16_t receive_errors (void) { return (rx_errors); }
+};
+
+#endif // _XT_API_H_
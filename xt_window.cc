@@ -0,0 +1,171 @@
+//======================================================================================
+/** \file  xt_window.cc
+ *  This file contains the window which holds critical telemetry frames until the
+ *  ground radio has acknowledged them. See xt_window.h for details. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>                         // Include standard library header files
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+#include "avr_serial.h"
+#include "avr_9xtend.h"
+#include "stl_us_timer.h"
+#include "tlm_frame.h"
+#include "xt_api.h"
+#include "xt_window.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an empty window. 
+ */
+
+xt_window::xt_window (void)
+{
+    for (uint8_t index = 0; index < XW_SLOTS; index++)
+        slots[index].state = XW_FREE;
+
+    retry_time = XW_RETRY_TIME / USEC_PER_COUNT;
+    delivered = 0;
+    resent = 0;
+    lost = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method copies a frame into a free slot in the window, where it waits to be 
+ *  sent. 
+ *  @param frame A pointer to the encoded frame
+ *  @param length The number of bytes in the frame
+ *  @return True if the frame was taken, false if it's too long or the window is full
+ */
+
+bool xt_window::put (const uint8_t* frame, uint16_t length)
+{
+    if (length > XW_SLOT_BYTES)
+        return (false);
+
+    for (uint8_t index = 0; index < XW_SLOTS; index++)
+    {
+        if (slots[index].state == XW_FREE)
+        {
+            memcpy (slots[index].data, frame, length);
+            slots[index].length = (uint8_t)length;
+            slots[index].tries = 0;
+            slots[index].state = XW_READY;
+            return (true);
+        }
+    }
+
+    return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds a frame which should be sent now. That's a frame which hasn't
+ *  been sent yet, one whose last try failed, or one whose transmit status hasn't come
+ *  back within the retry time. A frame which has been tried XW_MAX_TRIES times is 
+ *  given up for lost and its slot freed. 
+ *  @param time_now The current time in timer counts
+ *  @return The number of the slot to be sent, or -1 if nothing needs sending
+ */
+
+int8_t xt_window::due (uint32_t time_now)
+{
+    for (uint8_t index = 0; index < XW_SLOTS; index++)
+    {
+        xw_slot* p_slot = &slots[index];
+
+        if (p_slot->state == XW_WAITING && time_now - p_slot->sent_time >= retry_time)
+            p_slot->state = XW_READY;
+
+        if (p_slot->state == XW_READY)
+        {
+            if (p_slot->tries < XW_MAX_TRIES)
+                return ((int8_t)index);
+
+            p_slot->state = XW_FREE;
+            lost++;
+        }
+    }
+
+    return (-1);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method records that the frame in a slot has been handed to the radio. 
+ *  @param slot The slot number which due() returned
+ *  @param frame_id The API frame ID the frame was sent with
+ *  @param time_now The current time in timer counts
+ */
+
+void xt_window::sent (int8_t slot, uint8_t frame_id, uint32_t time_now)
+{
+    xw_slot* p_slot = &slots[slot];
+
+    if (p_slot->tries > 0)
+        resent++;
+    p_slot->tries++;
+    p_slot->frame_id = frame_id;
+    p_slot->sent_time = time_now;
+    p_slot->state = XW_WAITING;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method handles a transmit status report from the radio. If the report is for
+ *  a frame in the window, the frame is either freed (success) or marked to be sent 
+ *  again (anything else). 
+ *  @param frame_id The frame ID in the status report
+ *  @param status The status code, XT_TX_SUCCESS if the packet was acknowledged
+ *  @return True if the report was for a frame in this window
+ */
+
+bool xt_window::status (uint8_t frame_id, uint8_t status)
+{
+    for (uint8_t index = 0; index < XW_SLOTS; index++)
+    {
+        xw_slot* p_slot = &slots[index];
+
+        if (p_slot->state == XW_WAITING && p_slot->frame_id == frame_id)
+        {
+            if (status == XT_TX_SUCCESS)
+            {
+                p_slot->state = XW_FREE;
+                delivered++;
+            }
+            else
+                p_slot->state = XW_READY;
+
+            return (true);
+        }
+    }
+
+    return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether the window is empty, so that the radio may be put to
+ *  sleep without leaving frames unsent or unacknowledged. 
+ *  @return True if no frames are in the window
+ */
+
+bool xt_window::idle (void)
+{
+    for (uint8_t index = 0; index < XW_SLOTS; index++)
+        if (slots[index].state != XW_FREE)
+            return (false);
+
+    return (true);
+}
@@ -0,0 +1,107 @@
+//======================================================================================
+/** \file  xt_window.h
+ *  This file contains a small window of critical telemetry frames which are sent to 
+ *  the ground again and again until the ground radio acknowledges them. Ordinary
+ *  sample frames aren't kept; if one is lost, the next one a few milliseconds later 
+ *  is about as good. Frames which can't be replaced, such as replies to commands and
+ *  event reports, are copied into the window, each is sent as its own API packet with
+ *  a frame ID, and the radio's transmit status for that ID says whether it got there.
+ *  Only the frames which failed, or whose status never came back, are sent again, so
+ *  one lost packet doesn't cost the ones which were sent after it. 
+ *
+ *  Revisions:
+ *    \li  10-18-26 DSC Original file
+ *    \li  10-18-26 DSC Slots sized for command replies to save RAM
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#ifndef _XT_WINDOW_H_                       // To prevent *.h file from being included
+#define _XT_WINDOW_H_                       // in a source file more than once
+
+#include <stdint.h>
+
+/** The number of critical frames which may be waiting for acknowledgement at once */
+#define XW_SLOTS            4
+
+/** The largest critical frame which can be kept in the window. Only replies to
+ *  commands are sent as critical frames, so the slots needn't hold a telemetry frame */
+#define XW_SLOT_BYTES       TLM_MESSAGE_MAX
+
+/** How long, in microseconds, to wait for a transmit status before sending again */
+#define XW_RETRY_TIME       250000L
+
+/** How many times a frame is sent before it's given up for lost */
+#define XW_MAX_TRIES        5
+
+// The states a slot in the window can be in
+#define XW_FREE             0               // Nothing in the slot
+#define XW_READY            1               // Frame waiting to be sent (or sent again)
+#define XW_WAITING          2               // Frame sent; waiting for its status
+
+
+//-------------------------------------------------------------------------------------
+/** This class holds critical frames until they're acknowledged. It doesn't send 
+ *  anything itself; the telemetry task asks it which frame is due, sends that frame,
+ *  and passes along transmit status reports as they come from the radio. 
+ */
+
+class xt_window
+{
+    protected:
+        /** Everything known about one frame in the window */
+        typedef struct
+        {
+            uint8_t data[XW_SLOT_BYTES];    // A copy of the frame
+            uint8_t length;                 // Number of bytes in the frame
+            uint8_t state;                  // XW_FREE, XW_READY or XW_WAITING
+            uint8_t frame_id;               // API frame ID it was last sent with
+            uint8_t tries;                  // Number of times it has been sent
+            uint32_t sent_time;             // When it was last sent, in timer counts
+        } xw_slot;
+
+        xw_slot slots[XW_SLOTS];            // The frames in the window
+        uint32_t retry_time;                // Wait for status before resending
+        uint16_t delivered;                 // Frames which were acknowledged
+        uint16_t resent;                    // Times a frame was sent again
+        uint16_t lost;                      // Frames given up after XW_MAX_TRIES
+
+    public:
+        // The constructor creates an empty window
+        xt_window (void);
+
+        // This method copies a frame into the window to be sent
+        bool put (const uint8_t*, uint16_t);
+
+        // This method finds a frame which needs to be sent now, if there is one
+        int8_t due (uint32_t);
+
+        // This method records that a frame has been sent with a given frame ID
+        void sent (int8_t, uint8_t, uint32_t);
+
+        // This method handles a transmit status report from the radio
+        bool status (uint8_t, uint8_t);
+
+        // This method checks if any frames are waiting to be sent or acknowledged
+        bool idle (void);
+
+        /** This method returns a pointer to the frame in a slot. */
+        const uint8_t* data (int8_t slot) { return (slots[slot].data); }
+
+        /** This method returns the number of bytes in the frame in a slot. */
+        uint8_t length (int8_t slot) { return (slots[slot].length); }
+
+        /** This method returns the number of frames which have been acknowledged. */
+        uint16_t frames_delivered (void) { return (delivered); }
+
+        /** This method returns the number of times frames have been sent again. */
+        uint16_t frames_resent (void) { return (resent); }
+
+        /** This method returns the number of frames which never got through. */
+        uint16_t frames_lost (void) { return (lost); }
+};
+
+#endif // _XT_WINDOW_H_